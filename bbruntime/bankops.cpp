@@ -0,0 +1,518 @@
+
+#include "std.h"
+#include "bankops.h"
+
+#include <limits.h>
+#include <emmintrin.h>
+
+static bool sse2=IsProcessorFeaturePresent( PF_XMMI64_INSTRUCTIONS_AVAILABLE ) ? true : false;
+
+//rounds to nearest even, the same as the SSE2 conversions
+static inline int roundClamp( double d,int lo,int hi ){
+	if( d<=lo ) return lo;
+	if( d>=hi ) return hi;
+	return _mm_cvtsd_si32( _mm_set_sd( d ) );
+}
+
+static inline int clampi( int n,int lo,int hi ){
+	return n<lo ? lo : (n>hi ? hi : n);
+}
+
+int bankTypeSize( int type ){
+	return type==BANK_BYTE ? 1 : (type==BANK_SHORT ? 2 : 4);
+}
+
+void bankFill( char *p,int count,int size ){
+	int n=count*size;
+	if( size==1 ){
+		memset( p+1,p[0],n-1 );
+		return;
+	}
+	for( int done=size;done<n;done+=done ){
+		memcpy( p+done,p,done<n-done ? done : n-done );
+	}
+}
+
+/***** Add *****/
+
+static void addBytes( unsigned char *p,int count,int a ){
+	int k=0;
+	if( sse2 ){
+		__m128i v=_mm_set1_epi8( (char)(a<0 ? -a : a) );
+		for( ;k+16<=count;k+=16 ){
+			__m128i x=_mm_loadu_si128( (__m128i*)(p+k) );
+			_mm_storeu_si128( (__m128i*)(p+k),a<0 ? _mm_subs_epu8( x,v ) : _mm_adds_epu8( x,v ) );
+		}
+	}
+	for( ;k<count;++k ) p[k]=clampi( p[k]+a,0,255 );
+}
+
+static void addShorts( short *p,int count,int a ){
+	int k=0;
+	if( sse2 && a>=-32768 && a<=32767 ){
+		__m128i v=_mm_set1_epi16( (short)a );
+		for( ;k+8<=count;k+=8 ){
+			__m128i x=_mm_loadu_si128( (__m128i*)(p+k) );
+			_mm_storeu_si128( (__m128i*)(p+k),_mm_adds_epi16( x,v ) );
+		}
+	}
+	for( ;k<count;++k ) p[k]=clampi( p[k]+a,-32768,32767 );
+}
+
+static void addFloats( float *p,int count,float a ){
+	int k=0;
+	if( sse2 ){
+		__m128 v=_mm_set1_ps( a );
+		for( ;k+4<=count;k+=4 ) _mm_storeu_ps( p+k,_mm_add_ps( _mm_loadu_ps( p+k ),v ) );
+	}
+	for( ;k<count;++k ) p[k]+=a;
+}
+
+void bankAdd( void *p,int count,int type,float value ){
+	switch( type ){
+	case BANK_BYTE:addBytes( (unsigned char*)p,count,roundClamp( value,-255,255 ) );break;
+	case BANK_SHORT:addShorts( (short*)p,count,roundClamp( value,-65535,65535 ) );break;
+	case BANK_INT:
+		for( int *t=(int*)p,*e=t+count;t!=e;++t ) *t=roundClamp( (double)*t+value,INT_MIN,INT_MAX );
+		break;
+	case BANK_FLOAT:addFloats( (float*)p,count,value );break;
+	}
+}
+
+/***** Multiply *****/
+
+static void mulBytes( unsigned char *p,int count,float m ){
+	int k=0;
+	if( sse2 ){
+		__m128 v=_mm_set1_ps( m ),lo=_mm_setzero_ps(),hi=_mm_set1_ps( 255 );
+		__m128i zero=_mm_setzero_si128();
+		for( ;k+16<=count;k+=16 ){
+			__m128i x=_mm_loadu_si128( (__m128i*)(p+k) );
+			__m128i w[2]={ _mm_unpacklo_epi8( x,zero ),_mm_unpackhi_epi8( x,zero ) },r[4];
+			for( int j=0;j<4;++j ){
+				__m128i d=(j&1) ? _mm_unpackhi_epi16( w[j>>1],zero ) : _mm_unpacklo_epi16( w[j>>1],zero );
+				__m128 f=_mm_mul_ps( _mm_cvtepi32_ps( d ),v );
+				r[j]=_mm_cvtps_epi32( _mm_min_ps( _mm_max_ps( f,lo ),hi ) );
+			}
+			_mm_storeu_si128( (__m128i*)(p+k),_mm_packus_epi16( _mm_packs_epi32( r[0],r[1] ),_mm_packs_epi32( r[2],r[3] ) ) );
+		}
+	}
+	for( ;k<count;++k ){
+		float f=p[k]*m;
+		p[k]=roundClamp( f,0,255 );
+	}
+}
+
+static void mulShorts( short *p,int count,float m ){
+	int k=0;
+	if( sse2 ){
+		__m128 v=_mm_set1_ps( m ),lo=_mm_set1_ps( -32768 ),hi=_mm_set1_ps( 32767 );
+		for( ;k+8<=count;k+=8 ){
+			__m128i x=_mm_loadu_si128( (__m128i*)(p+k) );
+			__m128i d0=_mm_srai_epi32( _mm_unpacklo_epi16( x,x ),16 );
+			__m128i d1=_mm_srai_epi32( _mm_unpackhi_epi16( x,x ),16 );
+			__m128 f0=_mm_min_ps( _mm_max_ps( _mm_mul_ps( _mm_cvtepi32_ps( d0 ),v ),lo ),hi );
+			__m128 f1=_mm_min_ps( _mm_max_ps( _mm_mul_ps( _mm_cvtepi32_ps( d1 ),v ),lo ),hi );
+			_mm_storeu_si128( (__m128i*)(p+k),_mm_packs_epi32( _mm_cvtps_epi32( f0 ),_mm_cvtps_epi32( f1 ) ) );
+		}
+	}
+	for( ;k<count;++k ){
+		float f=p[k]*m;
+		p[k]=roundClamp( f,-32768,32767 );
+	}
+}
+
+static void mulFloats( float *p,int count,float m ){
+	int k=0;
+	if( sse2 ){
+		__m128 v=_mm_set1_ps( m );
+		for( ;k+4<=count;k+=4 ) _mm_storeu_ps( p+k,_mm_mul_ps( _mm_loadu_ps( p+k ),v ) );
+	}
+	for( ;k<count;++k ) p[k]*=m;
+}
+
+void bankMul( void *p,int count,int type,float value ){
+	switch( type ){
+	case BANK_BYTE:mulBytes( (unsigned char*)p,count,value );break;
+	case BANK_SHORT:mulShorts( (short*)p,count,value );break;
+	case BANK_INT:
+		for( int *t=(int*)p,*e=t+count;t!=e;++t ) *t=roundClamp( (double)*t*value,INT_MIN,INT_MAX );
+		break;
+	case BANK_FLOAT:mulFloats( (float*)p,count,value );break;
+	}
+}
+
+/***** Clamp *****/
+
+static void clampBytes( unsigned char *p,int count,int lo,int hi ){
+	int k=0;
+	if( sse2 ){
+		__m128i vlo=_mm_set1_epi8( (char)lo ),vhi=_mm_set1_epi8( (char)hi );
+		for( ;k+16<=count;k+=16 ){
+			__m128i x=_mm_loadu_si128( (__m128i*)(p+k) );
+			_mm_storeu_si128( (__m128i*)(p+k),_mm_min_epu8( _mm_max_epu8( x,vlo ),vhi ) );
+		}
+	}
+	for( ;k<count;++k ){
+		int n=p[k]<lo ? lo : p[k];
+		p[k]=n>hi ? hi : n;
+	}
+}
+
+static void clampShorts( short *p,int count,int lo,int hi ){
+	int k=0;
+	if( sse2 ){
+		__m128i vlo=_mm_set1_epi16( (short)lo ),vhi=_mm_set1_epi16( (short)hi );
+		for( ;k+8<=count;k+=8 ){
+			__m128i x=_mm_loadu_si128( (__m128i*)(p+k) );
+			_mm_storeu_si128( (__m128i*)(p+k),_mm_min_epi16( _mm_max_epi16( x,vlo ),vhi ) );
+		}
+	}
+	for( ;k<count;++k ){
+		int n=p[k]<lo ? lo : p[k];
+		p[k]=n>hi ? hi : n;
+	}
+}
+
+static void clampFloats( float *p,int count,float lo,float hi ){
+	int k=0;
+	if( sse2 ){
+		__m128 vlo=_mm_set1_ps( lo ),vhi=_mm_set1_ps( hi );
+		for( ;k+4<=count;k+=4 ) _mm_storeu_ps( p+k,_mm_min_ps( _mm_max_ps( _mm_loadu_ps( p+k ),vlo ),vhi ) );
+	}
+	for( ;k<count;++k ){
+		float n=p[k]<lo ? lo : p[k];
+		p[k]=n>hi ? hi : n;
+	}
+}
+
+void bankClamp( void *p,int count,int type,float lo,float hi ){
+	switch( type ){
+	case BANK_BYTE:clampBytes( (unsigned char*)p,count,roundClamp( lo,0,255 ),roundClamp( hi,0,255 ) );break;
+	case BANK_SHORT:clampShorts( (short*)p,count,roundClamp( lo,-32768,32767 ),roundClamp( hi,-32768,32767 ) );break;
+	case BANK_INT:{
+		int l=roundClamp( lo,INT_MIN,INT_MAX ),h=roundClamp( hi,INT_MIN,INT_MAX );
+		for( int *t=(int*)p,*e=t+count;t!=e;++t ){
+			int n=*t<l ? l : *t;
+			*t=n>h ? h : n;
+		}
+		break;
+	}
+	case BANK_FLOAT:clampFloats( (float*)p,count,lo,hi );break;
+	}
+}
+
+/***** Min/Max *****/
+
+//min if !max
+template<class T>
+static T scalarExtreme( const T *p,int count,T r,bool max ){
+	for( int k=0;k<count;++k ){
+		if( max ? p[k]>r : p[k]<r ) r=p[k];
+	}
+	return r;
+}
+
+static int extremeBytes( const unsigned char *p,int count,bool max ){
+	int k=0;
+	unsigned char r=p[0];
+	if( sse2 && count>=16 ){
+		__m128i v=_mm_loadu_si128( (__m128i*)p );
+		for( k=16;k+16<=count;k+=16 ){
+			__m128i x=_mm_loadu_si128( (__m128i*)(p+k) );
+			v=max ? _mm_max_epu8( v,x ) : _mm_min_epu8( v,x );
+		}
+		unsigned char t[16];
+		_mm_storeu_si128( (__m128i*)t,v );
+		r=scalarExtreme( t,16,t[0],max );
+	}
+	return scalarExtreme( p+k,count-k,r,max );
+}
+
+static int extremeShorts( const short *p,int count,bool max ){
+	int k=0;
+	short r=p[0];
+	if( sse2 && count>=8 ){
+		__m128i v=_mm_loadu_si128( (__m128i*)p );
+		for( k=8;k+8<=count;k+=8 ){
+			__m128i x=_mm_loadu_si128( (__m128i*)(p+k) );
+			v=max ? _mm_max_epi16( v,x ) : _mm_min_epi16( v,x );
+		}
+		short t[8];
+		_mm_storeu_si128( (__m128i*)t,v );
+		r=scalarExtreme( t,8,t[0],max );
+	}
+	return scalarExtreme( p+k,count-k,r,max );
+}
+
+static float extremeFloats( const float *p,int count,bool max ){
+	int k=0;
+	float r=p[0];
+	if( sse2 && count>=4 ){
+		__m128 v=_mm_loadu_ps( p );
+		for( k=4;k+4<=count;k+=4 ){
+			__m128 x=_mm_loadu_ps( p+k );
+			v=max ? _mm_max_ps( v,x ) : _mm_min_ps( v,x );
+		}
+		float t[4];
+		_mm_storeu_ps( t,v );
+		r=scalarExtreme( t,4,t[0],max );
+	}
+	return scalarExtreme( p+k,count-k,r,max );
+}
+
+static float extreme( const void *p,int count,int type,bool max ){
+	switch( type ){
+	case BANK_BYTE:return extremeBytes( (const unsigned char*)p,count,max );
+	case BANK_SHORT:return extremeShorts( (const short*)p,count,max );
+	case BANK_INT:return scalarExtreme( (const int*)p,count,*(const int*)p,max );
+	case BANK_FLOAT:return extremeFloats( (const float*)p,count,max );
+	}
+	return 0;
+}
+
+float bankMin( const void *p,int count,int type ){
+	return extreme( p,count,type,false );
+}
+
+float bankMax( const void *p,int count,int type ){
+	return extreme( p,count,type,true );
+}
+
+/***** Sum *****/
+
+static double sumBytes( const unsigned char *p,int count ){
+	int k=0;
+	double sum=0;
+	if( sse2 ){
+		__m128i acc=_mm_setzero_si128(),zero=_mm_setzero_si128();
+		for( ;k+16<=count;k+=16 ){
+			acc=_mm_add_epi64( acc,_mm_sad_epu8( _mm_loadu_si128( (__m128i*)(p+k) ),zero ) );
+		}
+		unsigned t[4];
+		_mm_storeu_si128( (__m128i*)t,acc );
+		sum=(double)t[0]+(double)t[1]*4294967296.0+(double)t[2]+(double)t[3]*4294967296.0;
+	}
+	for( ;k<count;++k ) sum+=p[k];
+	return sum;
+}
+
+static double sumShorts( const short *p,int count ){
+	int k=0;
+	double sum=0;
+	if( sse2 ){
+		__m128i ones=_mm_set1_epi16( 1 );
+		while( k+8<=count ){
+			//int lanes can take 16384 rounds of pairs before they could overflow
+			int e=count-(count-k)%8,n=k+16384*8;
+			if( n<e ) e=n;
+			__m128i acc=_mm_setzero_si128();
+			for( ;k<e;k+=8 ) acc=_mm_add_epi32( acc,_mm_madd_epi16( _mm_loadu_si128( (__m128i*)(p+k) ),ones ) );
+			int t[4];
+			_mm_storeu_si128( (__m128i*)t,acc );
+			sum+=(double)t[0]+t[1]+t[2]+t[3];
+		}
+	}
+	for( ;k<count;++k ) sum+=p[k];
+	return sum;
+}
+
+static double sumFloats( const float *p,int count ){
+	int k=0;
+	double sum=0;
+	if( sse2 ){
+		__m128d a0=_mm_setzero_pd(),a1=_mm_setzero_pd();
+		for( ;k+4<=count;k+=4 ){
+			__m128 x=_mm_loadu_ps( p+k );
+			a0=_mm_add_pd( a0,_mm_cvtps_pd( x ) );
+			a1=_mm_add_pd( a1,_mm_cvtps_pd( _mm_movehl_ps( x,x ) ) );
+		}
+		double t[2];
+		_mm_storeu_pd( t,_mm_add_pd( a0,a1 ) );
+		sum=t[0]+t[1];
+	}
+	for( ;k<count;++k ) sum+=p[k];
+	return sum;
+}
+
+double bankSum( const void *p,int count,int type ){
+	switch( type ){
+	case BANK_BYTE:return sumBytes( (const unsigned char*)p,count );
+	case BANK_SHORT:return sumShorts( (const short*)p,count );
+	case BANK_INT:{
+		double sum=0;
+		for( const int *t=(const int*)p,*e=t+count;t!=e;++t ) sum+=*t;
+		return sum;
+	}
+	case BANK_FLOAT:return sumFloats( (const float*)p,count );
+	}
+	return 0;
+}
+
+/***** Byte swap *****/
+
+void bankSwap( void *p,int count,int size ){
+	int k=0;
+	if( size==2 ){
+		unsigned short *t=(unsigned short*)p;
+		if( sse2 ){
+			for( ;k+8<=count;k+=8 ){
+				__m128i x=_mm_loadu_si128( (__m128i*)(t+k) );
+				_mm_storeu_si128( (__m128i*)(t+k),_mm_or_si128( _mm_slli_epi16( x,8 ),_mm_srli_epi16( x,8 ) ) );
+			}
+		}
+		for( ;k<count;++k ) t[k]=(t[k]<<8)|(t[k]>>8);
+	}else if( size==4 ){
+		unsigned *t=(unsigned*)p;
+		if( sse2 ){
+			for( ;k+4<=count;k+=4 ){
+				__m128i x=_mm_loadu_si128( (__m128i*)(t+k) );
+				x=_mm_or_si128( _mm_slli_epi16( x,8 ),_mm_srli_epi16( x,8 ) );
+				x=_mm_shufflehi_epi16( _mm_shufflelo_epi16( x,_MM_SHUFFLE(2,3,0,1) ),_MM_SHUFFLE(2,3,0,1) );
+				_mm_storeu_si128( (__m128i*)(t+k),x );
+			}
+		}
+		for( ;k<count;++k ){
+			unsigned n=t[k];
+			t[k]=(n<<24)|((n<<8)&0xff0000)|((n>>8)&0xff00)|(n>>24);
+		}
+	}
+}
+
+/***** Find *****/
+
+static inline int firstBit( int m ){
+	int k=0;
+	while( !(m&1) ){ m>>=1;++k; }
+	return k;
+}
+
+static int findShorts( const short *p,int count,short value ){
+	int k=0;
+	if( sse2 ){
+		__m128i v=_mm_set1_epi16( value );
+		for( ;k+8<=count;k+=8 ){
+			if( int m=_mm_movemask_epi8( _mm_cmpeq_epi16( _mm_loadu_si128( (__m128i*)(p+k) ),v ) ) ){
+				return k+firstBit( m )/2;
+			}
+		}
+	}
+	for( ;k<count;++k ) if( p[k]==value ) return k;
+	return -1;
+}
+
+static int findInts( const int *p,int count,int value ){
+	int k=0;
+	if( sse2 ){
+		__m128i v=_mm_set1_epi32( value );
+		for( ;k+4<=count;k+=4 ){
+			__m128i eq=_mm_cmpeq_epi32( _mm_loadu_si128( (__m128i*)(p+k) ),v );
+			if( int m=_mm_movemask_ps( _mm_castsi128_ps( eq ) ) ) return k+firstBit( m );
+		}
+	}
+	for( ;k<count;++k ) if( p[k]==value ) return k;
+	return -1;
+}
+
+static int findFloats( const float *p,int count,float value ){
+	int k=0;
+	if( sse2 ){
+		__m128 v=_mm_set1_ps( value );
+		for( ;k+4<=count;k+=4 ){
+			if( int m=_mm_movemask_ps( _mm_cmpeq_ps( _mm_loadu_ps( p+k ),v ) ) ) return k+firstBit( m );
+		}
+	}
+	for( ;k<count;++k ) if( p[k]==value ) return k;
+	return -1;
+}
+
+int bankFind( const void *p,int count,int type,int value ){
+	switch( type ){
+	case BANK_BYTE:{
+		const char *t=(const char*)memchr( p,value,count );
+		return t ? t-(const char*)p : -1;
+	}
+	case BANK_SHORT:return findShorts( (const short*)p,count,(short)value );
+	case BANK_INT:return findInts( (const int*)p,count,value );
+	case BANK_FLOAT:return findFloats( (const float*)p,count,(float)value );
+	}
+	return -1;
+}
+
+int bankFindFloat( const float *p,int count,float value ){
+	return findFloats( p,count,value );
+}
+
+/***** Checksums *****/
+
+//slice by 4 tables
+static unsigned crc_table[4][256];
+
+static bool initCRC(){
+	for( int k=0;k<256;++k ){
+		unsigned c=k;
+		for( int j=0;j<8;++j ) c=(c&1) ? 0xedb88320^(c>>1) : c>>1;
+		crc_table[0][k]=c;
+	}
+	for( int k=0;k<256;++k ){
+		for( int j=1;j<4;++j ){
+			unsigned c=crc_table[j-1][k];
+			crc_table[j][k]=(c>>8)^crc_table[0][c&255];
+		}
+	}
+	return true;
+}
+
+static bool crc_init=initCRC();
+
+unsigned bankCRC32( const void *p,int n ){
+	const unsigned char *t=(const unsigned char*)p;
+	unsigned c=0xffffffff;
+	for( ;n && ((size_t)t&3);--n ) c=crc_table[0][(c^*t++)&255]^(c>>8);
+	for( ;n>=4;n-=4,t+=4 ){
+		c^=*(const unsigned*)t;
+		c=crc_table[3][c&255]^crc_table[2][(c>>8)&255]^crc_table[1][(c>>16)&255]^crc_table[0][c>>24];
+	}
+	for( ;n;--n ) c=crc_table[0][(c^*t++)&255]^(c>>8);
+	return ~c;
+}
+
+static const unsigned PRIME1=2654435761u,PRIME2=2246822519u,PRIME3=3266489917u,PRIME4=668265263u,PRIME5=374761393u;
+
+static inline unsigned rotl( unsigned n,int r ){
+	return (n<<r)|(n>>(32-r));
+}
+
+static inline unsigned read32( const unsigned char *p ){
+	unsigned n;
+	memcpy( &n,p,4 );
+	return n;
+}
+
+static inline unsigned round32( unsigned acc,unsigned n ){
+	return rotl( acc+n*PRIME2,13 )*PRIME1;
+}
+
+unsigned bankHash( const void *p,int n ){
+	const unsigned char *t=(const unsigned char*)p,*e=t+n;
+	unsigned h;
+	if( n>=16 ){
+		unsigned v1=PRIME1+PRIME2,v2=PRIME2,v3=0,v4=0-PRIME1;
+		for( ;e-t>=16;t+=16 ){
+			v1=round32( v1,read32( t ) );
+			v2=round32( v2,read32( t+4 ) );
+			v3=round32( v3,read32( t+8 ) );
+			v4=round32( v4,read32( t+12 ) );
+		}
+		h=rotl( v1,1 )+rotl( v2,7 )+rotl( v3,12 )+rotl( v4,18 );
+	}else{
+		h=PRIME5;
+	}
+	h+=n;
+	for( ;e-t>=4;t+=4 ) h=rotl( h+read32( t )*PRIME3,17 )*PRIME4;
+	for( ;t<e;++t ) h=rotl( h+*t*PRIME5,11 )*PRIME1;
+	h^=h>>15;h*=PRIME2;
+	h^=h>>13;h*=PRIME3;
+	h^=h>>16;
+	return h;
+}
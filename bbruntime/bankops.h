@@ -0,0 +1,38 @@
+
+#ifndef BANKOPS_H
+#define BANKOPS_H
+
+//Bulk operations over typed spans of bank memory.
+//
+//Bytes are unsigned, shorts signed. Integer results are rounded to nearest
+//and saturate to the range of the type.
+enum{
+	BANK_BYTE=1,BANK_SHORT,BANK_INT,BANK_FLOAT
+};
+
+int bankTypeSize( int type );
+
+//repeats the first size bytes at p through count elements
+void bankFill( char *p,int count,int size );
+
+void bankAdd( void *p,int count,int type,float value );
+void bankMul( void *p,int count,int type,float value );
+void bankClamp( void *p,int count,int type,float lo,float hi );
+
+//count must be at least 1
+float bankMin( const void *p,int count,int type );
+float bankMax( const void *p,int count,int type );
+double bankSum( const void *p,int count,int type );
+
+//reverses the bytes of count elements of size 2 or 4
+void bankSwap( void *p,int count,int size );
+
+//index of first element equal to value, or -1
+int bankFind( const void *p,int count,int type,int value );
+int bankFindFloat( const float *p,int count,float value );
+
+//zlib compatible crc32 and xxHash32 with seed 0
+unsigned bankCRC32( const void *p,int n );
+unsigned bankHash( const void *p,int n );
+
+#endif
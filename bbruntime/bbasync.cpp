@@ -0,0 +1,424 @@
+
+#include "std.h"
+#include "bbasync.h"
+#include "bbaudio.h"
+#include "bbgraphics.h"
+#include "bbbank.h"
+
+#ifdef PRO
+#include "bbblitz3d.h"
+#endif
+
+#include <deque>
+#include <algorithm>
+
+//Background loading.
+//
+//Worker threads only do the parts of a load that don't touch the gx or blitz3d
+//objects: reading files and decoding images. Everything else - surfaces, FMOD
+//samples, entities - is created on the main thread when the load is claimed,
+//using the normal load commands with the decoded images handed to gx_graphics.
+//
+//File reads and writes to banks go straight between the file and the bank's
+//memory on a worker. Freeing or resizing a bank waits for any transfer using it.
+
+enum{
+	ASYNC_IMAGE,ASYNC_SOUND,ASYNC_TEXTURE,ASYNC_MESH,ASYNC_ANIMMESH,
+	ASYNC_READ,ASYNC_WRITE
+};
+
+struct bbAsyncLoad{
+	int type,flags;
+	string file;
+	string tex_path;		//texture path of a mesh
+	HANDLE done;
+	bool ok;
+
+	//file transfers
+	bbBank *bank;
+	int offset,count;
+	bool append;
+	int bytes;
+
+	//results
+	mmapfile data;
+	vector<pair<string,ddUtil::Image*> > images;
+
+	bbAsyncLoad( int type,const string &file,int flags ):
+	type(type),flags(flags),file(file),ok(false),
+	bank(0),offset(0),count(0),append(false),bytes(0){
+		done=CreateEvent( 0,TRUE,FALSE,0 );
+	}
+	~bbAsyncLoad(){
+		for( int k=0;k<images.size();++k ) ddUtil::freeImage( images[k].second );
+		CloseHandle( done );
+	}
+};
+
+static ptrset<bbAsyncLoad> load_set;
+static deque<bbAsyncLoad*> load_queue;
+
+static CRITICAL_SECTION queue_lock;
+static HANDLE queue_sem;
+static vector<HANDLE> workers;
+static bool quit;
+static int bank_io;		//requests that may still touch a bank
+
+static inline void debugAsyncLoad( bbAsyncLoad *r ){
+	if( debug ){
+		if( !load_set.count( r ) ) RTEX( "Async load does not exist" );
+	}
+}
+
+static bool isExt( const string &f,const string &ext ){
+	return f.size()>ext.size() && tolower( f.substr( f.size()-ext.size() ) )==ext;
+}
+
+//fault a mapped file into memory so the main thread doesn't wait on the disk
+static void touch( const mmapfile &m ){
+	const char *p=m.data();
+	volatile char t=0;
+	for( int k=0;k<m.size();k+=4096 ) t+=p[k];
+}
+
+//texture names from the TEXS chunk of a .b3d
+static void scanB3DTextures( const char *p,const char *e,vector<string> &names ){
+	if( e-p<12 || memcmp( p,"BB3D",4 ) ) return;
+	int sz;memcpy( &sz,p+4,4 );
+	if( sz>=4 && sz<=e-p-8 ) e=p+8+sz;
+	p+=12;
+	while( e-p>=8 ){
+		memcpy( &sz,p+4,4 );
+		const char *t=p+8,*end=(sz<0 || sz>e-t) ? e : t+sz;
+		if( !memcmp( p,"TEXS",4 ) ){
+			while( t<end ){
+				const char *z=(const char*)memchr( t,0,end-t );
+				if( !z ) break;
+				names.push_back( string( t,z ) );
+				t=z+1+28;
+			}
+		}
+		p=end;
+	}
+}
+
+static void transfer( bbAsyncLoad *r ){
+	HANDLE h;
+	if( r->type==ASYNC_READ ){
+		h=CreateFile( r->file.c_str(),GENERIC_READ,FILE_SHARE_READ,0,OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,0 );
+	}else{
+		h=CreateFile( r->file.c_str(),GENERIC_WRITE,0,0,r->append ? OPEN_ALWAYS : CREATE_ALWAYS,FILE_ATTRIBUTE_NORMAL,0 );
+		if( h!=INVALID_HANDLE_VALUE && r->append ) SetFilePointer( h,0,0,FILE_END );
+	}
+	if( h==INVALID_HANDLE_VALUE ) return;
+
+	char *p=r->bank->data+r->offset;
+	r->ok=true;
+	while( r->bytes<r->count ){
+		DWORD n=0;
+		if( r->type==ASYNC_READ ){
+			if( !ReadFile( h,p+r->bytes,r->count-r->bytes,&n,0 ) ) r->ok=false;
+		}else{
+			if( !WriteFile( h,p+r->bytes,r->count-r->bytes,&n,0 ) ) r->ok=false;
+		}
+		if( !r->ok || !n ) break;
+		r->bytes+=n;
+	}
+	if( r->type==ASYNC_WRITE && r->bytes<r->count ) r->ok=false;
+	CloseHandle( h );
+}
+
+static void run( bbAsyncLoad *r ){
+	switch( r->type ){
+	case ASYNC_IMAGE:case ASYNC_TEXTURE:
+		if( ddUtil::Image *img=ddUtil::decodeImage( r->file ) ){
+			r->images.push_back( make_pair( r->file,img ) );
+			r->ok=true;
+		}
+		break;
+	case ASYNC_SOUND:
+		if( r->ok=r->data.open( r->file ) ) touch( r->data );
+		break;
+	case ASYNC_MESH:case ASYNC_ANIMMESH:
+		if( r->ok=r->data.open( r->file ) ){
+			touch( r->data );
+			vector<string> names;
+			if( isExt( r->file,".b3d" ) ){
+				scanB3DTextures( r->data.data(),r->data.data()+r->data.size(),names );
+			}
+			for( int k=0;k<names.size();++k ){
+				string t=r->tex_path+tolower( filenamefile( names[k] ) );
+				if( ddUtil::Image *img=ddUtil::decodeImage( t ) ){
+					r->images.push_back( make_pair( t,img ) );
+				}
+			}
+		}
+		r->data.close();
+		break;
+	case ASYNC_READ:case ASYNC_WRITE:
+		transfer( r );
+		break;
+	}
+}
+
+static DWORD WINAPI workerProc( void * ){
+	for(;;){
+		WaitForSingleObject( queue_sem,INFINITE );
+		EnterCriticalSection( &queue_lock );
+		if( quit ){
+			LeaveCriticalSection( &queue_lock );
+			return 0;
+		}
+		bbAsyncLoad *r=0;
+		if( load_queue.size() ){
+			r=load_queue.front();
+			load_queue.pop_front();
+		}
+		LeaveCriticalSection( &queue_lock );
+		if( !r ) continue;
+		run( r );
+		SetEvent( r->done );
+	}
+}
+
+static void startWorkers(){
+	if( workers.size() ) return;
+
+	ddUtil::initImages();
+
+	SYSTEM_INFO si;
+	GetSystemInfo( &si );
+	int n=si.dwNumberOfProcessors-1;
+	if( n<1 ) n=1;else if( n>4 ) n=4;
+
+	quit=false;
+	for( int k=0;k<n;++k ){
+		DWORD id;
+		if( HANDLE t=CreateThread( 0,0,workerProc,0,0,&id ) ){
+			SetThreadPriority( t,THREAD_PRIORITY_BELOW_NORMAL );
+			workers.push_back( t );
+		}
+	}
+}
+
+static void stopWorkers(){
+	if( !workers.size() ) return;
+
+	EnterCriticalSection( &queue_lock );
+	quit=true;
+	LeaveCriticalSection( &queue_lock );
+	ReleaseSemaphore( queue_sem,workers.size(),0 );
+
+	WaitForMultipleObjects( workers.size(),&workers[0],TRUE,INFINITE );
+	for( int k=0;k<workers.size();++k ) CloseHandle( workers[k] );
+	workers.clear();
+}
+
+static bbAsyncLoad *request( bbAsyncLoad *r ){
+	load_set.insert( r );
+	if( r->bank ) ++bank_io;
+
+	startWorkers();
+	if( !workers.size() ){
+		run( r );
+		SetEvent( r->done );
+		return r;
+	}
+
+	EnterCriticalSection( &queue_lock );
+	load_queue.push_back( r );
+	LeaveCriticalSection( &queue_lock );
+	ReleaseSemaphore( queue_sem,1,0 );
+	return r;
+}
+
+//pulls r off the queue if nothing has started it yet, otherwise waits for it
+static void complete( bbAsyncLoad *r ){
+	EnterCriticalSection( &queue_lock );
+	deque<bbAsyncLoad*>::iterator it=find( load_queue.begin(),load_queue.end(),r );
+	bool queued=it!=load_queue.end();
+	if( queued ) load_queue.erase( it );
+	LeaveCriticalSection( &queue_lock );
+
+	if( queued ){
+		run( r );
+		SetEvent( r->done );
+	}else{
+		WaitForSingleObject( r->done,INFINITE );
+	}
+}
+
+static void release( bbAsyncLoad *r ){
+	if( r->bank ) --bank_io;
+	load_set.erase( r );
+	delete r;
+}
+
+bbAsyncLoad *bbLoadImageAsync( BBStr *f ){
+	string t=*f;delete f;
+	return request( d_new bbAsyncLoad( ASYNC_IMAGE,t,0 ) );
+}
+
+bbAsyncLoad *bbLoadSoundAsync( BBStr *f ){
+	string t=*f;delete f;
+	return request( d_new bbAsyncLoad( ASYNC_SOUND,t,0 ) );
+}
+
+bbAsyncLoad *bbLoadTextureAsync( BBStr *f,int flags ){
+	string t=*f;delete f;
+	//same name CachedTexture will ask gx_graphics for
+	if( t.substr(0,2)==".\\" ) t=t.substr(2);
+	return request( d_new bbAsyncLoad( ASYNC_TEXTURE,tolower( fullfilename( t ) ),flags ) );
+}
+
+static bbAsyncLoad *requestMesh( int type,BBStr *f ){
+	string t=*f;delete f;
+	bbAsyncLoad *r=d_new bbAsyncLoad( type,t,0 );
+	//same texture path loadEntity will use
+	r->tex_path=tolower( filenamepath( tolower( t ) ) );
+	if( int sz=r->tex_path.size() ){
+		if( r->tex_path[sz-1]!='/' && r->tex_path[sz-1]!='\\' ) r->tex_path+='\\';
+	}
+	return request( r );
+}
+
+bbAsyncLoad *bbLoadMeshAsync( BBStr *f ){
+	return requestMesh( ASYNC_MESH,f );
+}
+
+bbAsyncLoad *bbLoadAnimMeshAsync( BBStr *f ){
+	return requestMesh( ASYNC_ANIMMESH,f );
+}
+
+int bbAsyncLoadStatus( bbAsyncLoad *r ){
+	debugAsyncLoad( r );
+	if( WaitForSingleObject( r->done,0 )!=WAIT_OBJECT_0 ) return 0;
+	return r->ok ? 1 : -1;
+}
+
+void *bbClaimAsyncLoad( bbAsyncLoad *r,void *parent ){
+	debugAsyncLoad( r );
+	complete( r );
+
+	void *t=0;
+	if( r->ok ){
+		if( gx_graphics ){
+			for( int k=0;k<r->images.size();++k ){
+				gx_graphics->preloadCanvas( r->images[k].first,r->images[k].second );
+			}
+			r->images.clear();
+		}
+		switch( r->type ){
+		case ASYNC_IMAGE:
+			t=bbLoadImage( d_new BBStr( r->file ) );
+			break;
+		case ASYNC_SOUND:
+			if( gx_audio ) t=gx_audio->loadSound( r->data.data(),r->data.size(),false );
+			break;
+#ifdef PRO
+		case ASYNC_TEXTURE:
+			t=bbLoadTexture( d_new BBStr( r->file ),r->flags );
+			break;
+		case ASYNC_MESH:
+			t=bbLoadMesh( d_new BBStr( r->file ),(Entity*)parent );
+			break;
+		case ASYNC_ANIMMESH:
+			t=bbLoadAnimMesh( d_new BBStr( r->file ),(Entity*)parent );
+			break;
+#endif
+		}
+		if( gx_graphics ) gx_graphics->flushPreloads();
+	}
+	release( r );
+	return t;
+}
+
+void bbFreeAsyncLoad( bbAsyncLoad *r ){
+	if( !r ) return;
+	debugAsyncLoad( r );
+	complete( r );
+	release( r );
+}
+
+static bbAsyncLoad *requestTransfer( int type,BBStr *f,bbBank *b,int offset,int count ){
+	string t=*f;delete f;
+	if( count<0 ){
+		debugBank( b );
+		count=b->size-offset;
+	}
+	if( debug ){
+		if( offset<0 || count<0 ) RTEX( "Illegal bank range" );
+		if( count ) debugBank( b,offset+count-1 );
+		else debugBank( b );
+	}
+	bbAsyncLoad *r=d_new bbAsyncLoad( type,t,0 );
+	r->bank=b;
+	r->offset=offset;
+	r->count=count;
+	return r;
+}
+
+bbAsyncLoad *bbReadBankAsync( BBStr *f,bbBank *b,int offset,int count ){
+	return request( requestTransfer( ASYNC_READ,f,b,offset,count ) );
+}
+
+bbAsyncLoad *bbWriteBankAsync( BBStr *f,bbBank *b,int offset,int count,int append ){
+	bbAsyncLoad *r=requestTransfer( ASYNC_WRITE,f,b,offset,count );
+	r->append=append ? true : false;
+	return request( r );
+}
+
+int bbFinishAsyncIO( bbAsyncLoad *r ){
+	debugAsyncLoad( r );
+	if( debug ){
+		if( !r->bank ) RTEX( "Async request is not a file transfer" );
+	}
+	complete( r );
+	int n=r->ok ? r->bytes : -1;
+	release( r );
+	return n;
+}
+
+void bbCompleteBankIO( bbBank *b ){
+	if( !bank_io ) return;
+	ptrset<bbAsyncLoad>::const_iterator it;
+	for( it=load_set.begin();it!=load_set.end();++it ){
+		if( (*it)->bank==b ) complete( *it );
+	}
+}
+
+bool async_create(){
+	InitializeCriticalSection( &queue_lock );
+	queue_sem=CreateSemaphore( 0,0,0x7fffffff,0 );
+	return queue_sem!=0;
+}
+
+bool async_destroy(){
+	stopWorkers();
+	load_queue.clear();
+	while( load_set.size() ){
+		bbAsyncLoad *r=*load_set.begin();
+		load_set.erase( r );
+		delete r;
+	}
+	bank_io=0;
+	CloseHandle( queue_sem );
+	DeleteCriticalSection( &queue_lock );
+	return true;
+}
+
+void async_link( void (*rtSym)( const char *sym,void *pc ) ){
+	rtSym( "%LoadImageAsync$bmpfile",bbLoadImageAsync );
+	rtSym( "%LoadSoundAsync$filename",bbLoadSoundAsync );
+#ifdef PRO
+	rtSym( "%LoadTextureAsync$file%flags=1",bbLoadTextureAsync );
+	rtSym( "%LoadMeshAsync$file",bbLoadMeshAsync );
+	rtSym( "%LoadAnimMeshAsync$file",bbLoadAnimMeshAsync );
+#endif
+	rtSym( "%AsyncLoadStatus%request",bbAsyncLoadStatus );
+	rtSym( "%ClaimAsyncLoad%request%parent=0",bbClaimAsyncLoad );
+	rtSym( "FreeAsyncLoad%request",bbFreeAsyncLoad );
+	rtSym( "%ReadBankAsync$file%bank%offset=0%count=-1",bbReadBankAsync );
+	rtSym( "%WriteBankAsync$file%bank%offset=0%count=-1%append=0",bbWriteBankAsync );
+	rtSym( "%FinishAsyncIO%request",bbFinishAsyncIO );
+}
@@ -0,0 +1,25 @@
+
+#ifndef BBASYNC_H
+#define BBASYNC_H
+
+#include "bbsys.h"
+
+struct bbAsyncLoad;
+struct bbBank;
+
+bbAsyncLoad *	 bbLoadImageAsync( BBStr *file );
+bbAsyncLoad *	 bbLoadSoundAsync( BBStr *file );
+bbAsyncLoad *	 bbLoadTextureAsync( BBStr *file,int flags );
+bbAsyncLoad *	 bbLoadMeshAsync( BBStr *file );
+bbAsyncLoad *	 bbLoadAnimMeshAsync( BBStr *file );
+int				 bbAsyncLoadStatus( bbAsyncLoad *r );
+void *			 bbClaimAsyncLoad( bbAsyncLoad *r,void *parent );
+void			 bbFreeAsyncLoad( bbAsyncLoad *r );
+bbAsyncLoad *	 bbReadBankAsync( BBStr *file,bbBank *b,int offset,int count );
+bbAsyncLoad *	 bbWriteBankAsync( BBStr *file,bbBank *b,int offset,int count,int append );
+int				 bbFinishAsyncIO( bbAsyncLoad *r );
+
+//waits for any async transfer using b
+void			 bbCompleteBankIO( bbBank *b );
+
+#endif
@@ -2,44 +2,99 @@
 #include "std.h"
 #include "bbbank.h"
 #include "bbstream.h"
+#include "bbasync.h"
+#include "bankops.h"
+#include "lzblock.h"
 
-struct bbBank{
-	char *data;
-	int size,capacity;
+static ptrset<bbBank> bank_set;
 
-	bbBank( int sz ):size(sz){
-		capacity=(size+15)&~15;
-		data=d_new char[capacity];
-		memset( data,0,size );
+//Stream reading and writing a bank at a cursor, growing it as it's written
+struct bbBankStream : public bbStream{
+	bbBank *bank;		//0 once the bank has been freed
+	int pos;
+	bbBankStream( bbBank *b ):bank(b),pos(0){
 	}
-	virtual ~bbBank(){
-		delete[] data;
+	int read( char *buff,int size ){
+		if( !bank ) return 0;
+		int n=bank->size-pos;
+		if( size<n ) n=size;
+		if( n<=0 ) return 0;
+		memcpy( buff,bank->data+pos,n );
+		pos+=n;
+		return n;
 	}
-	void resize( int n ){
-		if( n>size ){
-			if( n>capacity ){
-				capacity=capacity*3/2;
-				if( n>capacity ) capacity=n;
-				capacity=(capacity+15)&~15;
-				char *p=d_new char[capacity];
-				memcpy( p,data,size );
-				delete[] data;
-				data=p;
-			}else memset( data+size,0,n-size );
+	int write( const char *buff,int size ){
+		if( !bank || size<=0 ) return 0;
+		if( pos+size>bank->size ){
+			//buff may be in the bank itself - WriteBytes from the same bank
+			const char *data=bank->data;
+			bool own=buff>=data && buff<data+bank->size;
+			bbCompleteBankIO( bank );
+			bank->resize( pos+size );
+			if( own ) buff=bank->data+(buff-data);
 		}
-		size=n;
+		memmove( bank->data+pos,buff,size );
+		pos+=size;
+		return size;
+	}
+	int avail(){
+		return bank && pos<bank->size ? bank->size-pos : 0;
+	}
+	int eof(){
+		if( !bank ) return EOF_ERROR;
+		return pos>=bank->size ? EOF_OK : EOF_NOT;
+	}
+	int peek( const char **p ){
+		int n=avail();
+		if( n ) *p=bank->data+pos;
+		return n;
+	}
+	void consume( int n ){
+		pos+=n;
 	}
 };
 
-static set<bbBank*> bank_set;
+static ptrset<bbBankStream> bank_stream_set;
 
-static inline void debugBank( bbBank *b ){
+static inline void debugBankStream( bbBankStream *s ){
+	if( debug ){
+		if( !bank_stream_set.count( s ) ) RTEX( "Bank Stream does not exist" );
+	}
+}
+
+//Bank over a copy-on-write view of a file - pokes change the bank but not the
+//file, and pages are only read in as they're touched
+struct bbMapBank : public bbBank{
+	mmapfile file;
+	bool open( const string &f ){
+		if( !file.open( f,true ) ) return false;
+		data=(char*)file.data();
+		size=capacity=file.size();
+		return true;
+	}
+	~bbMapBank(){
+		if( file.data() ) data=0;
+	}
+	void resize( int n ){
+		if( file.data() && n>capacity ){
+			//grown out of the view into memory of our own
+			capacity=(n+15)&~15;
+			char *p=d_new char[capacity];
+			memcpy( p,data,size );
+			data=p;
+			file.close();
+		}
+		bbBank::resize( n );
+	}
+};
+
+void debugBank( bbBank *b ){
 	if( debug ){
 		if( !bank_set.count( b ) ) RTEX( "bbBank does not exist" );
 	}
 }
 
-static inline void debugBank( bbBank *b,int offset ){
+void debugBank( bbBank *b,int offset ){
 	if( debug ){
 		debugBank( b );
 		if( offset>=b->size ) RTEX( "Offset out of range" );
@@ -52,8 +107,25 @@ bbBank *bbCreateBank( int size ){
 	return b;
 }
 
+bbBank *bbMapFileToBank( BBStr *f ){
+	string t=*f;delete f;
+	bbMapBank *b=d_new bbMapBank();
+	if( !b->open( t ) ){
+		delete b;
+		return 0;
+	}
+	bank_set.insert( b );
+	return b;
+}
+
 void bbFreeBank( bbBank *b ){
-	if( bank_set.erase( b ) ) delete b;
+	if( !bank_set.erase( b ) ) return;
+	bbCompleteBankIO( b );
+	ptrset<bbBankStream>::const_iterator it;
+	for( it=bank_stream_set.begin();it!=bank_stream_set.end();++it ){
+		if( (*it)->bank==b ) (*it)->bank=0;
+	}
+	delete b;
 }
 
 int bbBankSize( bbBank *b ){
@@ -63,6 +135,7 @@ int bbBankSize( bbBank *b ){
 
 void  bbResizeBank( bbBank *b,int size ){
 	debugBank( b );
+	bbCompleteBankIO( b );
 	b->resize( size );
 }
 
@@ -127,6 +200,147 @@ int   bbWriteBytes( bbBank *b,bbStream *s,int offset,int count ){
 	return s->write( b->data+offset,count );
 }
 
+bbBankStream *bbCreateBankStream( bbBank *b ){
+	debugBank( b );
+	bbBankStream *s=d_new bbBankStream( b );
+	bank_stream_set.insert( s );
+	return s;
+}
+
+void bbCloseBankStream( bbBankStream *s ){
+	debugBankStream( s );
+	bank_stream_set.erase( s );
+	delete s;
+}
+
+int bbBankStreamPos( bbBankStream *s ){
+	debugBankStream( s );
+	return s->pos;
+}
+
+int bbSeekBankStream( bbBankStream *s,int pos ){
+	debugBankStream( s );
+	if( pos<0 ) pos=0;
+	return s->pos=pos;
+}
+
+//debug only - count elements of type from offset
+static void debugSpan( bbBank *b,int offset,int count,int type ){
+	if( debug ){
+		if( type<BANK_BYTE || type>BANK_FLOAT ) RTEX( "Illegal bank data type" );
+		if( count<0 ) RTEX( "Illegal count" );
+		if( offset<0 ) RTEX( "Offset out of range" );
+		debugBank( b,offset+count*bankTypeSize( type )-1 );
+	}
+}
+
+void bbFillBank( bbBank *b,int offset,int count,int value,int type ){
+	debugSpan( b,offset,count,type );
+	if( count<=0 ) return;
+	char *p=b->data+offset;
+	if( type==BANK_FLOAT ) *(float*)p=value;
+	else memcpy( p,&value,bankTypeSize( type ) );
+	bankFill( p,count,bankTypeSize( type ) );
+}
+
+//fractional values for float spans, which FillBank's int value can't hold
+void bbFillBankFloat( bbBank *b,int offset,int count,float value ){
+	debugSpan( b,offset,count,BANK_FLOAT );
+	if( count<=0 ) return;
+	char *p=b->data+offset;
+	*(float*)p=value;
+	bankFill( p,count,4 );
+}
+
+void bbAddBank( bbBank *b,int offset,int count,float value,int type ){
+	debugSpan( b,offset,count,type );
+	bankAdd( b->data+offset,count,type,value );
+}
+
+void bbMultiplyBank( bbBank *b,int offset,int count,float value,int type ){
+	debugSpan( b,offset,count,type );
+	bankMul( b->data+offset,count,type,value );
+}
+
+void bbClampBank( bbBank *b,int offset,int count,float lo,float hi,int type ){
+	debugSpan( b,offset,count,type );
+	bankClamp( b->data+offset,count,type,lo,hi );
+}
+
+float bbBankMin( bbBank *b,int offset,int count,int type ){
+	debugSpan( b,offset,count,type );
+	return count>0 ? bankMin( b->data+offset,count,type ) : 0;
+}
+
+float bbBankMax( bbBank *b,int offset,int count,int type ){
+	debugSpan( b,offset,count,type );
+	return count>0 ? bankMax( b->data+offset,count,type ) : 0;
+}
+
+float bbBankSum( bbBank *b,int offset,int count,int type ){
+	debugSpan( b,offset,count,type );
+	return count>0 ? bankSum( b->data+offset,count,type ) : 0;
+}
+
+void bbSwapBankBytes( bbBank *b,int offset,int count,int size ){
+	if( debug ){
+		if( size!=2 && size!=4 ) RTEX( "Illegal element size" );
+		debugSpan( b,offset,count,size==2 ? BANK_SHORT : BANK_INT );
+	}
+	bankSwap( b->data+offset,count,size );
+}
+
+int bbFindBank( bbBank *b,int offset,int count,int value,int type ){
+	debugSpan( b,offset,count,type );
+	if( count<=0 ) return -1;
+	int n=bankFind( b->data+offset,count,type,value );
+	return n<0 ? -1 : offset+n*bankTypeSize( type );
+}
+
+int bbFindBankFloat( bbBank *b,int offset,int count,float value ){
+	debugSpan( b,offset,count,BANK_FLOAT );
+	if( count<=0 ) return -1;
+	int n=bankFindFloat( (const float*)(b->data+offset),count,value );
+	return n<0 ? -1 : offset+n*4;
+}
+
+int bbBankCRC32( bbBank *b,int offset,int count ){
+	debugSpan( b,offset,count,BANK_BYTE );
+	return count>0 ? bankCRC32( b->data+offset,count ) : 0;
+}
+
+int bbBankHash( bbBank *b,int offset,int count ){
+	debugSpan( b,offset,count,BANK_BYTE );
+	return bankHash( b->data+offset,count>0 ? count : 0 );
+}
+
+//compressed banks are the uncompressed size followed by the compressed data
+bbBank *bbCompressBank( bbBank *b,int level ){
+	debugBank( b );
+	if( debug ){
+		if( level<1 || level>9 ) RTEX( "Illegal compression level" );
+	}
+	bbBank *t=bbCreateBank( 4+lzBound( b->size ) );
+	memcpy( t->data,&b->size,4 );
+	t->resize( 4+lzCompress( b->data,b->size,t->data+4,level ) );
+	return t;
+}
+
+bbBank *bbDecompressBank( bbBank *b ){
+	debugBank( b );
+	int size;
+	if( b->size<5 ) return 0;
+	memcpy( &size,b->data,4 );
+	//nothing expands by more than 255 to 1
+	if( size<0 || size/255>b->size ) return 0;
+	bbBank *t=bbCreateBank( size );
+	if( lzDecompress( b->data+4,b->size-4,t->data,size )!=size ){
+		bbFreeBank( t );
+		return 0;
+	}
+	return t;
+}
+
 int  bbCallDLL( BBStr *dll,BBStr *fun,bbBank *in,bbBank *out ){
 	if( debug ){
 		if( in ) debugBank( in );
@@ -144,12 +358,14 @@ bool bank_create(){
 }
 
 bool bank_destroy(){
+	while( bank_stream_set.size() ) bbCloseBankStream( *bank_stream_set.begin() );
 	while( bank_set.size() ) bbFreeBank( *bank_set.begin() );
 	return true;
 }
 
 void bank_link( void(*rtSym)(const char*,void*) ){
 	rtSym( "%CreateBank%size=0",bbCreateBank );
+	rtSym( "%MapFileToBank$file",bbMapFileToBank );
 	rtSym( "FreeBank%bank",bbFreeBank );
 	rtSym( "%BankSize%bank",bbBankSize );
 	rtSym( "ResizeBank%bank%size",bbResizeBank );
@@ -164,6 +380,25 @@ void bank_link( void(*rtSym)(const char*,void*) ){
 	rtSym( "PokeFloat%bank%offset#value",bbPokeFloat );
 	rtSym( "%ReadBytes%bank%file%offset%count",bbReadBytes );
 	rtSym( "%WriteBytes%bank%file%offset%count",bbWriteBytes );
+	rtSym( "FillBank%bank%offset%count%value%type=1",bbFillBank );
+	rtSym( "FillBankFloat%bank%offset%count#value",bbFillBankFloat );
+	rtSym( "AddBank%bank%offset%count#value%type=1",bbAddBank );
+	rtSym( "MultiplyBank%bank%offset%count#value%type=1",bbMultiplyBank );
+	rtSym( "ClampBank%bank%offset%count#min#max%type=1",bbClampBank );
+	rtSym( "#BankMin%bank%offset%count%type=1",bbBankMin );
+	rtSym( "#BankMax%bank%offset%count%type=1",bbBankMax );
+	rtSym( "#BankSum%bank%offset%count%type=1",bbBankSum );
+	rtSym( "SwapBankBytes%bank%offset%count%size=2",bbSwapBankBytes );
+	rtSym( "%FindBank%bank%offset%count%value%type=1",bbFindBank );
+	rtSym( "%FindBankFloat%bank%offset%count#value",bbFindBankFloat );
+	rtSym( "%BankCRC32%bank%offset%count",bbBankCRC32 );
+	rtSym( "%BankHash%bank%offset%count",bbBankHash );
+	rtSym( "%CompressBank%bank%level=1",bbCompressBank );
+	rtSym( "%DecompressBank%bank",bbDecompressBank );
+	rtSym( "%CreateBankStream%bank",bbCreateBankStream );
+	rtSym( "CloseBankStream%bank_stream",bbCloseBankStream );
+	rtSym( "%BankStreamPos%bank_stream",bbBankStreamPos );
+	rtSym( "%SeekBankStream%bank_stream%pos",bbSeekBankStream );
 	rtSym( "%CallDLL$dll_name$func_name%in_bank=0%out_bank=0",bbCallDLL );
 }
 
@@ -4,4 +4,40 @@
 
 #include "bbsys.h"
 
+struct bbBank{
+	char *data;
+	int size,capacity;
+
+	bbBank( int sz ):size(sz){
+		capacity=(size+15)&~15;
+		data=d_new char[capacity];
+		memset( data,0,size );
+	}
+	virtual ~bbBank(){
+		delete[] data;
+	}
+	virtual void resize( int n ){
+		if( n>size ){
+			if( n>capacity ){
+				capacity=capacity*3/2;
+				if( n>capacity ) capacity=n;
+				capacity=(capacity+15)&~15;
+				char *p=d_new char[capacity];
+				memcpy( p,data,size );
+				delete[] data;
+				data=p;
+			}
+			memset( data+size,0,n-size );
+		}
+		size=n;
+	}
+protected:
+	bbBank():data(0),size(0),capacity(0){
+	}
+};
+
+//debug only - offset is the last byte that will be accessed
+void debugBank( bbBank *b );
+void debugBank( bbBank *b,int offset );
+
 #endif
\ No newline at end of file
@@ -5,6 +5,7 @@
 
 #include "bbblitz3d.h"
 #include "bbgraphics.h"
+#include "bbbank.h"
 #include "../blitz3d/blitz3d.h"
 #include "../blitz3d/world.h"
 #include "../blitz3d/texture.h"
@@ -20,6 +21,7 @@
 #include "../blitz3d/md2model.h"
 #include "../blitz3d/q3bspmodel.h"
 #include "../blitz3d/meshutil.h"
+#include "../blitz3d/meshcache.h"
 #include "../blitz3d/pivot.h"
 #include "../blitz3d/planemodel.h"
 #include "../blitz3d/terrain.h"
@@ -29,12 +31,12 @@
 gxScene *gx_scene;
 extern gxFileSystem *gx_filesys;
 
-static int tri_count;
+static int tri_count,vert_count,state_count,draw_count;
 static World *world;
 
-static set<Brush*> brush_set;
-static set<Texture*> texture_set;
-static set<Entity*> entity_set;
+static ptrset<Brush> brush_set;
+static ptrset<Texture> texture_set;
+static ptrset<Entity> entity_set;
 
 static Listener *listener;
 
@@ -61,6 +63,8 @@ static Loader_GLTF loader_gltf;
 
 static map<string,Transform> loader_mat_map;
 
+static bool mesh_cache;
+
 static inline void debug3d(){
 	if( debug && !gx_scene ) RTEX( "3D Graphics mode not set" );
 }
@@ -171,6 +175,27 @@ static Entity *loadEntity( string t,int hint ){
 	return e;
 }
 
+static Entity *loadCooked( string t,int hint ){
+	if( !mesh_cache ) return 0;
+	t=tolower(t);
+	int n=t.rfind( "." );if( n==string::npos ) return 0;
+	const Transform &conv=loader_mat_map[t.substr( n+1 )];
+
+	CachedTexture::setPath( filenamepath( t ) );
+	Entity *e=MeshCache::load( t,conv,hint );
+	CachedTexture::setPath( "" );
+	return e;
+}
+
+static void saveCooked( string t,int hint,Entity *e ){
+	if( !mesh_cache ) return;
+	t=tolower(t);
+	int n=t.rfind( "." );if( n==string::npos ) return;
+	const Transform &conv=loader_mat_map[t.substr( n+1 )];
+
+	MeshCache::save( t,conv,hint,e );
+}
+
 static void collapseMesh( MeshModel *mesh,Entity *e ){
 	while( e->children() ){
 		collapseMesh( mesh,e->children() );
@@ -225,6 +250,10 @@ void  bbLoaderMatrix( BBStr *ext,float xx,float xy,float xz,float yx,float yy,fl
 	delete ext;
 }
 
+void  bbMeshCache( int enable ){
+	mesh_cache=!!enable;
+}
+
 int   bbHWTexUnits(){
 	debug3d();
 	return gx_scene->hwTexUnits();
@@ -302,8 +331,14 @@ void  bbRenderWorld( float tween ){
 
 #ifndef BETA
 	tri_count=gx_scene->getTrianglesDrawn();
+	vert_count=gx_scene->getVerticesDrawn();
+	state_count=gx_scene->getStateChanges();
+	draw_count=gx_scene->getDrawCalls();
 	world->render( tween );
 	tri_count=gx_scene->getTrianglesDrawn()-tri_count;
+	vert_count=gx_scene->getVerticesDrawn()-vert_count;
+	state_count=gx_scene->getStateChanges()-state_count;
+	draw_count=gx_scene->getDrawCalls()-draw_count;
 	return;
 #endif
 #ifdef BETA
@@ -351,6 +386,18 @@ int  bbTrisRendered(){
 	return tri_count;
 }
 
+int  bbVertsRendered(){
+	return vert_count;
+}
+
+int  bbStateChangesRendered(){
+	return state_count;
+}
+
+int  bbDrawCallsRendered(){
+	return draw_count;
+}
+
 float  bbStats3D( int n ){
 	return stats3d[n];
 }
@@ -605,21 +652,30 @@ Entity *  bbCreateMesh( Entity *p ){
 
 Entity *  bbLoadMesh( BBStr *f,Entity *p ){
 	debugParent(p);
-	Entity *e=loadEntity( f->c_str(),MeshLoader::HINT_COLLAPSE );
+	string t=*f;
 	delete f;
 
+	if( Entity *e=loadCooked( t,MeshLoader::HINT_COLLAPSE ) ) return insertEntity( e,p );
+
+	Entity *e=loadEntity( t,MeshLoader::HINT_COLLAPSE );
 	if( !e ) return 0;
 	MeshModel *m=d_new MeshModel();
 	collapseMesh( m,e );
+	saveCooked( t,MeshLoader::HINT_COLLAPSE,m );
 	return insertEntity( m,p );
 }
 
 Entity *  bbLoadAnimMesh( BBStr *f,Entity *p ){
 	debugParent(p);
-	Entity *e=loadEntity( f->c_str(),0 );
+	string t=*f;
 	delete f;
 
-	if( !e ) return 0;
+	Entity *e=loadCooked( t,0 );
+	if( !e ){
+		e=loadEntity( t,0 );
+		if( !e ) return 0;
+		saveCooked( t,0,e );
+	}
 	if( Animator *anim=e->getObject()->getAnimator() ){
 		anim->animate( 1,0,0,0 );
 	}
@@ -1072,6 +1128,44 @@ Entity *  bbLinePick( float x,float y,float z,float dx,float dy,float dz,float r
 	return doPick( l,radius );
 }
 
+//rays are 6 floats: x,y,z,dx,dy,dz
+//results are 32 bytes: entity,x,y,z,nx,ny,nz,time
+int  bbLinePicks( bbBank *rays,bbBank *results,int count,float radius ){
+	if( debug ){
+		debug3d();
+		if( count<0 ) RTEX( "Illegal ray count" );
+		if( count ){ debugBank( rays,count*24-1 );debugBank( results,count*32-1 ); }
+	}
+	if( !count ) return 0;
+
+	static vector<Line> lines;
+	static vector<ObjCollision> colls;
+	lines.resize( count );
+	colls.resize( count );
+
+	const float *p=(const float*)rays->data;
+	for( int k=0;k<count;++k,p+=6 ){
+		lines[k]=Line( Vector( p[0],p[1],p[2] ),Vector( p[3],p[4],p[5] ) );
+	}
+
+	int hits=world->traceRays( &lines[0],count,radius,&colls[0] );
+
+	char *out=results->data;
+	for( int k=0;k<count;++k,out+=32 ){
+		const ObjCollision &c=colls[k];
+		float *f=(float*)(out+4);
+		*(Entity**)out=c.with;
+		if( c.with ){
+			f[0]=c.coords.x;f[1]=c.coords.y;f[2]=c.coords.z;
+			f[3]=c.collision.normal.x;f[4]=c.collision.normal.y;f[5]=c.collision.normal.z;
+			f[6]=c.collision.time;
+		}else{
+			memset( f,0,28 );
+		}
+	}
+	return hits;
+}
+
 Entity *  bbEntityPick( Object *src,float range ){
 	debugEntity(src);
 
@@ -1323,36 +1417,60 @@ static Vector terrainVector( Terrain *t,float x,float y,float z ){
 	return t->getWorldTform() * Vector( v.x,terrainHeight( t,v.x,v.z ),v.z );
 }
 
-Entity *  bbCreateTerrain( int n,Entity *p ){
+Entity *  bbCreateTerrain( int n,Entity *p,int format ){
 	debugParent(p);
+	if( format<0 || format>Terrain::HEIGHTS_FLOAT ) RTEX( "Illegal terrain format" );
 	int shift=0;
 	while( (1<<shift)<n ) ++shift;
 	if( (1<<shift)!=n ) RTEX( "Illegal terrain size" );
-	Terrain *t=d_new Terrain( shift );
+	Terrain *t=d_new Terrain( shift,format ? format : Terrain::HEIGHTS_8BIT );
 	return insertEntity( t,p );
 }
 
-Entity *  bbLoadTerrain( BBStr *file,Entity *p ){
-	debugParent(p);
-	gxCanvas *c=gx_graphics->loadCanvas( *file,gxCanvas::CANVAS_HIGHCOLOR );
-	if( !c ) RTEX( "Unable to load heightmap image" );
+//heights of an image only gx_graphics can load, such as a .dds
+static float *canvasHeights( const string &f,int *width,int *height ){
+	gxCanvas *c=gx_graphics->loadCanvas( f,gxCanvas::CANVAS_HIGHCOLOR );
+	if( !c ) return 0;
 	int w=c->getWidth(),h=c->getHeight();
-	if( w!=h ) RTEX( "Terrain must be square" );
-	int shift=0;
-	while( (1<<shift)<w ) ++shift;
-	if( (1<<shift)!=w ) RTEX( "Illegal terrain size" );
-	Terrain *t=d_new Terrain( shift );
+	float *heights=d_new float[w*h];
 	c->lock();
 	for( int y=0;y<h;++y ){
+		float *out=heights+(h-1-y)*w;
 		for( int x=0;x<w;++x ){
 			int rgb=c->getPixelFast( x,y );
 			int r=(rgb>>16)&0xff,g=(rgb>>8)&0xff,b=rgb&0xff;
-			float p=(r>g?(r>b?r:b):(g>b?g:b))/255.0f;
-			t->setHeight( x,h-1-y,p,false );
+			out[x]=(r>g?(r>b?r:b):(g>b?g:b))/255.0f;
 		}
 	}
 	c->unlock();
 	gx_graphics->freeCanvas( c );
+	*width=w;*height=h;
+	return heights;
+}
+
+Entity *  bbLoadTerrain( BBStr *file,Entity *p,int format ){
+	debugParent(p);
+	if( format<0 || format>Terrain::HEIGHTS_FLOAT ) RTEX( "Illegal terrain format" );
+	string f=*file;delete file;
+	int w,h,bits=8;
+	float *heights=ddUtil::decodeHeights( f,&w,&h,&bits );
+	if( !heights ) heights=canvasHeights( f,&w,&h );
+	if( !heights ) RTEX( "Unable to load heightmap image" );
+	int shift=0;
+	while( (1<<shift)<w ) ++shift;
+	if( w!=h || (1<<shift)!=w ){
+		delete[] heights;
+		if( w!=h ) RTEX( "Terrain must be square" );
+		RTEX( "Illegal terrain size" );
+	}
+	//default to the precision of the heightmap
+	if( !format ) format=bits==16 ? Terrain::HEIGHTS_16BIT : Terrain::HEIGHTS_8BIT;
+	Terrain *t=d_new Terrain( shift,format );
+	for( int z=0;z<h;++z ){
+		const float *row=heights+z*w;
+		for( int x=0;x<w;++x ) t->setHeight( x,z,row[x],false );
+	}
+	delete[] heights;
 	return insertEntity( t,p );
 }
 
@@ -1554,6 +1672,13 @@ int  bbExtractAnimSeq( Object *o,int first,int last,int seq ){
 	return -1;
 }
 
+void  bbCompressAnim( Object *o,float pos_tol,float rot_tol ){
+	debugObject( o );
+	if( Animator *anim=o->getAnimator() ){
+		anim->compress( pos_tol,rot_tol );
+	}
+}
+
 int  bbAddAnimSeq( Object *o,int length ){
 	debugObject( o );
 	Animator *anim=o->getAnimator();
@@ -2087,7 +2212,8 @@ void blitz3d_close(){
 }
 
 bool blitz3d_create(){
-	tri_count=0;
+	tri_count=vert_count=state_count=draw_count=0;
+	mesh_cache=false;
 	gx_scene=0;world=0;
 	return true;
 }
@@ -2099,6 +2225,7 @@ bool blitz3d_destroy(){
 
 void blitz3d_link( void (*rtSym)( const char *sym,void *pc ) ){
 	rtSym( "LoaderMatrix$file_ext#xx#xy#xz#yx#yy#yz#zx#zy#zz",bbLoaderMatrix );
+	rtSym( "MeshCache%enable",bbMeshCache );
 	rtSym( "HWMultiTex%enable",bbHWMultiTex );
 	rtSym( "%HWTexUnits",bbHWTexUnits );
 	rtSym( "%GfxDriverCaps3D",bbGfxDriverCaps3D );
@@ -2115,6 +2242,9 @@ void blitz3d_link( void (*rtSym)( const char *sym,void *pc ) ){
 	rtSym( "ClearWorld%entities=1%brushes=1%textures=1",bbClearWorld );
 	rtSym( "%ActiveTextures",bbActiveTextures );
 	rtSym( "%TrisRendered",bbTrisRendered );
+	rtSym( "%VertsRendered",bbVertsRendered );
+	rtSym( "%StateChangesRendered",bbStateChangesRendered );
+	rtSym( "%DrawCallsRendered",bbDrawCallsRendered );
 	rtSym( "#Stats3D%type",bbStats3D );
 
 	rtSym( "%CreateTexture%width%height%flags=0%frames=1",bbCreateTexture );
@@ -2234,6 +2364,7 @@ void blitz3d_link( void (*rtSym)( const char *sym,void *pc ) ){
 
 	rtSym( "%EntityPick%entity#range",bbEntityPick );
 	rtSym( "%LinePick#x#y#z#dx#dy#dz#radius=0",bbLinePick );
+	rtSym( "%LinePicks%rays_bank%results_bank%count#radius=0",bbLinePicks );
 	rtSym( "%CameraPick%camera#viewport_x#viewport_y",bbCameraPick );
 
 	rtSym( "#PickedX",bbPickedX );
@@ -2275,8 +2406,8 @@ void blitz3d_link( void (*rtSym)( const char *sym,void *pc ) ){
 
 	rtSym( "%CreatePlane%segments=1%parent=0",bbCreatePlane );
 
-	rtSym( "%CreateTerrain%grid_size%parent=0",bbCreateTerrain );
-	rtSym( "%LoadTerrain$heightmap_file%parent=0",bbLoadTerrain );
+	rtSym( "%CreateTerrain%grid_size%parent=0%format=0",bbCreateTerrain );
+	rtSym( "%LoadTerrain$heightmap_file%parent=0%format=0",bbLoadTerrain );
 	rtSym( "TerrainDetail%terrain%detail_level%morph=0",bbTerrainDetail );
 	rtSym( "TerrainShading%terrain%enable",bbTerrainShading );
 	rtSym( "#TerrainX%terrain#world_x#world_y#world_z",bbTerrainX );
@@ -2353,6 +2484,7 @@ void blitz3d_link( void (*rtSym)( const char *sym,void *pc ) ){
 	rtSym( "SetAnimKey%entity%frame%pos_key=1%rot_key=1%scale_key=1",bbSetAnimKey );
 	rtSym( "%AddAnimSeq%entity%length",bbAddAnimSeq );
 	rtSym( "%ExtractAnimSeq%entity%first_frame%last_frame%anim_seq=0",bbExtractAnimSeq );
+	rtSym( "CompressAnim%entity#pos_tolerance#rot_tolerance",bbCompressAnim );
 	rtSym( "%AnimSeq%entity",bbAnimSeq );
 	rtSym( "#AnimTime%entity",bbAnimTime );
 	rtSym( "%AnimLength%entity",bbAnimLength );
@@ -7,5 +7,12 @@
 
 extern gxScene *gx_scene;
 
+class Entity;
+class Texture;
+
+Texture *	 bbLoadTexture( BBStr *file,int flags );
+Entity *	 bbLoadMesh( BBStr *file,Entity *parent );
+Entity *	 bbLoadAnimMesh( BBStr *file,Entity *parent );
+
 #endif
 
@@ -6,9 +6,21 @@
 
 gxFileSystem *gx_filesys;
 
+//filebuf with its get area open to bbFile::peek
+struct bbFileBuf : public filebuf{
+	int peek( const char **p ){
+		if( gptr()==egptr() && sgetc()==EOF ) return 0;
+		*p=gptr();
+		return egptr()-gptr();
+	}
+	void consume( int n ){
+		gbump( n );
+	}
+};
+
 struct bbFile : public bbStream{
-	filebuf *buf;
-	bbFile( filebuf *f ):buf(f){
+	bbFileBuf *buf;
+	bbFile( bbFileBuf *f ):buf(f){
 	}
 	~bbFile(){
 		delete buf;
@@ -25,9 +37,60 @@ struct bbFile : public bbStream{
 	int eof(){
 		return buf->sgetc()==EOF;
 	}
+	int peek( const char **p ){
+		return buf->peek( p );
+	}
+	void consume( int n ){
+		buf->consume( n );
+	}
+	virtual int pos(){
+		return buf->pubseekoff( 0,ios_base::cur );
+	}
+	virtual int seek( int n ){
+		return buf->pubseekoff( n,ios_base::beg );
+	}
 };
 
-static set<bbFile*> file_set;
+//Read-only file mapped into memory, for random access without buffer refills
+struct bbMappedFile : public bbFile{
+	mmapfile file;
+	int get;
+	bbMappedFile():bbFile(0),get(0){
+	}
+	int read( char *buff,int size ){
+		int n=file.size()-get;
+		if( size<n ) n=size;
+		if( n<=0 ) return 0;
+		memcpy( buff,file.data()+get,n );
+		get+=n;
+		return n;
+	}
+	int write( const char *buff,int size ){
+		return 0;
+	}
+	int avail(){
+		return file.size()-get;
+	}
+	int eof(){
+		return get==file.size();
+	}
+	int peek( const char **p ){
+		*p=file.data()+get;
+		return file.size()-get;
+	}
+	void consume( int n ){
+		seek( get+n );
+	}
+	int pos(){
+		return get;
+	}
+	int seek( int n ){
+		if( n<0 ) n=0;else if( n>file.size() ) n=file.size();
+		return get=n;
+	}
+};
+
+static ptrset<bbFile> file_set;
 
 static inline void debugFile( bbFile *f ){
 	if( debug ){
@@ -43,7 +106,7 @@ static inline void debugDir( gxDir *d ){
 
 static bbFile *open( BBStr *f,int n ){
 	string t=*f;
-	filebuf *buf=d_new filebuf();
+	bbFileBuf *buf=d_new bbFileBuf();
 	if( buf->open( t.c_str(),n|ios_base::binary ) ){
 		bbFile *f=d_new bbFile( buf );
 		file_set.insert( f );
@@ -53,6 +116,17 @@ static bbFile *open( BBStr *f,int n ){
 	return 0;
 }
 
+bbFile *bbMapFile( BBStr *f ){
+	string t=*f;delete f;
+	bbMappedFile *p=d_new bbMappedFile();
+	if( !p->file.open( t ) ){
+		delete p;
+		return 0;
+	}
+	file_set.insert( p );
+	return p;
+}
+
 bbFile *bbReadFile( BBStr *f ){
 	return open( f,ios_base::in );
 }
@@ -72,11 +146,11 @@ void bbCloseFile( bbFile *f ){
 }
 
 int bbFilePos( bbFile *f ){
-	return f->buf->pubseekoff( 0,ios_base::cur );
+	return f->pos();
 }
 
 int bbSeekFile( bbFile *f,int pos ){
-	return f->buf->pubseekoff( pos,ios_base::beg );
+	return f->seek( pos );
 }
 
 gxDir *bbReadDir( BBStr *d ){
@@ -158,6 +232,7 @@ void filesystem_link( void(*rtSym)(const char*,void*) ){
 	rtSym( "%OpenFile$filename",bbOpenFile );
 	rtSym( "%ReadFile$filename",bbReadFile );
 	rtSym( "%WriteFile$filename",bbWriteFile );
+	rtSym( "%MapFile$filename",bbMapFile );
 	rtSym( "CloseFile%file_stream",bbCloseFile );
 	rtSym( "%FilePos%file_stream",bbFilePos );
 	rtSym( "%SeekFile%file_stream%pos",bbSeekFile );
@@ -38,7 +38,7 @@ static int gx_driver;	//current graphics driver
 static bool filter;
 static bool auto_dirty;
 static bool auto_midhandle;
-static set<bbImage*> image_set;
+static ptrset<bbImage> image_set;
 static int curs_x,curs_y;
 static gxCanvas *p_canvas;
 
@@ -393,6 +393,7 @@ void bbGraphics( int w,int h,int d,int mode ){
 	case 4:flags |= gxGraphics::GRAPHICS_WINDOWED | gxGraphics::GRAPHICS_BORDERLESS; break;
 	case 6:flags|=gxGraphics::GRAPHICS_WINDOWED|gxGraphics::GRAPHICS_AUTOSUSPEND;break;
 	case 7:flags|=gxGraphics::GRAPHICS_WINDOWED|gxGraphics::GRAPHICS_SCALED|gxGraphics::GRAPHICS_AUTOSUSPEND;break;
+	case 8:flags|=gxGraphics::GRAPHICS_WINDOWED|gxGraphics::GRAPHICS_HEADLESS;break;
 	default:RTEX( "Illegal Graphics mode" );
 	}
 	graphics( w,h,d,flags );
@@ -409,6 +410,7 @@ void bbGraphics3D( int w,int h,int d,int mode ){
 	case 4:flags |= gxGraphics::GRAPHICS_WINDOWED | gxGraphics::GRAPHICS_BORDERLESS; break;
 	case 6:flags|=gxGraphics::GRAPHICS_WINDOWED|gxGraphics::GRAPHICS_AUTOSUSPEND;break;
 	case 7:flags|=gxGraphics::GRAPHICS_WINDOWED|gxGraphics::GRAPHICS_SCALED|gxGraphics::GRAPHICS_AUTOSUSPEND;break;
+	case 8:flags|=gxGraphics::GRAPHICS_WINDOWED|gxGraphics::GRAPHICS_HEADLESS;break;
 	default:RTEX( "Illegal Graphics3D mode" );
 	}
 	graphics( w,h,d,flags );
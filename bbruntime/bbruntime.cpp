@@ -170,6 +170,9 @@ void input_link( void (*rtSym)( const char *sym,void *pc ) );
 bool audio_create();
 bool audio_destroy();
 void audio_link( void (*rtSym)( const char *sym,void *pc ) );
+bool async_create();
+bool async_destroy();
+void async_link( void (*rtSym)( const char *sym,void *pc ) );
 
 bool userlibs_create();
 void userlibs_destroy();
@@ -222,6 +225,7 @@ void bbruntime_link( void (*rtSym)( const char *sym,void *pc ) ){
 	input_link( rtSym );
 	audio_link( rtSym );
 	blitz3d_link( rtSym );
+	async_link( rtSym );
 	userlibs_link( rtSym );
 }
 
@@ -243,9 +247,12 @@ bool bbruntime_create(){
 									if( input_create() ){
 										if( audio_create() ){
 											if (blitz3d_create()) {
-												if (userlibs_create()) {
-													return true;
-												}
+												if( async_create() ){
+													if (userlibs_create()) {
+														return true;
+													}
+													async_destroy();
+												}else sue( "async_create failed" );
 											} else sue("blitz3d_create failed");
 											audio_destroy();
 										}else sue( "audio_create failed" );
@@ -272,6 +279,7 @@ bool bbruntime_create(){
 
 bool bbruntime_destroy(){
 	userlibs_destroy();
+	async_destroy();
 	blitz3d_destroy();
 	audio_destroy();
 	input_destroy();
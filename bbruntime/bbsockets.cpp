@@ -2,6 +2,8 @@
 #include "std.h"
 #include "bbsockets.h"
 
+#include <algorithm>
+
 static bool socks_ok;
 static WSADATA wsadata;
 static int recv_timeout;
@@ -19,10 +21,14 @@ static void close( SOCKET sock,int e ){
 class UDPStream;
 class TCPStream;
 class TCPServer;
+class SocketSet;
+
+static ptrset<UDPStream> udp_set;
+static ptrset<TCPStream> tcp_set;
+static ptrset<TCPServer> server_set;
+static ptrset<SocketSet> socket_sets;
 
-static set<UDPStream*> udp_set;
-static set<TCPStream*> tcp_set;
-static set<TCPServer*> server_set;
+static void unwatch( void *p );
 
 class UDPStream : public bbStream{
 public:
@@ -34,27 +40,49 @@ public:
 	int avail();
 	int eof();
 
+	int peek( const char **p );
+	void consume( int n );
+
 	int recv();
+	int recvBatch( int max );
+	int next();
 	int send( int ip,int port );
 	int getIP();
 	int getPort();
 	int getMsgIP();
 	int getMsgPort();
 
+	SOCKET getSocket()const{ return sock; }
+	//datagrams from recvBatch still to be taken with next
+	bool batched()const{ return batch_get<batch_cnt; }
+
 private:
+	struct Datagram{
+		vector<char> data;
+		sockaddr_in addr;
+	};
+
 	SOCKET sock;
-	vector<char> in_buf,out_buf;
+	vector<char> in_buf,out_buf,scratch;
 	sockaddr_in addr,in_addr,out_addr;
 	int in_get,e;
+
+	//datagrams from recvBatch, slots are reused so their buffers stay allocated
+	vector<Datagram> batch;
+	int batch_get,batch_cnt;
+
+	bool wait( int tout );
+	bool recvDatagram( vector<char> &buf,sockaddr_in &from );
 };
 
-UDPStream::UDPStream( SOCKET s ):sock(s),in_get(0),e(0){
+UDPStream::UDPStream( SOCKET s ):sock(s),in_get(0),e(0),batch_get(0),batch_cnt(0){
 	int len=sizeof(addr);
 	getsockname( s,(sockaddr*)&addr,&len );
 	in_addr=out_addr=addr;
 }
 
 UDPStream::~UDPStream(){
+	unwatch( this );
 	close( sock,e );
 }
 
@@ -73,6 +101,16 @@ int UDPStream::write( const char *buff,int size ){
 	return size;
 }
 
+int UDPStream::peek( const char **p ){
+	if( e || in_get==in_buf.size() ) return 0;
+	*p=&in_buf[in_get];
+	return in_buf.size()-in_get;
+}
+
+void UDPStream::consume( int n ){
+	in_get+=n;
+}
+
 int UDPStream::avail(){
 	if( e ) return 0;
 	return in_buf.size()-in_get;
@@ -82,34 +120,77 @@ int UDPStream::eof(){
 	return e ? e : in_get==in_buf.size();
 }
 
+//wait for a datagram until tout if there's a recv timeout
+bool UDPStream::wait( int tout ){
+	int dt=0;
+	if( recv_timeout ){
+		dt=tout-gx_runtime->getMilliSecs();
+		if( dt<0 ) dt=0;
+	}
+	fd_set fd={ 1,sock };
+	timeval tv={ dt/1000,(dt%1000)*1000 };
+	int n=::select( 0,&fd,0,0,&tv );
+	if( !n ) return false;
+	if( n!=1 ){ e=-1;return false; }
+	return true;
+}
+
+//one datagram into buf - big enough for anything, so no FIONREAD needed first
+bool UDPStream::recvDatagram( vector<char> &buf,sockaddr_in &from ){
+	if( !scratch.size() ) scratch.resize( 65536 );
+	int len=sizeof(from);
+	int n=::recvfrom( sock,scratch.data(),scratch.size(),0,(sockaddr*)&from,&len );
+	if( n==SOCKET_ERROR ) return false;
+	buf.assign( scratch.data(),scratch.data()+n );
+	return true;
+}
+
 //fill buffer, return sender
 int UDPStream::recv(){
 	if( e ) return 0;
+	if( batch_get<batch_cnt ) return next();
 	int tout;
 	if( recv_timeout ) tout=gx_runtime->getMilliSecs()+recv_timeout;
 	for(;;){
-		int dt=0;
-		if( recv_timeout ){
-			dt=tout-gx_runtime->getMilliSecs();
-			if( dt<0 ) dt=0;
-		}
-		fd_set fd={ 1,sock };
-		timeval tv={ dt/1000,(dt%1000)*1000 };
-		int n=::select( 0,&fd,0,0,&tv );
-		if( !n ) return 0;
-		if( n!=1 ){ e=-1;return 0; }
-		unsigned long sz=-1;
-		if( ioctlsocket( sock,FIONREAD,&sz ) ){ e=-1;return 0; }
-		in_buf.resize( sz );in_get=0;
-		int len=sizeof(in_addr);
-		n=::recvfrom( sock,(char*)in_buf.data(),sz,0,(sockaddr*)&in_addr,&len );
-		if( n==SOCKET_ERROR ) continue;	//{ e=-1;return 0; }
-		in_buf.resize( n );
+		if( !wait( tout ) ) return 0;
+		if( !recvDatagram( in_buf,in_addr ) ) continue;	//{ e=-1;return 0; }
+		in_get=0;
 		return getMsgIP();
 	}
 	return 0;
 }
 
+//wait for one datagram as recv does, then take up to max-1 more that are
+//already queued without waiting. Returns number received.
+int UDPStream::recvBatch( int max ){
+	batch_get=batch_cnt=0;
+	if( e || max<1 ) return 0;
+	if( batch.size()<max ) batch.resize( max );
+	int tout;
+	if( recv_timeout ) tout=gx_runtime->getMilliSecs()+recv_timeout;
+	for(;;){
+		if( !wait( tout ) ) return 0;
+		if( recvDatagram( batch[0].data,batch[0].addr ) ) break;
+	}
+	batch_cnt=1;
+	unsigned long nb=1;
+	ioctlsocket( sock,FIONBIO,&nb );
+	while( batch_cnt<max && recvDatagram( batch[batch_cnt].data,batch[batch_cnt].addr ) ) ++batch_cnt;
+	nb=0;
+	ioctlsocket( sock,FIONBIO,&nb );
+	return batch_cnt;
+}
+
+//make the next batched datagram the current message, return sender
+int UDPStream::next(){
+	if( e || batch_get>=batch_cnt ) return 0;
+	Datagram &d=batch[batch_get++];
+	in_buf.swap( d.data );
+	in_addr=d.addr;
+	in_get=0;
+	return getMsgIP();
+}
+
 //send, empty buffer
 int UDPStream::send( int ip,int port ){
 	if( e ) return 0;
@@ -147,14 +228,33 @@ public:
 	int write( const char *buff,int size );
 	int avail();
 	int eof();
+	int peek( const char **p );
+	void consume( int n );
 
 	int getIP();
 	int getPort();
 
+	//true if there's received data waiting in in_buf
+	bool buffered()const{ return in_get<in_end; }
+
+	void setBuffer( int size,bool nodelay );
+	bool flush();
+
+	SOCKET getSocket()const{ return sock; }
+
 private:
 	SOCKET sock;
 	TCPServer *server;
 	int e,ip,port;
+	vector<char> out_buf;
+	int out_size;		//0 for unbuffered writes
+
+	//small reads are done a buffer at a time
+	vector<char> in_buf;
+	int in_get,in_end;
+
+	bool wait( int tout );
+	bool fill();
 };
 
 class TCPServer{
@@ -166,13 +266,16 @@ public:
 
 	void remove( TCPStream *s );
 
+	SOCKET getSocket()const{ return sock; }
+
 private:
 	int e;
 	SOCKET sock;
-	set<TCPStream*> accepted_set;
+	ptrset<TCPStream> accepted_set;
 };
 
-TCPStream::TCPStream( SOCKET s,TCPServer *t ):sock(s),server(t),e(0){
+TCPStream::TCPStream( SOCKET s,TCPServer *t ):sock(s),server(t),e(0),out_size(0),
+in_buf(4096),in_get(0),in_end(0){
 	sockaddr_in addr;
 	int len=sizeof(addr);
 	if( getpeername( s,(sockaddr*)&addr,&len ) ){
@@ -184,26 +287,31 @@ TCPStream::TCPStream( SOCKET s,TCPServer *t ):sock(s),server(t),e(0){
 }
 
 TCPStream::~TCPStream(){
+	flush();
+	unwatch( this );
 	if( server ) server->remove( this );
 	close( sock,e );
 }
 
 int TCPStream::read( char *buff,int size ){
 	if( e ) return 0;
+	//anything we're waiting a reply to has to go first
+	if( out_buf.size() && !flush() ) return 0;
 	char *b=buff,*l=buff+size;
 	int tout;
 	if( read_timeout ) tout=gx_runtime->getMilliSecs()+read_timeout;
-	while( b<l ){
-		int dt=0;
-		if( read_timeout ){
-			dt=tout-gx_runtime->getMilliSecs();
-			if( dt<0 ) dt=0;
+	for(;;){
+		if( int n=in_end-in_get ){
+			if( n>l-b ) n=l-b;
+			memcpy( b,&in_buf[in_get],n );
+			in_get+=n;b+=n;
+		}
+		if( b==l || !wait( tout ) ) break;
+		if( l-b<in_buf.size() ){
+			if( !fill() ) break;
+			continue;
 		}
-		fd_set fd={ 1,sock };
-		timeval tv={ dt/1000,(dt%1000)*1000 };
-		int n=::select( 0,&fd,0,0,&tv );
-		if( n!=1 ){ e=-1;break; }
-		n=::recv( sock,b,l-b,0 );
+		int n=::recv( sock,b,l-b,0 );
 		if( n==0 ){ e=1;break; }
 		if( n==SOCKET_ERROR ){ e=-1;break; }
 		b+=n;
@@ -211,22 +319,98 @@ int TCPStream::read( char *buff,int size ){
 	return b-buff;
 }
 
+//wait for data until tout if there's a read timeout
+bool TCPStream::wait( int tout ){
+	int dt=0;
+	if( read_timeout ){
+		dt=tout-gx_runtime->getMilliSecs();
+		if( dt<0 ) dt=0;
+	}
+	fd_set fd={ 1,sock };
+	timeval tv={ dt/1000,(dt%1000)*1000 };
+	int n=::select( 0,&fd,0,0,&tv );
+	if( n!=1 ){ e=-1;return false; }
+	return true;
+}
+
+//refill empty in_buf with whatever has arrived
+bool TCPStream::fill(){
+	int n=::recv( sock,&in_buf[0],in_buf.size(),0 );
+	if( n==0 ){ e=1;return false; }
+	if( n==SOCKET_ERROR ){ e=-1;return false; }
+	in_get=0;in_end=n;
+	return true;
+}
+
+int TCPStream::peek( const char **p ){
+	if( e ) return 0;
+	if( in_get==in_end ){
+		if( out_buf.size() && !flush() ) return 0;
+		int tout;
+		if( read_timeout ) tout=gx_runtime->getMilliSecs()+read_timeout;
+		if( !wait( tout ) || !fill() ) return 0;
+	}
+	*p=&in_buf[in_get];
+	return in_end-in_get;
+}
+
+void TCPStream::consume( int n ){
+	in_get+=n;
+}
+
 int TCPStream::write( const char *buff,int size ){
 	if( e ) return 0;
+	if( out_size ){
+		if( out_buf.size()+size<=out_size ){
+			out_buf.insert( out_buf.end(),buff,buff+size );
+			if( out_buf.size()==out_size && !flush() ) return 0;
+			return size;
+		}
+		if( out_buf.size() && !flush() ) return 0;
+		if( size<out_size ){
+			out_buf.insert( out_buf.end(),buff,buff+size );
+			return size;
+		}
+	}
 	int n=::send( sock,buff,size,0 );
 	if( n==SOCKET_ERROR ){ e=-1;return 0; }
 	return n;
 }
 
+//send anything buffered, returns false on error
+bool TCPStream::flush(){
+	if( e ) return false;
+	const char *p=out_buf.data(),*l=p+out_buf.size();
+	while( p<l ){
+		int n=::send( sock,p,l-p,0 );
+		if( n==SOCKET_ERROR ){ e=-1;break; }
+		p+=n;
+	}
+	out_buf.clear();
+	return !e;
+}
+
+void TCPStream::setBuffer( int size,bool nodelay ){
+	flush();
+	out_size=size>0 ? size : 0;
+	out_buf.reserve( out_size );
+	int opt=nodelay;
+	setsockopt( sock,IPPROTO_TCP,TCP_NODELAY,(char*)&opt,sizeof(opt) );
+}
+
 int TCPStream::avail(){
+	//a reply can't arrive before the request has gone
+	if( out_buf.size() && !flush() ) return 0;
 	unsigned long t;
 	int n=::ioctlsocket( sock,FIONREAD,&t );
 	if( n==SOCKET_ERROR ){ e=-1;return 0; }
-	return t;
+	return t+(in_end-in_get);
 }
 
 int TCPStream::eof(){
 	if( e ) return e;
+	if( out_buf.size() && !flush() ) return e;
+	if( in_get<in_end ) return 0;
 	fd_set fd={ 1,sock };
 	timeval tv={ 0,0 };
 	switch( ::select( 0,&fd,0,0,&tv ) ){
@@ -249,6 +433,7 @@ TCPServer::TCPServer( SOCKET s ):sock(s),e(0){
 }
 
 TCPServer::~TCPServer(){
+	unwatch( this );
 	while( accepted_set.size() ) delete *accepted_set.begin();
 	close( sock,e );
 }
@@ -271,6 +456,101 @@ void TCPServer::remove( TCPStream *s ){
 	accepted_set.erase( s );
 }
 
+//Streams and servers waited on together with a single select.
+//
+//A stream is ready when reading it won't block - it has data, or has been
+//closed by the other end - and a server is ready when it has a connection to
+//accept. Winsock's fd_set is just a count and an array, so one big enough
+//for every socket in the set is built rather than being stuck at FD_SETSIZE.
+class SocketSet{
+public:
+	SocketSet();
+
+	void add( void *p,SOCKET s );
+	void remove( void *p );
+
+	//returns number of ready sockets, timeout<0 waits forever
+	int wait( int timeout );
+	void *next();
+
+private:
+	map<SOCKET,void*> socks;
+	vector<SOCKET> fds;
+	vector<void*> ready;
+	int ready_get;
+};
+
+SocketSet::SocketSet():ready_get(0){
+}
+
+void SocketSet::add( void *p,SOCKET s ){
+	socks[s]=p;
+}
+
+void SocketSet::remove( void *p ){
+	map<SOCKET,void*>::iterator it;
+	for( it=socks.begin();it!=socks.end();++it ){
+		if( it->second!=p ) continue;
+		socks.erase( it );
+		break;
+	}
+	for( int k=ready_get;k<ready.size();++k ){
+		if( ready[k]==p ) ready[k]=0;
+	}
+}
+
+int SocketSet::wait( int timeout ){
+	ready.clear();ready_get=0;
+	if( !socks.size() ) return 0;
+
+	//streams with data already read into their buffers are ready now. Buffered
+	//output goes first so replies to it can arrive, and a failed flush leaves
+	//the stream in error, so reading it won't block either.
+	map<SOCKET,void*>::const_iterator it;
+	for( it=socks.begin();it!=socks.end();++it ){
+		void *p=it->second;
+		if( tcp_set.count( (TCPStream*)p ) ){
+			TCPStream *t=(TCPStream*)p;
+			if( !t->flush() || t->buffered() ) ready.push_back( p );
+		}else if( udp_set.count( (UDPStream*)p ) ){
+			if( ((UDPStream*)p)->batched() ) ready.push_back( p );
+		}
+	}
+	int buffered=ready.size();
+	if( buffered ) timeout=0;
+
+	int sz=socks.size()+1;
+	if( sz<sizeof(fd_set)/sizeof(SOCKET) ) sz=sizeof(fd_set)/sizeof(SOCKET);
+	fds.resize( sz );
+	fd_set *fd=(fd_set*)&fds[0];
+	fd->fd_count=0;
+	for( it=socks.begin();it!=socks.end();++it ) fd->fd_array[fd->fd_count++]=it->first;
+
+	timeval tv={ timeout/1000,(timeout%1000)*1000 };
+	int n=::select( 0,fd,0,0,timeout<0 ? 0 : &tv );
+	if( n==SOCKET_ERROR ) return ready.size();
+
+	for( int k=0;k<fd->fd_count;++k ){
+		it=socks.find( fd->fd_array[k] );
+		if( it==socks.end() ) continue;
+		if( buffered && find( ready.begin(),ready.begin()+buffered,it->second )!=ready.begin()+buffered ) continue;
+		ready.push_back( it->second );
+	}
+	return ready.size();
+}
+
+void *SocketSet::next(){
+	while( ready_get<ready.size() ){
+		if( void *p=ready[ready_get++] ) return p;
+	}
+	return 0;
+}
+
+static void unwatch( void *p ){
+	ptrset<SocketSet>::const_iterator it;
+	for( it=socket_sets.begin();it!=socket_sets.end();++it ) (*it)->remove( p );
+}
+
 static inline void debugUDPStream( UDPStream *p ){
 	if( debug && !udp_set.count(p) ){
 		RTEX( "UDP Stream does not exist" );
@@ -289,6 +569,12 @@ static inline void debugTCPServer( TCPServer *p ){
 	}
 }
 
+static inline void debugSocketSet( SocketSet *p ){
+	if( debug && !socket_sets.count(p) ){
+		RTEX( "Socket Set does not exist" );
+	}
+}
+
 static vector<int> host_ips;
 
 int bbCountHostIPs( BBStr *host ){
@@ -335,6 +621,16 @@ int bbRecvUDPMsg( UDPStream *p ){
 	return p->recv();
 }
 
+int bbRecvUDPMsgs( UDPStream *p,int max ){
+	debugUDPStream( p );
+	return p->recvBatch( max );
+}
+
+int bbNextUDPMsg( UDPStream *p ){
+	debugUDPStream( p );
+	return p->next();
+}
+
 void bbSendUDPMsg( UDPStream *p,int ip,int port ){
 	debugUDPStream( p );
 	p->send( ip,port );
@@ -458,6 +754,51 @@ int bbTCPStreamPort( TCPStream *p ){
 	return p->getPort();
 }
 
+void bbTCPStreamBuffer( TCPStream *p,int size,int nodelay ){
+	debugTCPStream( p );
+	p->setBuffer( size,!!nodelay );
+}
+
+void bbFlushTCPStream( TCPStream *p ){
+	debugTCPStream( p );
+	p->flush();
+}
+
+SocketSet *bbCreateSocketSet(){
+	SocketSet *p=d_new SocketSet();
+	socket_sets.insert( p );
+	return p;
+}
+
+void bbFreeSocketSet( SocketSet *p ){
+	debugSocketSet( p );
+	socket_sets.erase( p );
+	delete p;
+}
+
+void bbAddToSocketSet( SocketSet *p,void *s ){
+	debugSocketSet( p );
+	if( tcp_set.count( (TCPStream*)s ) ) p->add( s,((TCPStream*)s)->getSocket() );
+	else if( udp_set.count( (UDPStream*)s ) ) p->add( s,((UDPStream*)s)->getSocket() );
+	else if( server_set.count( (TCPServer*)s ) ) p->add( s,((TCPServer*)s)->getSocket() );
+	else if( debug ) RTEX( "Stream or Server does not exist" );
+}
+
+void bbRemoveFromSocketSet( SocketSet *p,void *s ){
+	debugSocketSet( p );
+	p->remove( s );
+}
+
+int bbWaitSocketSet( SocketSet *p,int timeout ){
+	debugSocketSet( p );
+	return p->wait( timeout );
+}
+
+void *bbNextReadySocket( SocketSet *p ){
+	debugSocketSet( p );
+	return p->next();
+}
+
 void bbTCPTimeouts( int rt,int at ){
 	read_timeout=rt;
 	accept_timeout=at;
@@ -472,6 +813,7 @@ bool sockets_create(){
 }
 
 bool sockets_destroy(){
+	while( socket_sets.size() ) bbFreeSocketSet( *socket_sets.begin() );
 	while( udp_set.size() ) bbCloseUDPStream( *udp_set.begin() );
 	while( tcp_set.size() ) bbCloseTCPStream( *tcp_set.begin() );
 	while( server_set.size() ) bbCloseTCPServer( *server_set.begin() );
@@ -488,6 +830,8 @@ void sockets_link( void(*rtSym)(const char*,void*) ){
 	rtSym( "CloseUDPStream%udp_stream",bbCloseUDPStream );
 	rtSym( "SendUDPMsg%udp_stream%dest_ip%dest_port=0",bbSendUDPMsg );
 	rtSym( "%RecvUDPMsg%udp_stream",bbRecvUDPMsg );
+	rtSym( "%RecvUDPMsgs%udp_stream%max_msgs=64",bbRecvUDPMsgs );
+	rtSym( "%NextUDPMsg%udp_stream",bbNextUDPMsg );
 	rtSym( "%UDPStreamIP%udp_stream",bbUDPStreamIP );
 	rtSym( "%UDPStreamPort%udp_stream",bbUDPStreamPort );
 	rtSym( "%UDPMsgIP%udp_stream",bbUDPMsgIP );
@@ -501,5 +845,14 @@ void sockets_link( void(*rtSym)(const char*,void*) ){
 	rtSym( "%AcceptTCPStream%tcp_server",bbAcceptTCPStream );
 	rtSym( "%TCPStreamIP%tcp_stream",bbTCPStreamIP );
 	rtSym( "%TCPStreamPort%tcp_stream",bbTCPStreamPort );
+	rtSym( "TCPStreamBuffer%tcp_stream%size%no_delay=0",bbTCPStreamBuffer );
+	rtSym( "FlushTCPStream%tcp_stream",bbFlushTCPStream );
 	rtSym( "TCPTimeouts%read_millis%accept_millis",bbTCPTimeouts );
+
+	rtSym( "%CreateSocketSet",bbCreateSocketSet );
+	rtSym( "FreeSocketSet%socket_set",bbFreeSocketSet );
+	rtSym( "AddToSocketSet%socket_set%stream",bbAddToSocketSet );
+	rtSym( "RemoveFromSocketSet%socket_set%stream",bbRemoveFromSocketSet );
+	rtSym( "%WaitSocketSet%socket_set%timeout_millis=-1",bbWaitSocketSet );
+	rtSym( "%NextReadySocket%socket_set",bbNextReadySocket );
 }
@@ -1,8 +1,11 @@
 
 #include "std.h"
 #include "bbstream.h"
+#include "lzblock.h"
 
-static set<bbStream*> stream_set;
+static ptrset<bbStream> stream_set;
+
+static void detachCompressedStreams( bbStream *s );
 
 void debugStream( bbStream *s ){
 	if( stream_set.count(s) ) return;
@@ -15,6 +18,14 @@ bbStream::bbStream(){
 
 bbStream::~bbStream(){
 	stream_set.erase( this );
+	detachCompressedStreams( this );
+}
+
+int bbStream::peek( const char **p ){
+	return 0;
+}
+
+void bbStream::consume( int n ){
 }
 
 int bbEof( bbStream *s ){
@@ -69,10 +80,34 @@ BBStr *bbReadString( bbStream *s ){
 	return str;
 }
 
+//as much of a line as is in p, dropping any CRs
+static void appendLine( BBStr *str,const char *p,int n ){
+	if( !memchr( p,'\r',n ) ){
+		str->append( p,n );
+		return;
+	}
+	for( int k=0;k<n;++k ){
+		if( p[k]!='\r' ) *str+=p[k];
+	}
+}
+
 BBStr *bbReadLine( bbStream *s ){
 	if( debug ) debugStream( s );
-	unsigned char c;
 	BBStr *str=d_new BBStr();
+	const char *p;
+	while( int n=s->peek( &p ) ){
+		const char *t=(const char*)memchr( p,'\n',n );
+		if( !t ){
+			appendLine( str,p,n );
+			s->consume( n );
+			continue;
+		}
+		appendLine( str,p,t-p );
+		s->consume( t-p+1 );
+		return str;
+	}
+	//unbuffered streams a char at a time
+	unsigned char c;
 	for(;;){
 		if( s->read( (char*)&c,1 )!=1 ) break;
 		if( c=='\n' ) break;
@@ -121,13 +156,146 @@ void bbCopyStream( bbStream *s,bbStream *d,int buff_size ){
 		debugStream( s );debugStream( d ); 
 		if( buff_size<1 || buff_size>1024*1024 ) RTEX( "Illegal buffer size" );
 	}
-	char *buff=d_new char[buff_size];
+	if( buff_size<1 ) buff_size=1;
+	else if( buff_size>1024*1024 ) buff_size=1024*1024;
+	static vector<char> buff;
+	if( buff.size()<buff_size ) buff.resize( buff_size );
 	while( s->eof()==0 && d->eof()==0 ){
-		int n=s->read( buff,buff_size );
-		d->write( buff,n );
+		int n=s->read( &buff[0],buff_size );
+		d->write( &buff[0],n );
 		if( n<buff_size ) break;
 	}
-	delete buff;
+}
+
+//Stream compressing writes to another stream and decompressing reads from it.
+//
+//Data goes out in blocks of up to BLOCK_SIZE bytes, each an int uncompressed
+//size and an int compressed size followed by the compressed data. A partial
+//block is written on FlushCompressedStream and on close.
+struct bbCompressedStream : public bbStream{
+	enum{ BLOCK_SIZE=65536 };
+
+	bbStream *stream;
+	int level,e;
+	vector<char> out,packed,in;
+	int in_get;
+
+	bbCompressedStream( bbStream *s,int level ):stream(s),level(level),e(0),in_get(0){
+	}
+	~bbCompressedStream(){
+		flush();
+	}
+
+	//the wrapped stream may have been closed under us
+	bool valid(){
+		if( !e && !stream ) e=EOF_ERROR;
+		return !e;
+	}
+	bool flush(){
+		if( !out.size() || !valid() ) return !e;
+		packed.resize( 8+lzBound( out.size() ) );
+		int head[2];
+		head[0]=out.size();
+		head[1]=lzCompress( out.data(),head[0],packed.data()+8,level );
+		memcpy( packed.data(),head,8 );
+		out.clear();
+		if( stream->write( packed.data(),8+head[1] )!=8+head[1] ) e=EOF_ERROR;
+		return !e;
+	}
+	bool nextBlock(){
+		in.clear();in_get=0;
+		if( !valid() ) return false;
+		int head[2];
+		if( stream->read( (char*)head,8 )!=8 ) return false;
+		if( head[0]<0 || head[0]>BLOCK_SIZE || head[1]<0 || head[1]>lzBound( BLOCK_SIZE ) ){
+			e=EOF_ERROR;
+			return false;
+		}
+		packed.resize( head[1] );
+		in.resize( head[0] );
+		if( stream->read( packed.data(),head[1] )!=head[1] ||
+			lzDecompress( packed.data(),head[1],in.data(),head[0] )!=head[0] ){
+			in.clear();
+			e=EOF_ERROR;
+			return false;
+		}
+		return true;
+	}
+
+	int read( char *buff,int size ){
+		int n=0;
+		while( n<size ){
+			if( in_get==in.size() && !nextBlock() ) break;
+			int t=in.size()-in_get;
+			if( t>size-n ) t=size-n;
+			memcpy( buff+n,in.data()+in_get,t );
+			in_get+=t;n+=t;
+		}
+		return n;
+	}
+	int write( const char *buff,int size ){
+		if( e ) return 0;
+		for( int n=0;n<size; ){
+			int t=BLOCK_SIZE-out.size();
+			if( t>size-n ) t=size-n;
+			out.insert( out.end(),buff+n,buff+n+t );
+			n+=t;
+			if( out.size()==BLOCK_SIZE && !flush() ) return n;
+		}
+		return size;
+	}
+	int avail(){
+		return in.size()-in_get;
+	}
+	int eof(){
+		if( in_get<in.size() ) return EOF_NOT;
+		if( !valid() ) return e;
+		return stream->eof();
+	}
+	int peek( const char **p ){
+		if( in_get==in.size() && !nextBlock() ) return 0;
+		*p=in.data()+in_get;
+		return in.size()-in_get;
+	}
+	void consume( int n ){
+		in_get+=n;
+	}
+};
+
+static ptrset<bbCompressedStream> compressed_set;
+
+static void detachCompressedStreams( bbStream *s ){
+	ptrset<bbCompressedStream>::const_iterator it;
+	for( it=compressed_set.begin();it!=compressed_set.end();++it ){
+		if( (*it)->stream==s ) (*it)->stream=0;
+	}
+}
+
+static inline void debugCompressedStream( bbCompressedStream *s ){
+	if( debug ){
+		if( !compressed_set.count( s ) ) RTEX( "Compressed Stream does not exist" );
+	}
+}
+
+bbCompressedStream *bbCreateCompressedStream( bbStream *s,int level ){
+	if( debug ){
+		debugStream( s );
+		if( level<1 || level>9 ) RTEX( "Illegal compression level" );
+	}
+	bbCompressedStream *t=d_new bbCompressedStream( s,level );
+	compressed_set.insert( t );
+	return t;
+}
+
+void bbFlushCompressedStream( bbCompressedStream *s ){
+	debugCompressedStream( s );
+	s->flush();
+}
+
+void bbCloseCompressedStream( bbCompressedStream *s ){
+	debugCompressedStream( s );
+	compressed_set.erase( s );
+	delete s;
 }
 
 bool stream_create(){
@@ -135,6 +303,7 @@ bool stream_create(){
 }
 
 bool stream_destroy(){
+	while( compressed_set.size() ) bbCloseCompressedStream( *compressed_set.begin() );
 	return true;
 }
 
@@ -154,6 +323,9 @@ void stream_link( void(*rtSym)(const char*,void*) ){
 	rtSym( "WriteString%stream$string",bbWriteString );
 	rtSym( "WriteLine%stream$string",bbWriteLine );
 	rtSym( "CopyStream%src_stream%dest_stream%buffer_size=16384",bbCopyStream );
+	rtSym( "%CreateCompressedStream%stream%level=1",bbCreateCompressedStream );
+	rtSym( "FlushCompressedStream%compressed_stream",bbFlushCompressedStream );
+	rtSym( "CloseCompressedStream%compressed_stream",bbCloseCompressedStream );
 }
 
 
@@ -24,6 +24,13 @@ public:
 
 	//returns EOF status
 	virtual int eof()=0;
+
+	//returns chars buffered at *p, filling the buffer first if it's empty.
+	//0 if the stream has no buffer or nothing more to read.
+	virtual int peek( const char **p );
+
+	//skips n chars of those returned by peek
+	virtual void consume( int n );
 };
 
 void debugStream( bbStream *s );
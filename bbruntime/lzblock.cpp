@@ -0,0 +1,171 @@
+
+#include "std.h"
+#include "lzblock.h"
+
+enum{
+	MIN_MATCH=4,
+	MAX_OFFSET=65535,
+	LAST_LITERALS=5,	//block always ends with at least this many literals...
+	MF_LIMIT=12,		//...and no match starts this close to the end
+	HASH_BITS=16
+};
+
+typedef unsigned char uchar;
+
+static inline unsigned read32( const uchar *p ){
+	unsigned n;
+	memcpy( &n,p,4 );
+	return n;
+}
+
+static inline unsigned hash4( const uchar *p ){
+	return (read32( p )*2654435761u)>>(32-HASH_BITS);
+}
+
+//length of common run at p and q, stopping at end
+static inline int matchLength( const uchar *p,const uchar *q,const uchar *end ){
+	const uchar *t=p;
+	while( p+4<=end && read32( p )==read32( q ) ){ p+=4;q+=4; }
+	while( p<end && *p==*q ){ ++p;++q; }
+	return p-t;
+}
+
+static inline uchar *putLength( uchar *op,int n ){
+	for( ;n>=255;n-=255 ) *op++=255;
+	*op++=n;
+	return op;
+}
+
+static uchar *putLiterals( uchar *op,uchar *token,const uchar *p,int n ){
+	*token=(n<15 ? n : 15)<<4;
+	if( n>=15 ) op=putLength( op,n-15 );
+	memcpy( op,p,n );
+	return op+n;
+}
+
+int lzBound( int n ){
+	return n+n/255+16;
+}
+
+int lzCompress( const void *src,int n,void *dst,int level ){
+	const uchar *base=(const uchar*)src,*ip=base,*anchor=base,*end=base+n;
+	uchar *op=(uchar*)dst;
+
+	if( n>MF_LIMIT ){
+		const uchar *mf_limit=end-MF_LIMIT,*match_limit=end-LAST_LITERALS;
+		bool chained=level>1;
+		int attempts=chained ? 1<<(level<9 ? level : 9) : 1;
+
+		vector<int> table( 1<<HASH_BITS,-1 );
+		vector<int> chain( chained ? n : 0 );
+
+		int misses=0;
+		while( ip<mf_limit ){
+			//find the longest match at ip among the candidates
+			unsigned h=hash4( ip );
+			int pos=ip-base,cand=table[h];
+			table[h]=pos;
+			if( chained ) chain[pos]=cand;
+
+			int best_len=0;
+			const uchar *best=0;
+			for( int k=attempts;k && cand>=0 && pos-cand<=MAX_OFFSET;--k ){
+				const uchar *m=base+cand;
+				if( read32( m )==read32( ip ) ){
+					int len=MIN_MATCH+matchLength( ip+MIN_MATCH,m+MIN_MATCH,match_limit );
+					if( len>best_len ){ best_len=len;best=m; }
+				}
+				if( !chained ) break;
+				cand=chain[cand];
+			}
+
+			if( best_len<MIN_MATCH ){
+				//step further the longer we go without a match
+				ip+=chained ? 1 : 1+(misses++>>5);
+				continue;
+			}
+			misses=0;
+
+			//extend backwards over literals, which have all been hashed already
+			const uchar *hashed=ip;
+			while( ip>anchor && best>base && ip[-1]==best[-1] ){ --ip;--best;++best_len; }
+
+			uchar *token=op++;
+			op=putLiterals( op,token,anchor,ip-anchor );
+			int off=ip-best;
+			*op++=off&255;
+			*op++=off>>8;
+			int ml=best_len-MIN_MATCH;
+			*token|=ml<15 ? ml : 15;
+			if( ml>=15 ) op=putLength( op,ml-15 );
+
+			const uchar *next=ip+best_len;
+			if( chained ){
+				//remember positions inside the match too
+				for( const uchar *p=hashed+1;p<next && p<mf_limit;++p ){
+					unsigned h=hash4( p );
+					chain[p-base]=table[h];
+					table[h]=p-base;
+				}
+			}else if( next-2>ip && next-2<mf_limit ){
+				table[hash4( next-2 )]=next-2-base;
+			}
+			ip=anchor=next;
+		}
+	}
+
+	uchar *token=op++;
+	op=putLiterals( op,token,anchor,end-anchor );
+	return op-(uchar*)dst;
+}
+
+int lzDecompress( const void *src,int n,void *dst,int size ){
+	const uchar *ip=(const uchar*)src,*end=ip+n;
+	uchar *op=(uchar*)dst,*out=op,*out_end=op+size;
+
+	for(;;){
+		if( ip>=end ) return -1;
+		int token=*ip++;
+
+		int lit=token>>4;
+		if( lit==15 ){
+			int t;
+			do{
+				if( ip>=end || lit>size ) return -1;
+				t=*ip++;
+				lit+=t;
+			}while( t==255 );
+		}
+		if( lit>end-ip || lit>out_end-op ) return -1;
+		memcpy( op,ip,lit );
+		op+=lit;ip+=lit;
+		if( ip==end ) break;
+
+		if( end-ip<2 ) return -1;
+		int off=ip[0]|(ip[1]<<8);
+		ip+=2;
+		if( !off || off>op-out ) return -1;
+
+		int ml=token&15;
+		if( ml==15 ){
+			int t;
+			do{
+				if( ip>=end || ml>size ) return -1;
+				t=*ip++;
+				ml+=t;
+			}while( t==255 );
+		}
+		ml+=MIN_MATCH;
+		if( ml>out_end-op ) return -1;
+
+		const uchar *m=op-off;
+		if( off>=ml ){
+			memcpy( op,m,ml );
+		}else{
+			//overlapping copy repeats the last off bytes
+			for( int k=0;k<ml;++k ) op[k]=m[k];
+		}
+		op+=ml;
+	}
+	return op-out;
+}
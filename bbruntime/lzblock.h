@@ -0,0 +1,20 @@
+
+#ifndef LZBLOCK_H
+#define LZBLOCK_H
+
+//LZ77 compression in the LZ4 block format.
+//
+//level 1 takes the first match a hash table offers and skips ahead faster
+//through data that isn't compressing. Higher levels, up to 9, search hash
+//chains of up to 1<<level candidates for the longest match.
+
+//worst case compressed size of n bytes
+int lzBound( int n );
+
+//returns compressed size, dst must hold lzBound(n) bytes
+int lzCompress( const void *src,int n,void *dst,int level );
+
+//returns decompressed size, or -1 if src is corrupt or won't fit in size bytes
+int lzDecompress( const void *src,int n,void *dst,int size );
+
+#endif
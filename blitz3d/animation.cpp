@@ -6,9 +6,24 @@ struct Animation::Rep{
 
 	int ref_cnt;
 
-	typedef map<int,Quat> KeyList;
+	struct VecKey{
+		int frame;
+		Vector value;
+	};
+	struct RotKey{
+		int frame;
+		Quat value;
+	};
+	//compressed rotation key, components scaled by 32767
+	struct PackedKey{
+		int frame;
+		short value[4];
+	};
 
-	KeyList scale_anim,rot_anim,pos_anim;
+	//keys are sorted by frame
+	vector<VecKey> scale_anim,pos_anim;
+	vector<RotKey> rot_anim;
+	vector<PackedKey> packed_rot;	//replaces rot_anim once compressed
 
 	Rep():
 	ref_cnt(1){
@@ -16,44 +31,213 @@ struct Animation::Rep{
 
 	Rep( const Rep &t ):
 	ref_cnt(1),
-	scale_anim(t.scale_anim),rot_anim(t.rot_anim),pos_anim(t.pos_anim){
+	scale_anim(t.scale_anim),pos_anim(t.pos_anim),rot_anim(t.rot_anim),packed_rot(t.packed_rot){
 	}
 
-	Vector getLinearValue( const KeyList &keys,float time )const{
-		KeyList::const_iterator next,curr;
+	//index of first key after time
+	template<class K>
+	static int nextKey( const vector<K> &keys,float time ){
+		int frame=(int)time,lo=0,hi=keys.size();
+		while( lo<hi ){
+			int m=(lo+hi)/2;
+			if( keys[m].frame<=frame ) lo=m+1;
+			else hi=m;
+		}
+		return lo;
+	}
 
-		//for( next=keys.begin();next!=keys.end() && time>=next->first;++next ){}
-		next=keys.upper_bound( (int)time );
+	static Vector getLinearValue( const vector<VecKey> &keys,float time ){
+		int next=nextKey( keys,time );
 
-		if( next==keys.begin() ) return next->second.v;
-		curr=next;--curr;
-		if( next==keys.end() ) return curr->second.v;
+		if( next==0 ) return keys[0].value;
+		const VecKey &curr=keys[next-1];
+		if( next==keys.size() ) return curr.value;
 
-		float delta=( time-curr->first )/( next->first-curr->first );
-		return ( next->second.v-curr->second.v )*delta+curr->second.v;
+		float delta=( time-curr.frame )/( keys[next].frame-curr.frame );
+		return ( keys[next].value-curr.value )*delta+curr.value;
 	}
-	
-	Quat getSlerpValue( const KeyList &keys,float time )const{
-		KeyList::const_iterator next,curr;
 
-		//for( next=keys.begin();next!=keys.end() && time>=next->first;++next ){}
-		next=keys.upper_bound( (int)time );
+	static Quat getSlerpValue( const vector<RotKey> &keys,float time ){
+		int next=nextKey( keys,time );
 
-		if( next==keys.begin() ) return next->second;
-		curr=next;--curr;
-		if( next==keys.end() ) return curr->second;
+		if( next==0 ) return keys[0].value;
+		const RotKey &curr=keys[next-1];
+		if( next==keys.size() ) return curr.value;
 
-		float delta=( time-curr->first )/( next->first-curr->first );
-		return curr->second.slerpTo( next->second,delta );
+		float delta=( time-curr.frame )/( keys[next].frame-curr.frame );
+		return curr.value.slerpTo( keys[next].value,delta );
 	}
 
-	void setKey( KeyList &keys,int time,const Quat &value ){
-		keys[time]=value;
+	static Quat unpack( const PackedKey &k ){
+		const float s=1.0f/32767;
+		return Quat( k.value[3]*s,Vector( k.value[0]*s,k.value[1]*s,k.value[2]*s ) ).normalized();
+	}
+
+	static Quat getSlerpValue( const vector<PackedKey> &keys,float time ){
+		int next=nextKey( keys,time );
+
+		if( next==0 ) return unpack( keys[0] );
+		const PackedKey &curr=keys[next-1];
+		if( next==keys.size() ) return unpack( curr );
+
+		float delta=( time-curr.frame )/( keys[next].frame-curr.frame );
+		return unpack( curr ).slerpTo( unpack( keys[next] ),delta );
+	}
+
+	template<class K,class V>
+	static void setKey( vector<K> &keys,int frame,const V &value ){
+		//keys are mostly added in order
+		int n=keys.size();
+		if( !n || frame>keys[n-1].frame ){
+			K k;k.frame=frame;k.value=value;
+			keys.push_back( k );
+			return;
+		}
+		int i=nextKey( keys,frame );
+		if( i && keys[i-1].frame==frame ){
+			keys[i-1].value=value;
+			return;
+		}
+		K k;k.frame=frame;k.value=value;
+		keys.insert( keys.begin()+i,k );
+	}
+
+	void unpackRotations(){
+		if( !packed_rot.size() ) return;
+		rot_anim.resize( packed_rot.size() );
+		for( int k=0;k<packed_rot.size();++k ){
+			rot_anim[k].frame=packed_rot[k].frame;
+			rot_anim[k].value=unpack( packed_rot[k] );
+		}
+		vector<PackedKey>().swap( packed_rot );
+	}
+
+	int numRotationKeys()const{
+		return packed_rot.size() ? packed_rot.size() : rot_anim.size();
+	}
+
+	template<class K>
+	static void getKeys( const vector<K> &keys,vector<Key> &out ){
+		out.resize( keys.size() );
+		for( int k=0;k<keys.size();++k ){
+			out[k].frame=keys[k].frame;
+			out[k].value=Quat( 0,keys[k].value );
+		}
+	}
+
+	void getRotationKeys( vector<Key> &out )const{
+		if( packed_rot.size() ){
+			out.resize( packed_rot.size() );
+			for( int k=0;k<packed_rot.size();++k ){
+				out[k].frame=packed_rot[k].frame;
+				out[k].value=unpack( packed_rot[k] );
+			}
+			return;
+		}
+		out.resize( rot_anim.size() );
+		for( int k=0;k<rot_anim.size();++k ){
+			out[k].frame=rot_anim[k].frame;
+			out[k].value=rot_anim[k].value;
+		}
+	}
+
+	//drop keys that interpolation between their neighbours reproduces to within tolerance
+	static void reduce( vector<VecKey> &keys,float tol ){
+		if( keys.size()<3 ){
+			if( keys.size()==2 && keys[0].value.distance( keys[1].value )<=tol ) keys.pop_back();
+			return;
+		}
+		vector<VecKey> out;
+		out.push_back( keys[0] );
+		int last=0;
+		for( int k=1;k<keys.size()-1;++k ){
+			const VecKey &a=keys[last],&b=keys[k+1];
+			for( int j=last+1;j<=k;++j ){
+				float delta=float( keys[j].frame-a.frame )/( b.frame-a.frame );
+				Vector v=( b.value-a.value )*delta+a.value;
+				if( v.distance( keys[j].value )>tol ){
+					out.push_back( keys[k] );
+					last=k;
+					break;
+				}
+			}
+		}
+		out.push_back( keys.back() );
+		if( out.size()==2 ){
+			//a single key holds its value, so every dropped key must be within tol of it
+			int k;
+			for( k=1;k<keys.size() && out[0].value.distance( keys[k].value )<=tol;++k ){}
+			if( k==keys.size() ) out.pop_back();
+		}
+		keys.swap( out );
+	}
+
+	//angle between two rotations
+	static float angle( const Quat &a,const Quat &b ){
+		float d=fabs( a.dot( b ) );
+		return d>=1 ? 0 : 2*acosf( d );
+	}
+
+	static void reduce( vector<RotKey> &keys,float tol ){
+		if( keys.size()<3 ){
+			if( keys.size()==2 && angle( keys[0].value,keys[1].value )<=tol ) keys.pop_back();
+			return;
+		}
+		vector<RotKey> out;
+		out.push_back( keys[0] );
+		int last=0;
+		for( int k=1;k<keys.size()-1;++k ){
+			const RotKey &a=keys[last],&b=keys[k+1];
+			for( int j=last+1;j<=k;++j ){
+				float delta=float( keys[j].frame-a.frame )/( b.frame-a.frame );
+				if( angle( a.value.slerpTo( b.value,delta ),keys[j].value )>tol ){
+					out.push_back( keys[k] );
+					last=k;
+					break;
+				}
+			}
+		}
+		out.push_back( keys.back() );
+		if( out.size()==2 ){
+			int k;
+			for( k=1;k<keys.size() && angle( out[0].value,keys[k].value )<=tol;++k ){}
+			if( k==keys.size() ) out.pop_back();
+		}
+		keys.swap( out );
+	}
+
+	static short quantize( float n ){
+		int t=(int)floorf( n*32767+.5f );
+		return t<-32767 ? -32767 : ( t>32767 ? 32767 : t );
+	}
+
+	void compress( float pos_tol,float rot_tol ){
+		unpackRotations();
+		reduce( scale_anim,pos_tol );
+		reduce( pos_anim,pos_tol );
+		reduce( rot_anim,rot_tol );
+
+		packed_rot.resize( rot_anim.size() );
+		for( int k=0;k<rot_anim.size();++k ){
+			Quat q=rot_anim[k].value.normalized();
+			PackedKey &p=packed_rot[k];
+			p.frame=rot_anim[k].frame;
+			p.value[0]=quantize( q.v.x );
+			p.value[1]=quantize( q.v.y );
+			p.value[2]=quantize( q.v.z );
+			p.value[3]=quantize( q.w );
+		}
+		vector<RotKey>().swap( rot_anim );
+		vector<VecKey>( scale_anim ).swap( scale_anim );
+		vector<VecKey>( pos_anim ).swap( pos_anim );
 	}
 };
 
-Animation::Animation():
-rep( new Rep() ){
+Animation::Animation(){
+	//shared by every animation without keys, so empty animations don't cost an allocation each
+	static Rep *empty=new Rep();
+	rep=empty;
+	++rep->ref_cnt;
 }
 
 Animation::Animation( const Animation &t ):
@@ -63,18 +247,28 @@ rep( t.rep ){
 
 Animation::Animation( const Animation &t,int first,int last ):
 rep( new Rep() ){
-	Rep::KeyList::const_iterator it;
-	for( it=t.rep->pos_anim.begin();it!=t.rep->pos_anim.end();++it ){
-		if( it->first<first || it->first>last ) continue;
-		rep->setKey( rep->pos_anim,it->first-first,it->second );
+	const Rep &r=*t.rep;
+	for( int k=0;k<r.pos_anim.size();++k ){
+		int frame=r.pos_anim[k].frame;
+		if( frame<first || frame>last ) continue;
+		rep->setKey( rep->pos_anim,frame-first,r.pos_anim[k].value );
 	}
-	for( it=t.rep->scale_anim.begin();it!=t.rep->scale_anim.end();++it ){
-		if( it->first<first || it->first>last ) continue;
-		rep->setKey( rep->scale_anim,it->first-first,it->second );
+	for( int k=0;k<r.scale_anim.size();++k ){
+		int frame=r.scale_anim[k].frame;
+		if( frame<first || frame>last ) continue;
+		rep->setKey( rep->scale_anim,frame-first,r.scale_anim[k].value );
 	}
-	for( it=t.rep->rot_anim.begin();it!=t.rep->rot_anim.end();++it ){
-		if( it->first<first || it->first>last ) continue;
-		rep->setKey( rep->rot_anim,it->first-first,it->second );
+	for( int k=0;k<r.rot_anim.size();++k ){
+		int frame=r.rot_anim[k].frame;
+		if( frame<first || frame>last ) continue;
+		rep->setKey( rep->rot_anim,frame-first,r.rot_anim[k].value );
+	}
+	for( int k=0;k<r.packed_rot.size();++k ){
+		int frame=r.packed_rot[k].frame;
+		if( frame<first || frame>last ) continue;
+		Rep::PackedKey p=r.packed_rot[k];
+		p.frame-=first;
+		rep->packed_rot.push_back( p );
 	}
 }
 
@@ -99,31 +293,50 @@ Animation::Rep *Animation::write(){
 
 void Animation::setScaleKey( int time,const Vector &q ){
 	write();
-	rep->setKey( rep->scale_anim,time,Quat( 0,q ) );
+	rep->setKey( rep->scale_anim,time,q );
 }
 
 void Animation::setPositionKey( int time,const Vector &q ){
 	write();
-	rep->setKey( rep->pos_anim,time,Quat( 0,q ) );
+	rep->setKey( rep->pos_anim,time,q );
 }
 
 void Animation::setRotationKey( int time,const Quat &q ){
 	write();
+	rep->unpackRotations();
 	rep->setKey( rep->rot_anim,time,q );
 }
 
+void Animation::compress( float pos_tol,float rot_tol ){
+	if( !rep->scale_anim.size() && !rep->pos_anim.size() && !rep->numRotationKeys() ) return;
+	write();
+	rep->compress( pos_tol,rot_tol );
+}
+
 int Animation::numScaleKeys()const{
 	return rep->scale_anim.size();
 }
 
 int Animation::numRotationKeys()const{
-	return rep->rot_anim.size();
+	return rep->numRotationKeys();
 }
 
 int Animation::numPositionKeys()const{
 	return rep->pos_anim.size();
 }
 
+void Animation::getScaleKeys( vector<Key> &keys )const{
+	rep->getKeys( rep->scale_anim,keys );
+}
+
+void Animation::getPositionKeys( vector<Key> &keys )const{
+	rep->getKeys( rep->pos_anim,keys );
+}
+
+void Animation::getRotationKeys( vector<Key> &keys )const{
+	rep->getRotationKeys( keys );
+}
+
 Vector Animation::getScale( float time )const{
 	if( !rep->scale_anim.size() ) return Vector(1,1,1);
 	return rep->getLinearValue( rep->scale_anim,time );
@@ -135,6 +348,7 @@ Vector Animation::getPosition( float time )const{
 }
 
 Quat Animation::getRotation( float time )const{
+	if( rep->packed_rot.size() ) return rep->getSlerpValue( rep->packed_rot,time );
 	if( !rep->rot_anim.size() ) return Quat();
 	return rep->getSlerpValue( rep->rot_anim,time );
 }
@@ -8,6 +8,11 @@
 
 class Animation{
 public:
+	struct Key{
+		int frame;
+		Quat value;		//scale and position keys use value.v
+	};
+
 	Animation();
 	Animation( const Animation &t );
 	Animation( const Animation &t,int first,int last );
@@ -19,10 +24,17 @@ public:
 	void setPositionKey( int frame,const Vector &p );
 	void setRotationKey( int frame,const Quat &q );
 
+	//drops keys interpolation reproduces to within pos_tol units/rot_tol radians and packs rotations into 16 bits per component
+	void compress( float pos_tol,float rot_tol );
+
 	int numScaleKeys()const;
 	int numRotationKeys()const;
 	int numPositionKeys()const;
 
+	void getScaleKeys( vector<Key> &keys )const;
+	void getPositionKeys( vector<Key> &keys )const;
+	void getRotationKeys( vector<Key> &keys )const;
+
 	Vector getScale( float time )const;
 	Vector getPosition( float time )const;
 	Quat getRotation( float time )const;
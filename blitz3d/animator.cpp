@@ -3,36 +3,49 @@
 #include "animator.h"
 #include "object.h"
 
-Animator::Animator( Animator *t ):_seqs( t->_seqs ){
+Animator::Animator( Animator *t ):_tracks( t->_tracks ){
+
+	++_tracks->ref_cnt;
 
 	_objs.resize( t->_objs.size() );
-	_anims.resize( t->_anims.size() );
 
 	for( int k=0;k<t->_objs.size();++k ){
 		_objs[k]=t->_objs[k]->getLastCopy();
-		_anims[k].keys=t->_anims[k].keys;
 	}
 
 	reset();
 }
 
-Animator::Animator( Object *obj,int frames ){
+Animator::Animator( Object *obj,int frames ):_tracks( d_new Tracks() ){
 	addObjs( obj );
-	_anims.resize( _objs.size() );
+	_tracks->keys.resize( _objs.size() );
 	addSeq( frames );
 	reset();
 }
 
-Animator::Animator( const vector<Object*> &objs,int frames ):_objs(objs){
-	_anims.resize( _objs.size() );
+Animator::Animator( const vector<Object*> &objs,int frames ):_tracks( d_new Tracks() ),_objs(objs){
+	_tracks->keys.resize( _objs.size() );
 	addSeq( frames );
 	reset();
 }
 
+Animator::~Animator(){
+	if( !--_tracks->ref_cnt ) delete _tracks;
+}
+
 void Animator::reset(){
 	_seq=_mode=_seq_len=_time=_speed=_trans_time=_trans_speed=0;
 }
 
+Animator::Tracks *Animator::write(){
+	if( _tracks->ref_cnt>1 ){
+		--_tracks->ref_cnt;
+		_tracks=d_new Tracks( *_tracks );
+		_tracks->ref_cnt=1;
+	}
+	return _tracks;
+}
+
 void Animator::addObjs( Object *obj ){
 	_objs.push_back( obj );
 	for( Entity *e=obj->children();e;e=e->successor() ){
@@ -41,41 +54,51 @@ void Animator::addObjs( Object *obj ){
 }
 
 void Animator::addSeq( int frames ){
+	Tracks *t=write();
 	Seq seq;
 	seq.frames=frames;
-	_seqs.push_back( seq );
+	t->seqs.push_back( seq );
 	for( int k=0;k<_objs.size();++k ){
 		Object *obj=_objs[k];
-		_anims[k].keys.push_back( obj->getAnimation() );
+		t->keys[k].push_back( obj->getAnimation() );
 		obj->setAnimation( Animation() );
 	}
 }
 
 void Animator::addSeqs( Animator *t ){
-	for( int n=0;n<t->_seqs.size();++n ){
-		_seqs.push_back( t->_seqs[n] );
+	Tracks *tracks=write();
+	for( int n=0;n<t->_tracks->seqs.size();++n ){
+		tracks->seqs.push_back( t->_tracks->seqs[n] );
 		for( int k=0;k<_objs.size();++k ){
 			int j;
 			for( j=0;j<t->_objs.size();++j ){
 				if( _objs[k]->getName()==t->_objs[j]->getName() ) break;
 			}
 			if( j==t->_objs.size() ){
-				_anims[k].keys.push_back( Animation() );
+				tracks->keys[k].push_back( Animation() );
 				continue;
 			}
-			_anims[k].keys.push_back( t->_anims[j].keys[n] );
+			tracks->keys[k].push_back( t->_tracks->keys[j][n] );
 		}
 	}
 }
 
 void Animator::extractSeq( int first,int last,int seq ){
+	Tracks *t=write();
 	Seq sq;
 	sq.frames=last-first;
-	_seqs.push_back( sq );
+	t->seqs.push_back( sq );
 
 	for( int k=0;k<_objs.size();++k ){
-		Animation &keys=_anims[k].keys[seq];
-		_anims[k].keys.push_back( Animation( keys,first,last ) );
+		vector<Animation> &keys=t->keys[k];
+		keys.push_back( Animation( keys[seq],first,last ) );
+	}
+}
+
+void Animator::compress( float pos_tol,float rot_tol ){
+	Tracks *t=write();
+	for( int k=0;k<t->keys.size();++k ){
+		for( int n=0;n<t->keys[k].size();++n ) t->keys[k][n].compress( pos_tol,rot_tol );
 	}
 }
 
@@ -84,7 +107,7 @@ void Animator::updateAnim(){
 	for( int k=0;k<_objs.size();++k ){
 
 		Object *obj=_objs[k];
-		const Animation &keys=_anims[k].keys[_seq];
+		const Animation &keys=_tracks->keys[k][_seq];
 
 		if( keys.numPositionKeys() ){
 			obj->setLocalPosition( keys.getPosition( _time ) );
@@ -103,7 +126,7 @@ void Animator::updateTrans(){
 	for( int k=0;k<_objs.size();++k ){
 
 		Object *obj=_objs[k];
-		const Anim &anim=_anims[k];
+		const Trans &anim=_trans[k];
 
 		if( anim.pos ) obj->setLocalPosition( (anim.dest_pos-anim.src_pos)*_trans_time+anim.src_pos );
 		if( anim.scl ) obj->setLocalScale( (anim.dest_scl-anim.src_scl)*_trans_time+anim.src_scl );
@@ -113,11 +136,13 @@ void Animator::updateTrans(){
 
 void Animator::beginTrans(){
 
+	_trans.resize( _objs.size() );
+
 	for( int k=0;k<_objs.size();++k ){
 
 		Object *obj=_objs[k];
-		Anim &anim=_anims[k];
-		const Animation &keys=_anims[k].keys[_seq];
+		Trans &anim=_trans[k];
+		const Animation &keys=_tracks->keys[k][_seq];
 
 		if( anim.pos=!!keys.numPositionKeys() ){
 			anim.src_pos=obj->getLocalPosition();
@@ -135,12 +160,12 @@ void Animator::beginTrans(){
 }
 
 void Animator::setAnimTime( float time,int seq ){
-	if( seq<0 || seq>_seqs.size() ) return;
+	if( seq<0 || seq>=_tracks->seqs.size() ) return;
 
 	_mode=0;
 	_speed=0;
 	_seq=seq;
-	_seq_len=_seqs[_seq].frames;
+	_seq_len=_tracks->seqs[_seq].frames;
 
 	//Ok, mod the anim time!
 	if (time < 0 || time > _seq_len) {
@@ -157,11 +182,11 @@ void Animator::setAnimTime( float time,int seq ){
 void Animator::animate( int mode,float speed,int seq,float trans ){
 	if( !mode && !speed ){ _mode=0;return; }
 
-	if( seq<0 || seq>=_seqs.size() ) return;
+	if( seq<0 || seq>=_tracks->seqs.size() ) return;
 
 	_seq=seq;
 	_mode=mode;
-	_seq_len=_seqs[_seq].frames;
+	_seq_len=_tracks->seqs[_seq].frames;
 	_speed=speed;
 	_time=_speed>=0 ? 0 : _seq_len;
 
@@ -188,6 +213,7 @@ void Animator::update( float elapsed ){
 			return;
 		}
 		_mode&=0x7fff;
+		vector<Trans>().swap( _trans );
 		if( !_mode || !_speed ){
 			updateAnim();
 			_mode=0;
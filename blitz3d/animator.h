@@ -20,12 +20,16 @@ public:
 
 	Animator( const vector<Object*> &objs,int frames );
 
+	~Animator();
+
 	void addSeq( int frames );
 
 	void addSeqs( Animator *t );
 
 	void extractSeq( int first,int last,int seq );
 
+	void compress( float pos_tol,float rot_tol );
+
 	void setAnimTime( float time,int seq );
 
 	void animate( int mode,float speed,int seq,float trans );
@@ -37,7 +41,9 @@ public:
 	float animTime()const{ return _time; }
 	bool animating()const{ return !!_mode; }
 
-	int numSeqs()const{ return _seqs.size(); }
+	int numSeqs()const{ return _tracks->seqs.size(); }
+	int seqFrames( int seq )const{ return _tracks->seqs[seq].frames; }
+	const Animation &getKeys( int obj,int seq )const{ return _tracks->keys[obj][seq]; }
 	const vector<Object*> &getObjects()const{ return _objs; }
 
 private:
@@ -45,26 +51,31 @@ private:
 		int frames;
 	};
 
-	struct Anim{
-		//anim keys
-		vector<Animation> keys;
-		//for transitions...
+	//sequences and keys - copies of an animator share these until one of them changes them
+	struct Tracks{
+		int ref_cnt;
+		vector<Seq> seqs;
+		vector<vector<Animation> > keys;	//keys[obj][seq]
+		Tracks():ref_cnt(1){}
+	};
+
+	//for transitions...
+	struct Trans{
 		bool pos,scl,rot;
 		Vector src_pos,dest_pos;
 		Vector src_scl,dest_scl;
 		Quat src_rot,dest_rot;
-		Anim():pos(false),scl(false),rot(false){}
 	};
 
-	vector<Seq> _seqs;
-
-	vector<Anim> _anims;
+	Tracks *_tracks;
+	vector<Trans> _trans;	//only allocated while transitioning
 	vector<Object*> _objs;
 
 	int _seq,_mode,_seq_len;
 	float _time,_speed,_trans_time,_trans_speed;
 
 	void reset();
+	Tracks *write();
 	void addObjs( Object *obj );
 	void updateAnim();
 	void beginTrans();
@@ -187,6 +187,10 @@ int Brush::getBlend()const{
 	return rs.blend=gxScene::BLEND_REPLACE;
 }
 
+int Brush::getBlendSetting()const{
+	return rep->blend;
+}
+
 int Brush::getFX()const{
 	return rep->rs.fx;
 }
@@ -25,6 +25,7 @@ public:
 	float getAlpha()const;
 	float getShininess()const;
 	int getBlend()const;
+	int getBlendSetting()const;
 	int getFX()const;
 	Texture getTexture( int index )const;
 
@@ -153,6 +153,10 @@ string CachedTexture::getName()const{
 	return rep->file;
 }
 
+int CachedTexture::getFlags()const{
+	return rep->flags;
+}
+
 const vector<gxCanvas*> &CachedTexture::getFrames()const{
 	return rep->frames;
 }
@@ -14,6 +14,7 @@ public:
 	CachedTexture &operator=( const CachedTexture &t );
 
 	string getName()const;
+	int getFlags()const;
 
 	const vector<gxCanvas*> &getFrames()const;
 
@@ -5,6 +5,13 @@
 //#include "stats.h"
 
 Entity *Entity::_orphans,*Entity::_last_orphan;
+int Entity::_visible_changes,Entity::_enabled_changes;
+vector<Entity*> Entity::_moved;
+
+//bumped by every local transform change - a world transform checked at the current epoch is valid
+int Entity::_tform_epoch;
+//source of unique world transform versions
+int Entity::_world_versions;
 
 enum{
 	INVALID_LOCALTFORM=1,
@@ -12,6 +19,8 @@ enum{
 };
 
 void Entity::remove(){
+	++_visible_changes;
+	++_enabled_changes;
 	if( _parent ){
 		if( _parent->_children==this ) _parent->_children=_succ;
 		if( _parent->_last_child==this ) _parent->_last_child=_pred;
@@ -24,6 +33,8 @@ void Entity::remove(){
 }
 
 void Entity::insert(){
+	++_visible_changes;
+	++_enabled_changes;
 	_succ=0;
 	if( _parent ){
 		if( _pred=_parent->_last_child ) _pred->_succ=this;
@@ -40,7 +51,7 @@ Entity::Entity():
 _succ(0),_pred(0),_parent(0),_children(0),_last_child(0),
 _visible(true),_enabled(true),
 local_scl(1,1,1),
-invalid(0){
+invalid(0),world_epoch(-1),world_version(0),parent_version(-1),moved_index(-1){
 	insert();
 }
 
@@ -50,21 +61,38 @@ _name(e._name),_visible(e._visible),_enabled(e._enabled),
 local_pos(e.local_pos),
 local_scl(e.local_scl),
 local_rot(e.local_rot),
-invalid( INVALID_LOCALTFORM|INVALID_WORLDTFORM ){
+invalid( INVALID_LOCALTFORM|INVALID_WORLDTFORM ),world_epoch(-1),world_version(0),parent_version(-1),moved_index(-1){
 	insert();
 }
 
 Entity::~Entity(){
 	while( children() ) delete children();
 	remove();
+	if( moved_index>=0 ){
+		Entity *t=_moved.back();
+		_moved[moved_index]=t;
+		t->moved_index=moved_index;
+		_moved.pop_back();
+	}
 }
 
+void Entity::moved(){
+	if( moved_index>=0 ) return;
+	moved_index=_moved.size();
+	_moved.push_back( this );
+}
+
+void Entity::takeMoved( vector<Entity*> &out ){
+	out.swap( _moved );
+	_moved.clear();
+	for( int k=0;k<out.size();++k ) out[k]->moved_index=-1;
+}
+
+//children notice on their next read, when their parent's version has moved on
 void Entity::invalidateWorld(){
-	if( invalid & INVALID_WORLDTFORM ) return;
 	invalid|=INVALID_WORLDTFORM;
-	for( Entity *e=_children;e;e=e->_succ ){
-		e->invalidateWorld();
-	}
+	++_tform_epoch;
+	moved();
 }
 
 void Entity::invalidateLocal(){
@@ -85,13 +113,39 @@ const Transform &Entity::getLocalTform()const{
 }
 
 const Transform &Entity::getWorldTform()const{
-	if( invalid&INVALID_WORLDTFORM ){
-		world_tform=_parent ? _parent->getWorldTform() * getLocalTform() : getLocalTform();
-		invalid&=~INVALID_WORLDTFORM;
+	if( world_epoch==_tform_epoch ) return world_tform;
+	world_epoch=_tform_epoch;
+
+	if( _parent ){
+		const Transform &t=_parent->getWorldTform();
+		if( !(invalid&INVALID_WORLDTFORM) && parent_version==_parent->world_version ) return world_tform;
+		world_tform=t * getLocalTform();
+		parent_version=_parent->world_version;
+	}else{
+		if( !(invalid&INVALID_WORLDTFORM) ) return world_tform;
+		world_tform=getLocalTform();
 	}
+	invalid&=~INVALID_WORLDTFORM;
+	world_version=++_world_versions;
 	return world_tform;
 }
 
+void Entity::updateWorldTform()const{
+	getWorldTform();
+	for( Entity *e=_children;e;e=e->_succ ){
+		e->updateWorldTform();
+	}
+}
+
+void Entity::updateWorldTforms(){
+	static int epoch=-1;
+	if( epoch==_tform_epoch ) return;
+	for( Entity *e=_orphans;e;e=e->_succ ){
+		e->updateWorldTform();
+	}
+	epoch=_tform_epoch;
+}
+
 void Entity::setParent( Entity *p ){
 	if( _parent==p ) return;
 
@@ -109,11 +163,15 @@ void Entity::setName( const string &t ){
 }
 
 void Entity::setVisible( bool visible ){
+	if( _visible==visible ) return;
 	_visible=visible;
+	++_visible_changes;
 }
 
 void Entity::setEnabled( bool enabled ){
+	if( _enabled==enabled ) return;
 	_enabled=enabled;
+	++_enabled_changes;
 }
 
 void Entity::enumVisible( vector<Object*> &out ){
@@ -73,16 +73,37 @@ public:
 
 	static Entity *orphans(){ return _orphans; }
 
+	//validates every world transform, parents first
+	static void updateWorldTforms();
+
+	//bumped whenever the visible/enabled entities might have changed
+	static int visibleChanges(){ return _visible_changes; }
+	static int enabledChanges(){ return _enabled_changes; }
+
+	//entities whose world transform or collision bounds might have changed since the
+	//last call - their children may have moved with them. There's only one taker, the
+	//world's pick tree.
+	static void takeMoved( vector<Entity*> &out );
+
+protected:
+	static void enabledChanged(){ ++_enabled_changes; }
+	void boundsChanged(){ moved(); }
+
 private:
 	Entity *_succ,*_pred,*_parent,*_children,*_last_child;
 
 	static Entity *_orphans,*_last_orphan;
+	static int _visible_changes,_enabled_changes;
+	static vector<Entity*> _moved;
+	static int _tform_epoch,_world_versions;
 
 	bool _visible,_enabled;
 
 	std::string _name;
 
 	mutable int invalid;
+	mutable int world_epoch,world_version,parent_version;
+	int moved_index;		//index in _moved, or -1
 
 	Quat local_rot;
 	Vector local_pos,local_scl;
@@ -96,6 +117,8 @@ private:
 	void remove();
 	void invalidateLocal();
 	void invalidateWorld();
+	void moved();
+	void updateWorldTform()const;
 };
 
 #endif
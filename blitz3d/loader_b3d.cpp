@@ -7,8 +7,9 @@
 
 //#define SHOW_BONES
 
-static FILE *in;
-static vector<int> chunk_stack;
+static mmapfile in;
+static const char *in_pos;
+static vector<const char*> chunk_stack;
 static vector<Texture> textures;
 static vector<Brush> brushes;
 static vector<Object*> bones;
@@ -27,28 +28,45 @@ static void clear(){
 	chunk_stack.clear();
 }
 
+static const char *chunkEnd(){
+	return chunk_stack.size() ? chunk_stack.back() : in.data()+in.size();
+}
+
 static int readChunk(){
+	const char *end=chunkEnd();
+	if( end-in_pos<8 ){
+		in_pos=end;
+		chunk_stack.push_back( end );
+		return 0;
+	}
 	int header[2];
-	if( fread( header,8,1,in )<1 ) return 0;
-	chunk_stack.push_back( ftell( in )+header[1] );
+	memcpy( header,in_pos,8 );
+	in_pos+=8;
+	//clamp bad chunk sizes to the enclosing chunk
+	int sz=header[1];
+	if( sz<0 || sz>end-in_pos ) sz=end-in_pos;
+	chunk_stack.push_back( in_pos+sz );
 	return swap_endian( header[0] );
 }
 
 static void exitChunk(){
-	fseek( in,chunk_stack.back(),SEEK_SET );
+	in_pos=chunk_stack.back();
 	chunk_stack.pop_back();
 }
 
 static int chunkSize(){
-	return chunk_stack.back()-ftell( in );
+	return chunk_stack.back()-in_pos;
 }
 
 static void read( void *buf,int n ){
-	fread( buf,n,1,in );
-}
-
-static void skip( int n ){
-	fseek( in,n,SEEK_CUR );
+	if( n<=0 ) return;
+	int sz=chunkSize();
+	if( n>sz ){
+		memset( (char*)buf+sz,0,n-sz );
+		n=sz;
+	}
+	memcpy( buf,in_pos,n );
+	in_pos+=n;
 }
 
 static int readInt(){
@@ -71,22 +89,25 @@ static void readFloatArray( float t[],int n ){
 	read( t,n*4 );
 }
 
-static void readColor( unsigned *t ){
-	float r=readFloat();if(r<0) r=0;else if(r>1) r=1;
-	float g=readFloat();if(g<0) g=0;else if(g>1) g=1;
-	float b=readFloat();if(b<0) b=0;else if(b>1) b=1;
-	float a=readFloat();if(a<0) a=0;else if(a>1) a=1;
-	*t=(int(a*255)<<24)|(int(r*255)<<16)|(int(g*255)<<8)|int(b*255);
+static unsigned decodeColor( const float *rgba ){
+	float r=rgba[0];if(r<0) r=0;else if(r>1) r=1;
+	float g=rgba[1];if(g<0) g=0;else if(g>1) g=1;
+	float b=rgba[2];if(b<0) b=0;else if(b>1) b=1;
+	float a=rgba[3];if(a<0) a=0;else if(a>1) a=1;
+	return (int(a*255)<<24)|(int(r*255)<<16)|(int(g*255)<<8)|int(b*255);
 }
 
 static string readString(){
-	string t;
-	for(;;){
-		char c;
-		read( &c,1 );
-		if( !c ) return t;
-		t+=c;
+	int sz=chunkSize();
+	const char *end=(const char*)memchr( in_pos,0,sz );
+	if( !end ){
+		string t( in_pos,sz );
+		in_pos+=sz;
+		return t;
 	}
+	string t( in_pos,end-in_pos );
+	in_pos=end+1;
+	return t;
 }
 
 static void readTextures(){
@@ -116,8 +137,10 @@ static void readTextures(){
 static void readBrushes(){
 	int n_texs=readInt();
 
-	if (n_texs < 0 || n_texs > 8) {
-		n_texs = min(n_texs, 8);
+	if (n_texs < 0) {
+		n_texs = 0;
+	}else if (n_texs > 8) {
+		n_texs = 8;
 	}
 
 	int tex_id[8]={-1,-1,-1,-1,-1,-1,-1,-1};
@@ -140,7 +163,7 @@ static void readBrushes(){
 		bru.setFX( fx );
 
 		for( int k=0;k<8;++k ){
-			if( tex_id[k]<0 ) continue;
+			if( tex_id[k]<0 || tex_id[k]>=textures.size() ) continue;
 			bru.setTexture( k,textures[tex_id[k]],0 );
 		}
 
@@ -160,39 +183,58 @@ static int readVertices(){
 
 	if (tc_sets > 2) {
 		tc_sets = 2;
+	}else if( tc_sets<0 ){
+		tc_sets=0;
 	}
 
-	float tc[4]={0};
+	int stride=12;
+	if( flags&1 ) stride+=12;
+	if( flags&2 ) stride+=16;
+	stride+=tc_sets*tc_size*4;
 
-	Surface::Vertex t;
-	while( chunkSize() ){
-		readFloatArray( t.coords,3 );
+	//decode the whole chunk in one go
+	int n=chunkSize()/stride;
+	if( !n ) return flags;
+
+	vector<Surface::Vertex> verts( n );
+	const char *p=in_pos;
+	int tc_bytes=min( tc_size,2 )*4;
+
+	for( int k=0;k<n;++k ){
+		Surface::Vertex &t=verts[k];
+		memcpy( &t.coords,p,12 );p+=12;
 		if( flags&1 ){
-			readFloatArray( t.normal,3 );
+			memcpy( &t.normal,p,12 );p+=12;
 		}
 		if( flags&2 ){
-			readColor( &t.color );
+			float col[4];
+			memcpy( col,p,16 );p+=16;
+			t.color=decodeColor( col );
 		}
-		for (int k = 0; k < tc_sets; ++k) {
-			readFloatArray(tc, min(tc_size, 4));
-			if (k < 2) {
-				memcpy(t.tex_coords[k], tc, min(tc_size * sizeof(float), 8u));
-			}
+		for( int j=0;j<tc_sets;++j ){
+			memcpy( t.tex_coords[j],p,tc_bytes );
+			p+=tc_size*4;
 		}
-		MeshLoader::addVertex( t );
 	}
+	in_pos=p;
+
+	MeshLoader::addVertices( &verts[0],n );
 
 	return flags;
 }
 
 static void readTriangles(){
 	int brush_id=readInt();
-	Brush b=brush_id>=0 ? brushes[brush_id] : Brush();
-	while( chunkSize() ){
-		int verts[3];
-		readIntArray( verts,3 );
-		MeshLoader::addTriangle( verts,b );
-	}
+	Brush b=brush_id>=0 && brush_id<brushes.size() ? brushes[brush_id] : Brush();
+
+	int n=chunkSize()/12;
+	if( !n ) return;
+
+	vector<int> verts( n*3 );
+	memcpy( &verts[0],in_pos,n*12 );
+	in_pos+=n*12;
+
+	MeshLoader::addTriangles( &verts[0],n,b );
 }
 
 static int readMesh(){
@@ -229,34 +271,51 @@ static Object *readBone(){
 
 	bones.push_back( bone );
 
-	while( chunkSize() ){
-		int vert=readInt();
-		float weight=readFloat();
+	int n=chunkSize()/8;
+	const char *p=in_pos;
+	for( int k=0;k<n;++k ){
+		int vert;
+		float weight;
+		memcpy( &vert,p,4 );
+		memcpy( &weight,p+4,4 );
+		p+=8;
 		MeshLoader::addBone( vert,weight,bones.size() );
 	}
+	in_pos=p;
+
 	return bone;
 }
 
 static void readKeys( Animation &anim ){
 	int flags=readInt();
-	while( chunkSize() ){
-		int frame=readInt();
+
+	int stride=4;
+	if( flags&1 ) stride+=12;
+	if( flags&2 ) stride+=12;
+	if( flags&4 ) stride+=16;
+
+	int n=chunkSize()/stride;
+	const char *p=in_pos;
+	for( int k=0;k<n;++k ){
+		int frame;
+		memcpy( &frame,p,4 );p+=4;
 		if( flags&1 ){
 			float pos[3];
-			readFloatArray( pos,3 );
+			memcpy( pos,p,12 );p+=12;
 			anim.setPositionKey( frame,Vector(pos[0],pos[1],pos[2]) );
 		}
 		if( flags&2 ){
 			float scl[3];
-			readFloatArray( scl,3 );
+			memcpy( scl,p,12 );p+=12;
 			anim.setScaleKey( frame,Vector(scl[0],scl[1],scl[2]) );
 		}
 		if( flags&4 ){
 			float rot[4];
-			readFloatArray( rot,4 );
+			memcpy( rot,p,16 );p+=16;
 			anim.setRotationKey( frame,Quat(rot[0],Vector(rot[1],rot[2],rot[3])) );
 		}
 	}
+	in_pos=p;
 }
 
 static Object *readObject( Object *parent ){
@@ -334,20 +393,22 @@ MeshModel *Loader_B3D::load( const string &f,const Transform &conv,int hint ){
 	collapse=!!(hint&MeshLoader::HINT_COLLAPSE);
 	animonly=!!(hint&MeshLoader::HINT_ANIMONLY);
 
-	in=fopen( f.c_str(),"rb" );
-	if( !in ) return 0;
+	if( !in.open( f ) ) return 0;
+	in_pos=in.data();
 
 	::clear();
 
 	int tag=readChunk();
 	if( tag!='BB3D' ){
-		fclose( in );
+		in.close();
+		::clear();
 		return 0;
 	}
 
 	int version=readInt();
 	if( version>1 ){
-		fclose( in );
+		in.close();
+		::clear();
 		return 0;
 	}
 
@@ -366,7 +427,7 @@ MeshModel *Loader_B3D::load( const string &f,const Transform &conv,int hint ){
 		}
 		exitChunk();
 	}
-	fclose( in );
+	in.close();
 
 	::clear();
 
@@ -7,6 +7,8 @@
 #define TINYGLTF_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
+// glTF textures aren't used (see parseMaterial), so don't read external image files
+#define TINYGLTF_NO_EXTERNAL_IMAGE
 
 #include "tinygltf/tiny_gltf.h"
 
@@ -18,6 +20,205 @@ static bool conv, flip_tris;
 static Transform conv_tform;
 static bool collapse, animonly;
 
+// where each buffer's bytes are - for .glb files this is the BIN chunk of the mapped file
+struct BufferData {
+    const unsigned char* data;
+    size_t size;
+};
+static vector<BufferData> buffers;
+
+// strided view of an accessor's elements
+struct AccessorView {
+    const unsigned char* data;
+    int count, stride, type;
+    bool normalized;
+
+    float get(int i, int c) const {
+        const unsigned char* p = data + i * stride;
+        switch (type) {
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:
+            return ((const float*)p)[c];
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return normalized ? p[c] / 255.0f : p[c];
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+            return normalized ? max(((const signed char*)p)[c] / 127.0f, -1.0f) : ((const signed char*)p)[c];
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+            return normalized ? ((const unsigned short*)p)[c] / 65535.0f : ((const unsigned short*)p)[c];
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+            return normalized ? max(((const short*)p)[c] / 32767.0f, -1.0f) : ((const short*)p)[c];
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+            return (float)((const unsigned*)p)[c];
+        }
+        return 0;
+    }
+
+    unsigned index(int i) const {
+        const unsigned char* p = data + i * stride;
+        switch (type) {
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: return *p;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: return *(const unsigned short*)p;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: return *(const unsigned*)p;
+        }
+        return ~0u;
+    }
+};
+
+static bool getAccessor(const tinygltf::Model& model, int index, AccessorView* v) {
+    if (index < 0 || index >= (int)model.accessors.size()) return false;
+    const auto& accessor = model.accessors[index];
+    if (accessor.bufferView < 0 || accessor.bufferView >= (int)model.bufferViews.size()) return false;
+    const auto& bufferView = model.bufferViews[accessor.bufferView];
+    if (bufferView.buffer < 0 || bufferView.buffer >= (int)buffers.size()) return false;
+    const BufferData& buffer = buffers[bufferView.buffer];
+
+    int comps = tinygltf::GetNumComponentsInType(accessor.type);
+    int size = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+    int stride = accessor.ByteStride(bufferView);
+    if (comps <= 0 || size <= 0 || stride <= 0) return false;
+
+    // make sure the last element is inside the buffer view and the buffer
+    size_t offset = bufferView.byteOffset + accessor.byteOffset;
+    size_t end = offset + (accessor.count ? (accessor.count - 1) * stride + comps * size : 0);
+    if (end > bufferView.byteOffset + bufferView.byteLength || end > buffer.size) return false;
+
+    v->data = buffer.data + offset;
+    v->count = (int)accessor.count;
+    v->stride = stride;
+    v->type = accessor.componentType;
+    v->normalized = accessor.normalized;
+    return true;
+}
+
+// the loader doesn't use glTF textures, so don't decode them
+static bool skipImage(tinygltf::Image*, const int, string*, string*, int, int, const unsigned char*, int, void*) {
+    return true;
+}
+
+// a primitive's vertices and triangles, converted before the nodes are built
+struct Primitive {
+    const tinygltf::Primitive* prim;
+    vector<Surface::Vertex> verts;
+    vector<int> tris;
+    bool normals;
+};
+
+static const tinygltf::Model* conv_model;
+static vector<Primitive> primitives;
+static vector<int> mesh_prims;  // first primitive of each mesh, plus one past the end
+
+// only reads the model and conversion settings, so primitives can be converted in parallel
+static void convertPrimitive(int index, void*) {
+    Primitive& p = primitives[index];
+    const tinygltf::Model& model = *conv_model;
+    const tinygltf::Primitive& primitive = *p.prim;
+
+    auto posIt = primitive.attributes.find("POSITION");
+    auto normalIt = primitive.attributes.find("NORMAL");
+    auto texcoordIt = primitive.attributes.find("TEXCOORD_0");
+    auto colorIt = primitive.attributes.find("COLOR_0");
+
+    p.normals = normalIt != primitive.attributes.end();
+
+    AccessorView view;
+    if (posIt == primitive.attributes.end() || !getAccessor(model, posIt->second, &view)) return;
+
+    // vertices
+    int n_verts = view.count;
+    p.verts.resize(n_verts);
+    for (int k = 0; k < n_verts; ++k) {
+        Surface::Vertex& v = p.verts[k];
+        v.coords = Vector(view.get(k, 0), view.get(k, 1), view.get(k, 2));
+        if (conv) v.coords = conv_tform * v.coords;
+    }
+
+    // normals
+    if (p.normals && getAccessor(model, normalIt->second, &view)) {
+        Matrix co = conv_tform.m.cofactor();
+        int n = min(view.count, n_verts);
+        for (int k = 0; k < n; ++k) {
+            p.verts[k].normal = (co * Vector(view.get(k, 0), view.get(k, 1), view.get(k, 2))).normalized();
+        }
+    }
+
+    // texture coords
+    if (texcoordIt != primitive.attributes.end() && getAccessor(model, texcoordIt->second, &view)) {
+        bool uv = model.accessors[texcoordIt->second].type == TINYGLTF_TYPE_VEC2;
+        int n = min(view.count, n_verts);
+        for (int k = 0; k < n; ++k) {
+            Surface::Vertex& v = p.verts[k];
+            float tu = view.get(k, 0);
+            float tv = uv ? view.get(k, 1) : 0.0f;
+            v.tex_coords[0][0] = v.tex_coords[1][0] = tu;
+            v.tex_coords[0][1] = v.tex_coords[1][1] = tv;
+        }
+    }
+
+    // vertex colors
+    if (colorIt != primitive.attributes.end() && getAccessor(model, colorIt->second, &view)) {
+        int n = min(view.count, n_verts);
+        for (int k = 0; k < n; ++k) {
+            p.verts[k].color = 0xff000000 |
+                ((int)(view.get(k, 0) * 255) << 16) |
+                ((int)(view.get(k, 1) * 255) << 8) |
+                (int)(view.get(k, 2) * 255);
+        }
+    }
+
+    // indices - unindexed primitives use the vertices in order
+    int n_indices = n_verts;
+    bool indexed = primitive.indices >= 0;
+    if (indexed) {
+        if (!getAccessor(model, primitive.indices, &view)) return;
+        n_indices = view.count;
+    }
+
+    // make triangles
+    p.tris.reserve(n_indices / 3 * 3);
+    for (int k = 0; k + 2 < n_indices; k += 3) {
+        unsigned tri[3];
+        for (int j = 0; j < 3; ++j) tri[j] = indexed ? view.index(k + j) : k + j;
+        if (tri[0] >= (unsigned)n_verts || tri[1] >= (unsigned)n_verts || tri[2] >= (unsigned)n_verts) continue;
+        p.tris.push_back(tri[0]);
+        p.tris.push_back(flip_tris ? tri[2] : tri[1]);
+        p.tris.push_back(flip_tris ? tri[1] : tri[2]);
+    }
+}
+
+static void convertPrimitives(const tinygltf::Model& model) {
+    mesh_prims.resize(model.meshes.size() + 1);
+    for (size_t k = 0; k < model.meshes.size(); ++k) {
+        mesh_prims[k] = (int)primitives.size();
+        if (animonly) continue;
+        for (const auto& primitive : model.meshes[k].primitives) {
+            if (primitive.mode != TINYGLTF_MODE_TRIANGLES) continue;
+            primitives.push_back(Primitive());
+            primitives.back().prim = &primitive;
+        }
+    }
+    mesh_prims.back() = (int)primitives.size();
+
+    conv_model = &model;
+    parallelfor((int)primitives.size(), convertPrimitive, 0);
+}
+
+// locate the BIN chunk of a .glb
+static bool findBinChunk(const mmapfile& in, const unsigned char** data, size_t* size) {
+    const unsigned char* p = (const unsigned char*)in.data();
+    size_t n = in.size();
+    if (n < 20) return false;
+    unsigned json_len;
+    memcpy(&json_len, p + 12, 4);
+    size_t bin = 20 + (size_t)json_len;
+    if (bin + 8 > n) return false;
+    unsigned bin_len, bin_type;
+    memcpy(&bin_len, p + bin, 4);
+    memcpy(&bin_type, p + bin + 4, 4);
+    if (bin_type != 0x004e4942 || bin + 8 + bin_len > n) return false;
+    *data = p + bin + 8;
+    *size = bin_len;
+    return true;
+}
+
 struct NodeAnimData {
     map<int, Quat> rotationKeys;
     map<int, Vector> scaleKeys;
@@ -30,40 +231,28 @@ static void parseAnimations(const tinygltf::Model& model, map<int, NodeAnimData>
             int nodeIndex = channel.target_node;
             if (nodeIndex < 0 || nodeIndex >= model.nodes.size()) continue;
 
+            if (channel.sampler < 0 || channel.sampler >= (int)anim.samplers.size()) continue;
             const auto& sampler = anim.samplers[channel.sampler];
 
-            if (nodeAnims.find(nodeIndex) == nodeAnims.end()) {
-                nodeAnims[nodeIndex] = NodeAnimData();
-            }
-            NodeAnimData& animData = nodeAnims[nodeIndex];
-
-            const auto& inputAccessor = model.accessors[sampler.input];
+            AccessorView times, values;
+            if (!getAccessor(model, sampler.input, &times) || !getAccessor(model, sampler.output, &values)) continue;
             const auto& outputAccessor = model.accessors[sampler.output];
 
-            const auto& inputBufferView = model.bufferViews[inputAccessor.bufferView];
-            const auto& outputBufferView = model.bufferViews[outputAccessor.bufferView];
-
-            const auto& inputBuffer = model.buffers[inputBufferView.buffer];
-            const auto& outputBuffer = model.buffers[outputBufferView.buffer];
-
-            const float* times = reinterpret_cast<const float*>(
-                &inputBuffer.data[inputBufferView.byteOffset + inputAccessor.byteOffset]);
-            const float* values = reinterpret_cast<const float*>(
-                &outputBuffer.data[outputBufferView.byteOffset + outputAccessor.byteOffset]);
+            NodeAnimData& animData = nodeAnims[nodeIndex];
 
-            int numKeys = (int)inputAccessor.count;
+            int numKeys = min(times.count, values.count);
 
             for (int k = 0; k < numKeys; ++k) {
-                int time = static_cast<int>(times[k] * 1000);
+                int time = static_cast<int>(times.get(k, 0) * 1000);
                 if (time > anim_len) anim_len = time;
 
                 string target_path = channel.target_path;
                 if (target_path == "rotation") {
                     if (outputAccessor.type == TINYGLTF_TYPE_VEC4) {
-                        float x = values[k * 4];
-                        float y = values[k * 4 + 1];
-                        float z = values[k * 4 + 2];
-                        float w = values[k * 4 + 3];
+                        float x = values.get(k, 0);
+                        float y = values.get(k, 1);
+                        float z = values.get(k, 2);
+                        float w = values.get(k, 3);
 
                         Quat rot(w, Vector(x, y, z));
                         if (conv) {
@@ -83,7 +272,7 @@ static void parseAnimations(const tinygltf::Model& model, map<int, NodeAnimData>
                 }
                 else if (target_path == "scale") {
                     if (outputAccessor.type == TINYGLTF_TYPE_VEC3) {
-                        Vector scl(values[k * 3], values[k * 3 + 1], values[k * 3 + 2]);
+                        Vector scl(values.get(k, 0), values.get(k, 1), values.get(k, 2));
                         if (conv) scl = conv_tform.m * scl;
                         scl.x = fabs(scl.x); scl.y = fabs(scl.y); scl.z = fabs(scl.z);
                         animData.scaleKeys[time] = scl;
@@ -91,7 +280,7 @@ static void parseAnimations(const tinygltf::Model& model, map<int, NodeAnimData>
                 }
                 else if (target_path == "translation") {
                     if (outputAccessor.type == TINYGLTF_TYPE_VEC3) {
-                        Vector pos(values[k * 3], values[k * 3 + 1], values[k * 3 + 2]);
+                        Vector pos(values.get(k, 0), values.get(k, 1), values.get(k, 2));
                         if (conv) pos = conv_tform * pos;
                         animData.positionKeys[time] = pos;
                     }
@@ -203,145 +392,21 @@ static MeshModel* parseNode(int nodeIndex, const tinygltf::Model& model,
     }
 
     if (node.mesh >= 0 && node.mesh < model.meshes.size() && !animonly) {
-        const auto& mesh = model.meshes[node.mesh];
-
-        for (const auto& primitive : mesh.primitives) {
-            if (primitive.mode != TINYGLTF_MODE_TRIANGLES) continue;
+        for (int k = mesh_prims[node.mesh]; k < mesh_prims[node.mesh + 1]; ++k) {
+            const Primitive& p = primitives[k];
 
-            vector<Brush> materials;
-            if (primitive.material >= 0 && primitive.material < model.materials.size()) {
-                materials.push_back(parseMaterial(model.materials[primitive.material]));
-            }
-            else {
-                materials.push_back(Brush());
+            Brush brush;
+            if (p.prim->material >= 0 && p.prim->material < model.materials.size()) {
+                brush = parseMaterial(model.materials[p.prim->material]);
             }
 
             MeshLoader::beginMesh();
-
-            auto posIt = primitive.attributes.find("POSITION");
-            auto normalIt = primitive.attributes.find("NORMAL");
-            auto texcoordIt = primitive.attributes.find("TEXCOORD_0");
-            auto colorIt = primitive.attributes.find("COLOR_0");
-
-            // vertices
-            if (posIt != primitive.attributes.end()) {
-                const auto& accessor = model.accessors[posIt->second];
-                const auto& bufferView = model.bufferViews[accessor.bufferView];
-                const auto& buffer = model.buffers[bufferView.buffer];
-
-                const float* positions = reinterpret_cast<const float*>(
-                    &buffer.data[bufferView.byteOffset + accessor.byteOffset]);
-
-                for (size_t k = 0; k < accessor.count; ++k) {
-                    Surface::Vertex v;
-                    v.coords = Vector(positions[k * 3], positions[k * 3 + 1], positions[k * 3 + 2]);
-                    if (conv) v.coords = conv_tform * v.coords;
-                    v.color = 0xffffffff;
-                    MeshLoader::addVertex(v);
-                }
-
-                // normals
-                if (normalIt != primitive.attributes.end()) {
-                    const auto& normalAccessor = model.accessors[normalIt->second];
-                    const auto& normalBufferView = model.bufferViews[normalAccessor.bufferView];
-                    const auto& normalBuffer = model.buffers[normalBufferView.buffer];
-
-                    const float* normals = reinterpret_cast<const float*>(
-                        &normalBuffer.data[normalBufferView.byteOffset + normalAccessor.byteOffset]);
-
-                    Matrix co = conv_tform.m.cofactor();
-                    for (size_t k = 0; k < normalAccessor.count; ++k) {
-                        Surface::Vertex& v = MeshLoader::refVertex((int)k);
-                        v.normal = (co * Vector(normals[k * 3], normals[k * 3 + 1], normals[k * 3 + 2])).normalized();
-                    }
-                }
-
-                // texture coords
-                if (texcoordIt != primitive.attributes.end()) {
-                    const auto& texAccessor = model.accessors[texcoordIt->second];
-                    const auto& texBufferView = model.bufferViews[texAccessor.bufferView];
-                    const auto& texBuffer = model.buffers[texBufferView.buffer];
-
-                    const float* texcoords = reinterpret_cast<const float*>(
-                        &texBuffer.data[texBufferView.byteOffset + texAccessor.byteOffset]);
-
-                    int components = texAccessor.type == TINYGLTF_TYPE_VEC2 ? 2 : 1;
-                    for (size_t k = 0; k < texAccessor.count; ++k) {
-                        Surface::Vertex& v = MeshLoader::refVertex((int)k);
-                        float tu = texcoords[k * components];
-                        float tv = components > 1 ? texcoords[k * components + 1] : 0.0f;
-                        v.tex_coords[0][0] = v.tex_coords[1][0] = tu;
-                        v.tex_coords[0][1] = v.tex_coords[1][1] = tv;
-                    }
-                }
-
-                // vertex colors
-                if (colorIt != primitive.attributes.end()) {
-                    const auto& colorAccessor = model.accessors[colorIt->second];
-                    const auto& colorBufferView = model.bufferViews[colorAccessor.bufferView];
-                    const auto& colorBuffer = model.buffers[colorBufferView.buffer];
-
-                    if (colorAccessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT) {
-                        const float* colors = reinterpret_cast<const float*>(
-                            &colorBuffer.data[colorBufferView.byteOffset + colorAccessor.byteOffset]);
-
-                        int components = colorAccessor.type == TINYGLTF_TYPE_VEC3 ? 3 : 4;
-                        for (size_t k = 0; k < colorAccessor.count; ++k) {
-                            Surface::Vertex& v = MeshLoader::refVertex((int)k);
-                            if (components >= 3) {
-                                v.color = 0xff000000 |
-                                    ((int)(colors[k * components] * 255) << 16) |
-                                    ((int)(colors[k * components + 1] * 255) << 8) |
-                                    (int)(colors[k * components + 2] * 255);
-                            }
-                        }
-                    }
-                }
-
-                // indices
-                const auto& indexAccessor = model.accessors[primitive.indices];
-                const auto& indexBufferView = model.bufferViews[indexAccessor.bufferView];
-                const auto& indexBuffer = model.buffers[indexBufferView.buffer];
-
-                vector<unsigned int> indices;
-                if (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
-                    const unsigned short* idx = reinterpret_cast<const unsigned short*>(
-                        &indexBuffer.data[indexBufferView.byteOffset + indexAccessor.byteOffset]);
-                    indices.assign(idx, idx + indexAccessor.count);
-                }
-                else if (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT) {
-                    const unsigned int* idx = reinterpret_cast<const unsigned int*>(
-                        &indexBuffer.data[indexBufferView.byteOffset + indexAccessor.byteOffset]);
-                    indices.assign(idx, idx + indexAccessor.count);
-                }
-                else if (indexAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
-                    const unsigned char* idx = reinterpret_cast<const unsigned char*>(
-                        &indexBuffer.data[indexBufferView.byteOffset + indexAccessor.byteOffset]);
-                    indices.reserve(indexAccessor.count);
-                    for (size_t k = 0; k < indexAccessor.count; ++k) {
-                        indices.push_back(idx[k]);
-                    }
-                }
-
-                // make triangles
-                for (size_t k = 0; k < indices.size(); k += 3) {
-                    int tri[3];
-                    if (flip_tris) {
-                        tri[0] = (int)indices[k];
-                        tri[1] = (int)indices[k + 2];
-                        tri[2] = (int)indices[k + 1];
-                    }
-                    else {
-                        tri[0] = (int)indices[k];
-                        tri[1] = (int)indices[k + 1];
-                        tri[2] = (int)indices[k + 2];
-                    }
-                    MeshLoader::addTriangle(tri, materials[0]);
-                }
+            if (p.verts.size()) {
+                MeshLoader::addVertices(&p.verts[0], (int)p.verts.size());
+                if (p.tris.size()) MeshLoader::addTriangles(&p.tris[0], (int)p.tris.size() / 3, brush);
             }
-
             MeshLoader::endMesh(meshNode);
-            if (normalIt == primitive.attributes.end()) {
+            if (!p.normals) {
                 meshNode->updateNormals();
             }
         }
@@ -372,12 +437,20 @@ static MeshModel* parseGLTF(const string& filename) {
     string ext = dotPos != string::npos ? filename.substr(dotPos + 1) : "";
 
     loader.SetStoreOriginalJSONForExtrasAndExtensions(false);
+    loader.SetImageLoader(skipImage, 0);
 
+    mmapfile in;
     if (ext == "gltf") {
         success = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
     }
     else if (ext == "glb") {
-        success = loader.LoadBinaryFromFile(&model, &err, &warn, filename);
+        if (in.open(filename)) {
+            success = loader.LoadBinaryFromMemory(&model, &err, &warn,
+                (const unsigned char*)in.data(), in.size(), tinygltf::GetBaseDir(filename));
+        }
+        else {
+            err = "Unable to open file";
+        }
     }
     else {
         gx_runtime->debugLog("GLTF Load Error: Unsupported file extension");
@@ -399,6 +472,27 @@ static MeshModel* parseGLTF(const string& filename) {
         return 0;
     }
 
+    // tinygltf keeps its own copy of a .glb's BIN chunk - read accessors from the mapped file instead and free it
+    const unsigned char* bin = 0;
+    size_t bin_size = 0;
+    if (in.data()) findBinChunk(in, &bin, &bin_size);
+
+    buffers.resize(model.buffers.size());
+    for (size_t k = 0; k < model.buffers.size(); ++k) {
+        tinygltf::Buffer& buffer = model.buffers[k];
+        if (bin && buffer.uri.empty()) {
+            buffers[k].data = bin;
+            buffers[k].size = min(bin_size, buffer.data.size());
+            vector<unsigned char>().swap(buffer.data);
+        }
+        else {
+            buffers[k].data = buffer.data.empty() ? 0 : &buffer.data[0];
+            buffers[k].size = buffer.data.size();
+        }
+    }
+
+    convertPrimitives(model);
+
     anim_len = 0;
 
     map<int, NodeAnimData> nodeAnims;
@@ -429,6 +523,9 @@ static MeshModel* parseGLTF(const string& filename) {
     }
 
     nodes_map.clear();
+    primitives.clear();
+    mesh_prims.clear();
+    buffers.clear();
     return root;
 }
 
@@ -0,0 +1,581 @@
+
+#include "std.h"
+#include "meshcache.h"
+#include "pivot.h"
+
+static const int COOKED_MAGIC='BBMC';
+static const int COOKED_VERSION=1;
+
+enum{
+	OBJ_PIVOT=0,
+	OBJ_MESH=1
+};
+
+struct SourceKey{
+	int size;
+	unsigned hash_lo,hash_hi;
+};
+
+//64 bit FNV-1a over the whole source file
+static bool sourceKey( const string &f,SourceKey *key ){
+	mmapfile src;
+	if( !src.open( f ) ) return false;
+	unsigned long long h=14695981039346656037ull;
+	const unsigned char *p=(const unsigned char*)src.data();
+	for( int k=0;k<src.size();++k ){
+		h^=p[k];
+		h*=1099511628211ull;
+	}
+	key->size=src.size();
+	key->hash_lo=(unsigned)h;
+	key->hash_hi=(unsigned)(h>>32);
+	return true;
+}
+
+/////////////
+// Writing //
+/////////////
+struct CookedWriter{
+	vector<char> buf;
+
+	map<const CachedTexture*,int> tex_map;
+	map<Brush,int> brush_map;
+	vector<Texture> texs;
+	vector<Brush> brushes;
+
+	map<Object*,int> obj_map;
+	vector<Object*> objs;
+
+	void write( const void *p,int n ){
+		buf.insert( buf.end(),(const char*)p,(const char*)p+n );
+	}
+	void writeInt( int n ){
+		write( &n,4 );
+	}
+	void writeFloat( float n ){
+		write( &n,4 );
+	}
+	void writeArray( const void *p,int n ){
+		//keep everything 4 byte aligned so arrays can be used in place
+		write( p,n );
+		static const char pad[4]={0};
+		if( n&3 ) write( pad,4-(n&3) );
+	}
+	void writeString( const string &t ){
+		writeInt( t.size() );
+		writeArray( t.data(),t.size() );
+	}
+	void writeVector( const Vector &v ){
+		writeFloat( v.x );writeFloat( v.y );writeFloat( v.z );
+	}
+	void writeQuat( const Quat &q ){
+		writeFloat( q.w );writeVector( q.v );
+	}
+	void writeTransform( const Transform &t ){
+		writeVector( t.m.i );writeVector( t.m.j );writeVector( t.m.k );writeVector( t.v );
+	}
+	void writeBox( const Box &b ){
+		writeVector( b.a );writeVector( b.b );
+	}
+	void writeKeys( const vector<Animation::Key> &keys ){
+		writeInt( keys.size() );
+		for( int k=0;k<keys.size();++k ){
+			writeInt( keys[k].frame );
+			writeQuat( keys[k].value );
+		}
+	}
+	void writeAnimation( const Animation &anim ){
+		vector<Animation::Key> keys;
+		anim.getScaleKeys( keys );writeKeys( keys );
+		anim.getPositionKeys( keys );writeKeys( keys );
+		anim.getRotationKeys( keys );writeKeys( keys );
+	}
+
+	void addBrush( const Brush &b ){
+		if( brush_map.count( b ) ) return;
+		for( int k=0;k<gxScene::MAX_TEXTURES;++k ){
+			Texture t=b.getTexture( k );
+			if( !t.getCachedTexture() || tex_map.count( t.getCachedTexture() ) ) continue;
+			tex_map[t.getCachedTexture()]=texs.size();
+			texs.push_back( t );
+		}
+		brush_map[b]=brushes.size();
+		brushes.push_back( b );
+	}
+
+	void writeTextures(){
+		writeInt( texs.size() );
+		for( int k=0;k<texs.size();++k ){
+			const Texture &t=texs[k];
+			float pos[2]={0,0},scl[2]={1,1},rot=0;
+			bool coords=t.getCoords( pos,scl,&rot );
+			writeString( t.getCachedTexture()->getName() );
+			writeInt( t.getCachedTexture()->getFlags() );
+			writeInt( t.getBlend() );
+			writeInt( t.getFlags() );
+			writeInt( coords );
+			writeFloat( pos[0] );writeFloat( pos[1] );
+			writeFloat( scl[0] );writeFloat( scl[1] );
+			writeFloat( rot );
+		}
+	}
+
+	void writeBrushes(){
+		writeInt( brushes.size() );
+		for( int k=0;k<brushes.size();++k ){
+			const Brush &b=brushes[k];
+			writeVector( b.getColor() );
+			writeFloat( b.getAlpha() );
+			writeFloat( b.getShininess() );
+			writeInt( b.getBlendSetting() );
+			writeInt( b.getFX() );
+			const gxScene::RenderState &rs=b.getRenderState();
+			for( int j=0;j<gxScene::MAX_TEXTURES;++j ){
+				Texture t=b.getTexture( j );
+				if( !t.getCachedTexture() ){
+					writeInt( -1 );writeInt( 0 );
+					continue;
+				}
+				int frame=0;
+				while( t.getCanvas( frame ) && t.getCanvas( frame )!=rs.tex_states[j].canvas ) ++frame;
+				if( !t.getCanvas( frame ) ) frame=0;
+				writeInt( tex_map[t.getCachedTexture()] );
+				writeInt( frame );
+			}
+		}
+	}
+
+	bool addObjects( Entity *e ){
+		Object *obj=e->getObject();
+		if( !obj || e->getCamera() || e->getLight() || e->getMirror() || e->getListener() ) return false;
+		if( Model *model=e->getModel() ){
+			MeshModel *mesh=model->getMeshModel();
+			if( !mesh ) return false;
+			addBrush( mesh->getBrush() );
+			const MeshModel::SurfaceList &surfs=mesh->getSurfaces();
+			for( int k=0;k<surfs.size();++k ) addBrush( surfs[k]->getBrush() );
+		}
+		obj_map[obj]=objs.size();
+		objs.push_back( obj );
+		for( Entity *p=e->children();p;p=p->successor() ){
+			if( !addObjects( p ) ) return false;
+		}
+		return true;
+	}
+
+	void writeMesh( MeshModel *mesh ){
+		writeInt( brush_map[mesh->getBrush()] );
+
+		const MeshModel::SurfaceList &surfs=mesh->getSurfaces();
+		writeInt( surfs.size() );
+		for( int k=0;k<surfs.size();++k ){
+			Surface *s=surfs[k];
+			writeInt( brush_map[s->getBrush()] );
+			writeString( s->getName() );
+			writeInt( s->numVertices() );
+			if( s->numVertices() ) writeArray( &s->getVertex(0),s->numVertices()*sizeof(Surface::Vertex) );
+			writeInt( s->numTriangles() );
+			if( s->numTriangles() ) writeArray( &s->getTriangle(0),s->numTriangles()*sizeof(Surface::Triangle) );
+		}
+
+		const vector<Transform> &bone_tforms=mesh->getBoneTforms();
+		writeInt( bone_tforms.size() );
+		for( int k=0;k<bone_tforms.size();++k ) writeTransform( bone_tforms[k] );
+
+		vector<MeshCollider::FlatNode> nodes;
+		vector<int> node_tris;
+		mesh->getCollider()->flatten( nodes,node_tris );
+		writeInt( nodes.size() );
+		for( int k=0;k<nodes.size();++k ){
+			const MeshCollider::FlatNode &n=nodes[k];
+			writeBox( n.box );
+			writeInt( n.left );writeInt( n.right );
+			writeInt( n.first_tri );writeInt( n.n_tris );
+		}
+		writeInt( node_tris.size() );
+		if( node_tris.size() ) writeArray( &node_tris[0],node_tris.size()*4 );
+	}
+
+	void writeObject( Object *obj ){
+		MeshModel *mesh=obj->getModel() ? obj->getModel()->getMeshModel() : 0;
+		Entity *parent=obj->getParent();
+
+		writeInt( mesh ? OBJ_MESH : OBJ_PIVOT );
+		writeInt( parent && obj!=objs[0] ? obj_map[parent->getObject()] : -1 );
+		writeString( obj->getName() );
+		writeVector( obj->getLocalPosition() );
+		writeVector( obj->getLocalScale() );
+		writeQuat( obj->getLocalRotation() );
+		writeAnimation( obj->getAnimation() );
+
+		if( mesh ) writeMesh( mesh );
+	}
+
+	bool writeAnimator( int owner,Animator *anim ){
+		const vector<Object*> &anim_objs=anim->getObjects();
+		vector<int> ids( anim_objs.size() );
+		for( int k=0;k<anim_objs.size();++k ){
+			map<Object*,int>::const_iterator it=obj_map.find( anim_objs[k] );
+			if( it==obj_map.end() ) return false;
+			ids[k]=it->second;
+		}
+		writeInt( owner );
+		writeInt( ids.size() );
+		if( ids.size() ) writeArray( &ids[0],ids.size()*4 );
+		writeInt( anim->numSeqs() );
+		for( int n=0;n<anim->numSeqs();++n ){
+			writeInt( anim->seqFrames( n ) );
+			for( int k=0;k<anim_objs.size();++k ){
+				writeAnimation( anim->getKeys( k,n ) );
+			}
+		}
+		return true;
+	}
+};
+
+/////////////
+// Reading //
+/////////////
+struct CookedReader{
+	const char *p,*end;
+	bool ok;
+
+	vector<Texture> texs;
+	vector<Brush> brushes;
+	vector<Object*> objs;
+
+	CookedReader( const char *data,int size ):p(data),end(data+size),ok(true){
+	}
+
+	const char *read( int n ){
+		if( !ok || n<0 || n>end-p ){
+			ok=false;
+			static char zero[64];
+			return zero;
+		}
+		const char *t=p;
+		p+=n;
+		return t;
+	}
+	const char *readArray( int n ){
+		return read( (n+3)&~3 );
+	}
+	int readInt(){
+		int n;
+		memcpy( &n,read( 4 ),4 );
+		return n;
+	}
+	float readFloat(){
+		float n;
+		memcpy( &n,read( 4 ),4 );
+		return n;
+	}
+	int readCount( int elem_size ){
+		int n=readInt();
+		if( n<0 || n>(end-p)/elem_size ){ ok=false;return 0; }
+		return n;
+	}
+	string readString(){
+		int n=readCount( 1 );
+		const char *t=readArray( n );
+		return ok ? string( t,n ) : string();
+	}
+	Vector readVector(){
+		float t[3];
+		memcpy( t,read( 12 ),12 );
+		return Vector( t[0],t[1],t[2] );
+	}
+	Quat readQuat(){
+		float w=readFloat();
+		return Quat( w,readVector() );
+	}
+	Transform readTransform(){
+		Transform t;
+		t.m.i=readVector();t.m.j=readVector();t.m.k=readVector();t.v=readVector();
+		return t;
+	}
+	Box readBox(){
+		Vector a=readVector();
+		return Box( a,readVector() );
+	}
+	Animation readAnimation(){
+		Animation anim;
+		int n=readCount( 20 );
+		for( int k=0;k<n;++k ){
+			int frame=readInt();
+			anim.setScaleKey( frame,readQuat().v );
+		}
+		n=readCount( 20 );
+		for( int k=0;k<n;++k ){
+			int frame=readInt();
+			anim.setPositionKey( frame,readQuat().v );
+		}
+		n=readCount( 20 );
+		for( int k=0;k<n;++k ){
+			int frame=readInt();
+			anim.setRotationKey( frame,readQuat() );
+		}
+		return anim;
+	}
+	const Brush &brush( int n ){
+		if( n<0 || n>=brushes.size() ){
+			ok=false;
+			static Brush null_brush;
+			return null_brush;
+		}
+		return brushes[n];
+	}
+
+	void readTextures(){
+		int n=readCount( 40 );
+		for( int k=0;k<n && ok;++k ){
+			string name=readString();
+			int canvas_flags=readInt();
+			int blend=readInt();
+			int flags=readInt();
+			int coords=readInt();
+			float pos[2],scl[2],rot;
+			pos[0]=readFloat();pos[1]=readFloat();
+			scl[0]=readFloat();scl[1]=readFloat();
+			rot=readFloat();
+			if( !ok ) return;
+
+			Texture tex( name,canvas_flags );
+			tex.setBlend( blend );
+			tex.setFlags( flags );
+			if( coords ){
+				tex.setPosition( pos[0],pos[1] );
+				tex.setScale( scl[0],scl[1] );
+				tex.setRotation( rot );
+			}
+			texs.push_back( tex );
+		}
+	}
+
+	void readBrushes(){
+		int n=readCount( 28+gxScene::MAX_TEXTURES*8 );
+		for( int k=0;k<n && ok;++k ){
+			Brush b;
+			b.setColor( readVector() );
+			b.setAlpha( readFloat() );
+			b.setShininess( readFloat() );
+			b.setBlend( readInt() );
+			b.setFX( readInt() );
+			for( int j=0;j<gxScene::MAX_TEXTURES;++j ){
+				int id=readInt(),frame=readInt();
+				if( id<0 ) continue;
+				if( id>=texs.size() ){ ok=false;return; }
+				b.setTexture( j,texs[id],frame );
+			}
+			brushes.push_back( b );
+		}
+	}
+
+	void readMesh( MeshModel *mesh,vector<Transform> &bone_tforms ){
+		mesh->setBrush( brush( readInt() ) );
+
+		int n_surfs=readCount( 16 );
+		for( int k=0;k<n_surfs && ok;++k ){
+			Surface *s=mesh->createSurface( brush( readInt() ) );
+			s->setName( readString() );
+
+			int n_verts=readCount( sizeof(Surface::Vertex) );
+			const Surface::Vertex *verts=(const Surface::Vertex*)readArray( n_verts*sizeof(Surface::Vertex) );
+			int n_tris=readCount( sizeof(Surface::Triangle) );
+			const Surface::Triangle *tris=(const Surface::Triangle*)readArray( n_tris*sizeof(Surface::Triangle) );
+			if( !ok ) return;
+
+			for( int j=0;j<n_tris;++j ){
+				for( int i=0;i<3;++i ){
+					if( tris[j].verts[i]>=n_verts ){ ok=false;return; }
+				}
+			}
+			s->addVertices( vector<Surface::Vertex>( verts,verts+n_verts ) );
+			s->addTriangles( vector<Surface::Triangle>( tris,tris+n_tris ) );
+		}
+
+		int n_bones=readCount( 48 );
+		bone_tforms.resize( n_bones );
+		for( int k=0;k<n_bones;++k ) bone_tforms[k]=readTransform();
+
+		int n_nodes=readCount( 40 );
+		vector<MeshCollider::FlatNode> nodes( n_nodes );
+		for( int k=0;k<n_nodes;++k ){
+			MeshCollider::FlatNode &n=nodes[k];
+			n.box=readBox();
+			n.left=readInt();n.right=readInt();
+			n.first_tri=readInt();n.n_tris=readInt();
+		}
+		int n_node_tris=readCount( 4 );
+		vector<int> node_tris( n_node_tris );
+		if( n_node_tris ){
+			const char *t=readArray( n_node_tris*4 );
+			if( ok ) memcpy( &node_tris[0],t,n_node_tris*4 );
+		}
+		if( !ok || !n_nodes ){ ok=false;return; }
+
+		//validate tree before trusting it
+		int n_tris=0;
+		for( int k=0;k<mesh->getSurfaces().size();++k ) n_tris+=mesh->getSurfaces()[k]->numTriangles();
+		for( int k=0;k<n_nodes;++k ){
+			const MeshCollider::FlatNode &n=nodes[k];
+			if( n.left>=n_nodes || n.right>=n_nodes || (n.left>=0 && n.left<=k) || (n.right>=0 && n.right<=k) ){ ok=false;return; }
+			if( n.first_tri<0 || n.n_tris<0 || n.first_tri+n.n_tris>n_node_tris ){ ok=false;return; }
+		}
+		for( int k=0;k<n_node_tris;++k ){
+			if( node_tris[k]<0 || node_tris[k]>=n_tris ){ ok=false;return; }
+		}
+		mesh->setCollider( nodes,node_tris );
+	}
+};
+
+string MeshCache::cookedFile( const string &f,int hint ){
+	return f+"."+itoa( hint )+".cooked";
+}
+
+Entity *MeshCache::load( const string &f,const Transform &conv,int hint ){
+
+	SourceKey key;
+	if( !sourceKey( f,&key ) ) return 0;
+
+	mmapfile in;
+	if( !in.open( cookedFile( f,hint ) ) ) return 0;
+
+	CookedReader r( in.data(),in.size() );
+
+	if( r.readInt()!=COOKED_MAGIC ) return 0;
+	if( r.readInt()!=COOKED_VERSION ) return 0;
+	if( r.readInt()!=sizeof(Surface::Vertex) ) return 0;
+	if( r.readInt()!=hint ) return 0;
+	if( r.readInt()!=key.size ) return 0;
+	if( r.readInt()!=key.hash_lo ) return 0;
+	if( r.readInt()!=key.hash_hi ) return 0;
+	Transform t=r.readTransform();
+	if( memcmp( &t,&conv,sizeof(Transform) ) ) return 0;
+	if( !r.ok ) return 0;
+
+	r.readTextures();
+	r.readBrushes();
+
+	int n_objs=r.readCount( 56 );
+	if( !r.ok || !n_objs ) return 0;
+
+	vector<Animation> anims( n_objs );
+	vector< vector<Transform> > bone_tforms( n_objs );
+
+	for( int k=0;k<n_objs && r.ok;++k ){
+		int type=r.readInt();
+		int parent=r.readInt();
+		if( !r.ok || (parent<0)!=(k==0) || parent>=k ){ r.ok=false;break; }
+
+		Object *obj;
+		MeshModel *mesh=0;
+		if( type==OBJ_MESH ) obj=mesh=d_new MeshModel();
+		else obj=d_new Pivot();
+		r.objs.push_back( obj );
+		if( parent>=0 ) obj->setParent( r.objs[parent] );
+
+		obj->setName( r.readString() );
+		obj->setLocalPosition( r.readVector() );
+		obj->setLocalScale( r.readVector() );
+		obj->setLocalRotation( r.readQuat() );
+		anims[k]=r.readAnimation();
+
+		if( mesh ) r.readMesh( mesh,bone_tforms[k] );
+	}
+
+	int n_anims=r.ok ? r.readCount( 12 ) : 0;
+	for( int k=0;k<n_anims && r.ok;++k ){
+		int owner=r.readInt();
+		int n=r.readCount( 4 );
+		const int *ids=(const int*)r.readArray( n*4 );
+		if( !r.ok || owner<0 || owner>=n_objs ){ r.ok=false;break; }
+
+		vector<Object*> anim_objs( n );
+		for( int j=0;j<n;++j ){
+			if( ids[j]<0 || ids[j]>=n_objs ){ r.ok=false;break; }
+			anim_objs[j]=r.objs[ids[j]];
+		}
+
+		int n_seqs=r.readCount( 4 );
+		Animator *animator=0;
+		for( int s=0;s<n_seqs && r.ok;++s ){
+			int frames=r.readInt();
+			for( int j=0;j<n;++j ) anim_objs[j]->setAnimation( r.readAnimation() );
+			if( !r.ok ) break;
+			if( !animator ) animator=d_new Animator( anim_objs,frames );
+			else animator->addSeq( frames );
+		}
+		if( animator ) r.objs[owner]->setAnimator( animator );
+	}
+
+	if( !r.ok ){
+		if( r.objs.size() ) delete r.objs[0];
+		return 0;
+	}
+
+	for( int k=0;k<n_objs;++k ){
+		r.objs[k]->setAnimation( anims[k] );
+		if( bone_tforms[k].size() ){
+			MeshModel *mesh=r.objs[k]->getModel()->getMeshModel();
+			Animator *animator=mesh->getAnimator();
+			if( !animator || animator->getObjects().size()!=bone_tforms[k].size() ){
+				delete r.objs[0];
+				return 0;
+			}
+			mesh->createBones( bone_tforms[k] );
+		}
+	}
+
+	return r.objs[0];
+}
+
+bool MeshCache::save( const string &f,const Transform &conv,int hint,Entity *e ){
+
+	SourceKey key;
+	if( !sourceKey( f,&key ) ) return false;
+
+	CookedWriter w;
+	if( !w.addObjects( e ) ) return false;
+
+	w.writeInt( COOKED_MAGIC );
+	w.writeInt( COOKED_VERSION );
+	w.writeInt( sizeof(Surface::Vertex) );
+	w.writeInt( hint );
+	w.writeInt( key.size );
+	w.writeInt( key.hash_lo );
+	w.writeInt( key.hash_hi );
+	w.writeTransform( conv );
+
+	w.writeTextures();
+	w.writeBrushes();
+
+	w.writeInt( w.objs.size() );
+	for( int k=0;k<w.objs.size();++k ){
+		w.writeObject( w.objs[k] );
+	}
+
+	int n_anims=0;
+	for( int k=0;k<w.objs.size();++k ){
+		if( w.objs[k]->getAnimator() ) ++n_anims;
+	}
+	w.writeInt( n_anims );
+	for( int k=0;k<w.objs.size();++k ){
+		if( Animator *anim=w.objs[k]->getAnimator() ){
+			if( !w.writeAnimator( k,anim ) ) return false;
+		}
+	}
+
+	//write to a temp file first so a half written cache is never picked up
+	string t=cookedFile( f,hint ),tmp=t+".tmp";
+	FILE *out=fopen( tmp.c_str(),"wb" );
+	if( !out ) return false;
+	bool ok=fwrite( &w.buf[0],w.buf.size(),1,out )==1;
+	ok=!fclose( out ) && ok;
+	if( ok ){
+		remove( t.c_str() );
+		ok=!rename( tmp.c_str(),t.c_str() );
+	}
+	if( !ok ) remove( tmp.c_str() );
+	return ok;
+}
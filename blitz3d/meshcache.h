@@ -0,0 +1,25 @@
+
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include "meshmodel.h"
+
+//Cooked mesh cache.
+//
+//Stores the result of a mesh load next to the source asset so later loads
+//skip parsing, welding, normal generation and collider building. A cooked
+//file is only used if the source size/hash, load hint and loader matrix
+//all match what it was written with.
+struct MeshCache{
+
+	//cooked file name for a source asset
+	static string cookedFile( const string &f,int hint );
+
+	//returns 0 if there's no valid cooked file for f
+	static Entity *load( const string &f,const Transform &conv,int hint );
+
+	//returns false if e contains something that can't be cooked
+	static bool save( const string &f,const Transform &conv,int hint,Entity *e );
+};
+
+#endif
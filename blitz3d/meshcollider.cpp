@@ -47,6 +47,11 @@ vertices(verts),triangles(tris){
 	tree=createNode( ts );
 }
 
+MeshCollider::MeshCollider( const vector<Vertex> &verts,const vector<Triangle> &tris,const vector<FlatNode> &nodes,const vector<int> &node_tris ):
+vertices(verts),triangles(tris){
+	tree=createNode( nodes,node_tris,0 );
+}
+
 MeshCollider::~MeshCollider(){
 	delete tree;
 }
@@ -163,6 +168,54 @@ MeshCollider::Node *MeshCollider::createNode( const vector<int> &tris ){
 	return c;
 }
 
+MeshCollider::Node *MeshCollider::createNode( const vector<FlatNode> &nodes,const vector<int> &node_tris,int n ){
+
+	const FlatNode &f=nodes[n];
+
+	Node *c=d_new Node;
+	c->box=f.box;
+
+	if( f.left<0 && f.right<0 ){
+		c->triangles.assign( node_tris.begin()+f.first_tri,node_tris.begin()+f.first_tri+f.n_tris );
+		leaves.push_back( c );
+		return c;
+	}
+
+	if( f.left>=0 ) c->left=createNode( nodes,node_tris,f.left );
+	if( f.right>=0 ) c->right=createNode( nodes,node_tris,f.right );
+	return c;
+}
+
+void MeshCollider::flatten( vector<FlatNode> &nodes,vector<int> &node_tris )const{
+	nodes.clear();
+	node_tris.clear();
+	flatten( tree,nodes,node_tris );
+}
+
+void MeshCollider::flatten( Node *node,vector<FlatNode> &nodes,vector<int> &node_tris )const{
+
+	int n=nodes.size();
+	nodes.push_back( FlatNode() );
+
+	FlatNode &f=nodes[n];
+	f.box=node->box;
+	f.left=f.right=-1;
+	f.first_tri=node_tris.size();
+	f.n_tris=node->triangles.size();
+	node_tris.insert( node_tris.end(),node->triangles.begin(),node->triangles.end() );
+
+	if( node->left ){
+		int t=nodes.size();
+		flatten( node->left,nodes,node_tris );
+		nodes[n].left=t;
+	}
+	if( node->right ){
+		int t=nodes.size();
+		flatten( node->right,nodes,node_tris );
+		nodes[n].right=t;
+	}
+}
+
 bool MeshCollider::intersects( const MeshCollider &c,const Transform &t )const{
 
 	static Vector a[MAX_COLL_TRIS][3],b[3];
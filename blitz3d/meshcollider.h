@@ -13,9 +13,18 @@ public:
 		void *surface;
 		int verts[3],index;
 	};
+	//flattened tree node, for the mesh cache
+	struct FlatNode{
+		Box box;
+		int left,right;		//-1 for leaves
+		int first_tri,n_tris;
+	};
 	MeshCollider( const vector<Vertex> &verts,const vector<Triangle> &tris );
+	MeshCollider( const vector<Vertex> &verts,const vector<Triangle> &tris,const vector<FlatNode> &nodes,const vector<int> &node_tris );
 	~MeshCollider();
 
+	void flatten( vector<FlatNode> &nodes,vector<int> &node_tris )const;
+
 	//sphere collision
 	bool collide( const Line &line,float radius,Collision *curr_coll,const Transform &tform );
 
@@ -39,6 +48,8 @@ private:
 	Box nodeBox( const vector<int> &tris );
 	Node *createLeaf( const vector<int> &tris );
 	Node *createNode( const vector<int> &tris );
+	Node *createNode( const vector<FlatNode> &nodes,const vector<int> &node_tris,int n );
+	void flatten( Node *node,vector<FlatNode> &nodes,vector<int> &node_tris )const;
 	bool collide( const Box &box,const Line &line,float radius,const Transform &tform,Collision *curr_coll,Node *node );
 };
 
@@ -42,6 +42,10 @@ void MeshLoader::addVertex( const Surface::Vertex &v ){
 	ml_mesh->verts.push_back( v );
 }
 
+void MeshLoader::addVertices( const Surface::Vertex *v,int n ){
+	ml_mesh->verts.insert( ml_mesh->verts.end(),v,v+n );
+}
+
 void MeshLoader::addTriangle( const int verts[3],const Brush &b ){
 	addTriangle( verts[0],verts[1],verts[2],b );
 }
@@ -80,6 +84,34 @@ void MeshLoader::addTriangle( int v0,int v1,int v2,const Brush &b ){
 	surf->tris.push_back( tri );
 }
 
+void MeshLoader::addTriangles( const int *verts,int n,const Brush &b ){
+	if( n<=0 ) return;
+
+	Surf *surf;
+	map<Brush,Surf*>::const_iterator it=ml_mesh->brush_map.find( b );
+	if( it!=ml_mesh->brush_map.end() ) surf=it->second;
+	else{
+		surf=d_new Surf;
+		ml_mesh->brush_map.insert( make_pair( b,surf ) );
+	}
+
+	//triangles with a vertex that doesn't exist are dropped
+	unsigned cnt=ml_mesh->verts.size();
+	int k,base=surf->tris.size();
+	for( k=0;k<n*3 && (unsigned)verts[k]<cnt;++k ){}
+	if( k==n*3 ){
+		surf->tris.resize( base+n );
+		memcpy( &surf->tris[base],verts,n*sizeof(Tri) );
+		return;
+	}
+	for( k=0;k<n;++k,verts+=3 ){
+		if( (unsigned)verts[0]>=cnt || (unsigned)verts[1]>=cnt || (unsigned)verts[2]>=cnt ) continue;
+		Tri tri;
+		tri.verts[0]=verts[0];tri.verts[1]=verts[1];tri.verts[2]=verts[2];
+		surf->tris.push_back( tri );
+	}
+}
+
 void MeshLoader::endMesh( MeshModel *mesh ){
 	if( mesh ){
 		//fix bone weights
@@ -99,29 +131,33 @@ void MeshLoader::endMesh( MeshModel *mesh ){
 				v.bone_weights[j]*=t;
 			}
 		}
-		map<int,int> vert_map;
+		//per surface remap of loader vertex -> surface vertex, only the
+		//entries a surface used are reset for the next one
+		unsigned cnt=ml_mesh->verts.size();
+		vector<int> vert_map( cnt,-1 ),used;
 		map<Brush,Surf*>::iterator it;
 		for( it=ml_mesh->brush_map.begin();it!=ml_mesh->brush_map.end();++it ){
-			vert_map.clear();
 			Brush b=it->first;
 			Surf *t=it->second;
 			Surface *surf=mesh->findSurface( b );
 			if( !surf ) surf=mesh->createSurface( b );
 			for( int k=0;k<t->tris.size();++k ){
+				const int *v=t->tris[k].verts;
+				if( (unsigned)v[0]>=cnt || (unsigned)v[1]>=cnt || (unsigned)v[2]>=cnt ) continue;
 				Surface::Triangle tri;
 				for( int j=0;j<3;++j ){
-					int n=t->tris[k].verts[j],id;
-					map<int,int>::const_iterator it=vert_map.find( n );
-					if( it!=vert_map.end() ) id=it->second;
-					else{
-						id=surf->numVertices();
+					int n=v[j],id=vert_map[n];
+					if( id<0 ){
+						id=vert_map[n]=surf->numVertices();
 						surf->addVertex( ml_mesh->verts[n] );
-						vert_map.insert( make_pair( n,id ) );
+						used.push_back( n );
 					}
 					tri.verts[j]=id;
 				}
 				surf->addTriangle( tri );
 			}
+			for( int k=0;k<used.size();++k ) vert_map[used[k]]=-1;
+			used.clear();
 		}
 	}
 	delete ml_mesh;
@@ -20,9 +20,15 @@ public:
 	//add a vertex
 	static void addVertex( const Surface::Vertex &v );
 
+	//add a block of vertices
+	static void addVertices( const Surface::Vertex *verts,int n );
+
 	//add a triangle
 	static void addTriangle( const int verts[3],const Brush &b );
 
+	//add a block of triangles, 3 indices per triangle
+	static void addTriangles( const int *verts,int n,const Brush &b );
+
 	//also add a triangle
 	static void addTriangle( int v0,int v1,int v2,const Brush &b );
 
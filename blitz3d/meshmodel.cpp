@@ -130,34 +130,47 @@ struct MeshModel::Rep : public Surface::Monitor{
 		return cullBox.empty() ? getBox() : cullBox;
 	}
 
+	void getCollGeometry( vector<MeshCollider::Vertex> &verts,vector<MeshCollider::Triangle> &tris )const{
+		for( int k=0;k<surfaces.size();++k ){
+			Surface *s=surfaces[k];
+			int j;
+			for( j=0;j<s->numTriangles();++j ){
+				MeshCollider::Triangle q;
+				q.verts[0]=s->getTriangle(j).verts[0]+verts.size();
+				q.verts[1]=s->getTriangle(j).verts[1]+verts.size();
+				q.verts[2]=s->getTriangle(j).verts[2]+verts.size();
+				q.surface=s;
+				q.index=j;
+				tris.push_back( q );
+			}
+			for( j=0;j<s->numVertices();++j ){
+				MeshCollider::Vertex q;
+				q.coords=s->getVertex(j).coords;
+				verts.push_back( q );
+			}
+		}
+	}
+
 	MeshCollider *getCollider()const{
 		if( coll_valid!=geom_changes ){
 			delete collider;
 			vector<MeshCollider::Vertex> verts;
 			vector<MeshCollider::Triangle> tris;
-			for( int k=0;k<surfaces.size();++k ){
-				Surface *s=surfaces[k];
-				int j;
-				for( j=0;j<s->numTriangles();++j ){
-					MeshCollider::Triangle q;
-					q.verts[0]=s->getTriangle(j).verts[0]+verts.size();
-					q.verts[1]=s->getTriangle(j).verts[1]+verts.size();
-					q.verts[2]=s->getTriangle(j).verts[2]+verts.size();
-					q.surface=s;
-					q.index=j;
-					tris.push_back( q );
-				}
-				for( j=0;j<s->numVertices();++j ){
-					MeshCollider::Vertex q;
-					q.coords=s->getVertex(j).coords;
-					verts.push_back( q );
-				}
-			}
+			getCollGeometry( verts,tris );
 			collider=d_new MeshCollider( verts,tris );
 			coll_valid=geom_changes;
 		}
 		return collider;
 	}
+
+	void setCollider( const vector<MeshCollider::FlatNode> &nodes,const vector<int> &node_tris ){
+		delete collider;
+		vector<MeshCollider::Vertex> verts;
+		vector<MeshCollider::Triangle> tris;
+		getCollGeometry( verts,tris );
+		collider=d_new MeshCollider( verts,tris,nodes,node_tris );
+		coll_valid=geom_changes;
+	}
 };
 
 MeshModel::MeshModel():
@@ -208,14 +221,28 @@ void MeshModel::createBones(){
 	}
 }
 
+void MeshModel::createBones( const vector<Transform> &bone_tforms ){
+	setRenderSpace( RENDER_SPACE_WORLD );
+
+	surf_bones.resize( bone_tforms.size() );
+
+	rep->bone_tforms=bone_tforms;
+}
+
+const vector<Transform> &MeshModel::getBoneTforms()const{
+	return rep->bone_tforms;
+}
+
 bool MeshModel::render( const RenderContext &rc ){
 
 	const Box &b=rep->getCullBox();
 	if( b.empty() ) return false;
 
-	static Frustum model_frustum;
-	new( &model_frustum ) Frustum( rc.getWorldFrustum(),-getRenderTform() );
-	if( !model_frustum.cull( b ) ) return false;
+	if( !inView() ){
+		static Frustum model_frustum;
+		new( &model_frustum ) Frustum( rc.getWorldFrustum(),-getRenderTform() );
+		if( !model_frustum.cull( b ) ) return false;
+	}
 
 	if( brush_changes!=rep->brush_changes ){
 		brushes.clear();
@@ -308,6 +335,10 @@ MeshCollider *MeshModel::getCollider()const{
 	return rep->getCollider();
 }
 
+void MeshModel::setCollider( const vector<MeshCollider::FlatNode> &nodes,const vector<int> &node_tris ){
+	rep->setCollider( nodes,node_tris );
+}
+
 Surface *MeshModel::findSurface( const Brush &b )const{
 	return rep->findSurface( b );
 }
@@ -316,6 +347,16 @@ bool MeshModel::collide( const Line &line,float radius,Collision *curr_coll,cons
 	return getCollider()->collide( line,radius,curr_coll,t );
 }
 
+bool MeshModel::getRenderBounds( Box &box )const{
+	box=rep->getCullBox();
+	return true;
+}
+
+bool MeshModel::getCollideBounds( Box &box )const{
+	box=getBox();
+	return true;
+}
+
 bool MeshModel::intersects( const MeshModel &m )const{
 	return getCollider()->intersects( *m.getCollider(),-m.getWorldTform()*getWorldTform() );
 }
@@ -4,8 +4,7 @@
 
 #include "model.h"
 #include "surface.h"
-
-class MeshCollider;
+#include "meshcollider.h"
 
 class MeshModel : public Model{
 public:
@@ -21,14 +20,20 @@ public:
 
 	//Object interface
 	virtual bool collide( const Line &line,float radius,Collision *curr_coll,const Transform &t );
+	virtual bool getCollideBounds( Box &box )const;
 
 	//Model interface
 	virtual void setRenderBrush( const Brush &b );
 	virtual bool render( const RenderContext &rc );
+	virtual bool getRenderBounds( Box &box )const;
 	virtual void renderQueue( int type );
+	//boned surfaces are skinned into a mesh every copy shares
+	virtual bool batchable()const{ return !surf_bones.size(); }
 
 	//boned mesh!
 	void createBones();
+	void createBones( const vector<Transform> &bone_tforms );
+	const vector<Transform> &getBoneTforms()const;
 
 	//MeshModel interface
 	Surface *createSurface( const Brush &b );
@@ -45,6 +50,7 @@ public:
 	Surface *findSurface( const Brush &b )const;
 	bool intersects( const MeshModel &m )const;
 	MeshCollider *getCollider()const;
+	void setCollider( const vector<MeshCollider::FlatNode> &nodes,const vector<int> &node_tris );
 	const Box &getBox()const;
 
 private:
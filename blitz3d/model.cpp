@@ -1,6 +1,7 @@
 
 #include "std.h"
 #include "model.h"
+#include <algorithm>
 
 extern gxScene *gx_scene;
 
@@ -28,10 +29,22 @@ public:
 	int getQueueType()const{
 		return q_type;
 	}
+	const gxScene::RenderState &getRenderState()const{
+		return brush.getRenderState();
+	}
+	bool sameMesh( const MeshQueue *q )const{
+		return mesh==q->mesh && fv==q->fv && vc==q->vc && ft==q->ft && tc==q->tc;
+	}
+	gxMesh *getMesh()const{
+		return mesh;
+	}
 	void render(){
 		gx_scene->setRenderState( brush.getRenderState() );
 		gx_scene->render( mesh,fv,vc,ft,tc );
 	}
+	void renderMesh(){
+		gx_scene->render( mesh,fv,vc,ft,tc );
+	}
 	void *operator new( size_t sz ){
 		static const int GROW=256;
 		if( !pool ){
@@ -54,13 +67,13 @@ Model::MeshQueue *Model::MeshQueue::pool;
 
 Model::Model():
 space( RENDER_SPACE_LOCAL ),
-auto_fade(false),
+auto_fade(false),in_view(false),
 captured_alpha(1),w_brush(true){
 }
 
 Model::Model( const Model &t ):Object(t),
 space(t.space),brush(t.brush),
-auto_fade(t.auto_fade),auto_fade_nr(t.auto_fade_nr),auto_fade_fr(t.auto_fade_fr),
+auto_fade(t.auto_fade),auto_fade_nr(t.auto_fade_nr),auto_fade_fr(t.auto_fade_fr),in_view(false),
 captured_alpha(t.captured_alpha),w_brush(true){
 }
 
@@ -127,3 +140,91 @@ void Model::renderQueue( int type ){
 		delete q;
 	}
 }
+
+struct Model::QueueItem{
+	Model *model;
+	MeshQueue *queue;
+};
+
+//textures first as they're the most expensive to change, then the rest of the state, then mesh
+template<class T>
+static inline int compare( const T &a,const T &b ){
+	return a<b ? -1 : (b<a ? 1 : 0);
+}
+
+//field by field - struct padding isn't guaranteed to match
+static int compareStates( const gxScene::RenderState &a,const gxScene::RenderState &b ){
+	int k,n;
+	for( k=0;k<gxScene::MAX_TEXTURES;++k ){
+		if( n=compare( a.tex_states[k].canvas,b.tex_states[k].canvas ) ) return n;
+	}
+	if( n=compare( a.blend,b.blend ) ) return n;
+	if( n=compare( a.fx,b.fx ) ) return n;
+	for( k=0;k<3;++k ){
+		if( n=compare( a.color[k],b.color[k] ) ) return n;
+	}
+	if( n=compare( a.shininess,b.shininess ) ) return n;
+	if( n=compare( a.alpha,b.alpha ) ) return n;
+	for( k=0;k<gxScene::MAX_TEXTURES;++k ){
+		const gxScene::RenderState::TexState &p=a.tex_states[k],&q=b.tex_states[k];
+		if( n=compare( p.matrix,q.matrix ) ) return n;
+		if( n=compare( p.blend,q.blend ) ) return n;
+		if( n=compare( p.flags,q.flags ) ) return n;
+		for( int j=0;j<4;++j ){
+			if( n=compare( p.bumpEnvMat[j>>1][j&1],q.bumpEnvMat[j>>1][j&1] ) ) return n;
+		}
+		if( n=compare( p.bumpEnvScale,q.bumpEnvScale ) ) return n;
+		if( n=compare( p.bumpEnvOffset,q.bumpEnvOffset ) ) return n;
+	}
+	return 0;
+}
+
+bool Model::itemLess( const QueueItem &a,const QueueItem &b ){
+	if( int n=compareStates( a.queue->getRenderState(),b.queue->getRenderState() ) ) return n<0;
+	if( a.queue->getMesh()!=b.queue->getMesh() ) return a.queue->getMesh()<b.queue->getMesh();
+	return a.model<b.model;
+}
+
+void Model::renderQueues( const vector<Model*> &models,int type ){
+	static vector<QueueItem> items;
+
+	int k;
+	for( k=0;k<models.size();++k ){
+		Model *m=models[k];
+		vector<MeshQueue*> &que=m->queues[type];
+		for( int j=0;j<que.size();++j ){
+			QueueItem t={ m,que[j] };
+			items.push_back( t );
+		}
+		que.clear();
+	}
+
+	sort( items.begin(),items.end(),itemLess );
+
+	Model *model=0;
+	MeshQueue *prev=0;
+	bool world=false;
+	for( k=0;k<items.size();++k ){
+		const QueueItem &t=items[k];
+		if( t.model!=model ){
+			model=t.model;
+			if( model->getRenderSpace()==RENDER_SPACE_LOCAL ){
+				gx_scene->setWorldMatrix( (gxScene::Matrix*)&model->getRenderTform() );
+				world=false;
+			}else if( !world ){
+				gx_scene->setWorldMatrix( 0 );
+				world=true;
+			}
+		}
+		//runs of the same state only need the mesh resubmitted
+		if( prev && !compareStates( prev->getRenderState(),t.queue->getRenderState() ) ){
+			t.queue->renderMesh();
+		}else{
+			t.queue->render();
+		}
+		if( prev ) delete prev;
+		prev=t.queue;
+	}
+	if( prev ) delete prev;
+	items.clear();
+}
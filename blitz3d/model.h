@@ -41,7 +41,12 @@ public:
 	//Model interface
 	virtual void setRenderBrush( const Brush &b ){}
 	virtual bool render( const RenderContext &rc ){ return false; }
+	//local box that render() draws within, false if unknown
+	virtual bool getRenderBounds( Box &box )const{ return false; }
 	virtual void renderQueue( int type );
+	//true if the meshes render() queued stay as they are when other copies render,
+	//so drawing them can be put off and batched with other models
+	virtual bool batchable()const{ return false; }
 
 	virtual Sprite *getSprite(){ return 0; }
 	virtual Terrain *getTerrain(){ return 0; }
@@ -72,8 +77,19 @@ public:
 
 	int queueSize( int type )const{ return queues[type].size(); }
 
+	//renders the queues of several models together, sorted by render state.
+	//skips renderQueue(), so only for queues that don't override it.
+	static void renderQueues( const vector<Model*> &models,int type );
+
+	//set by world while rendering a model whose render box is wholly inside the view
+	void setInView( bool t ){ in_view=t; }
+	bool inView()const{ return in_view; }
+
 private:
 	class MeshQueue;
+	struct QueueItem;
+
+	static bool itemLess( const QueueItem &a,const QueueItem &b );
 
 	int space;
 	Brush brush,render_brush;
@@ -84,6 +100,8 @@ private:
 	bool auto_fade;
 	float auto_fade_nr,auto_fade_fr;
 
+	bool in_view;
+
 	vector<MeshQueue*> queues[2];
 
 	void enqueue( MeshQueue *q );
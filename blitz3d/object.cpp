@@ -47,10 +47,12 @@ void Object::setCollisionType( int type ){
 
 void Object::setCollisionRadii( const Vector &radii ){
 	coll_radii=radii;
+	boundsChanged();
 }
 
 void Object::setCollisionBox( const Box &box ){
 	coll_box=box;
+	boundsChanged();
 }
 
 void Object::setAnimator( Animator *t ){
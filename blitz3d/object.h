@@ -46,6 +46,7 @@ public:
 		capsule_a = a;
 		capsule_b = b;
 		capsule_radius = radius;
+		boundsChanged();
 	}
 
 	Vector getCapsulePointA() const { return capsule_a; }
@@ -53,7 +54,7 @@ public:
 	float getCapsuleRadius() const { return capsule_radius; }
 
 	void setOrder( int n ){ order=n; }
-	void setPickGeometry( int n ){ pick_geom=n; }
+	void setPickGeometry( int n ){ if( pick_geom!=n ){ pick_geom=n;enabledChanged(); } }
 	void setObscurer( bool t ){ obscurer=t; }
 	void setAnimation( const Animation &t ){ anim=t; }
 	void setAnimator( Animator *t );
@@ -62,6 +63,8 @@ public:
 
 	//overridables!
 	virtual bool collide( const Line &line,float radius,::Collision *curr_coll,const Transform &t ){ return false; }
+	//local bounds of what collide() can hit, false if unknown
+	virtual bool getCollideBounds( Box &box )const{ return false; }
 	virtual void capture();
 	virtual void animate( float e );
 	virtual bool beginRender( float tween );
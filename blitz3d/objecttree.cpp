@@ -0,0 +1,293 @@
+
+#include "std.h"
+#include "objecttree.h"
+#include <algorithm>
+#include <queue>
+
+static const int MAX_NODE_OBJS=4;
+static const int MAX_DEPTH=64;
+
+static const Box *sort_boxes;
+static int sort_axis;
+
+static float axis( const Vector &v,int n ){
+	return n==0 ? v.x : (n==1 ? v.y : v.z);
+}
+
+//empty and infinite boxes have no real centre - give them the origin so
+//the split comparator stays a strict weak ordering
+static Vector sortCentre( const Box &b ){
+	if( b.empty() ) return Vector();
+	Vector c=b.centre();
+	if( c.x!=c.x ) c.x=0;
+	if( c.y!=c.y ) c.y=0;
+	if( c.z!=c.z ) c.z=0;
+	return c;
+}
+
+static bool centreLess( int a,int b ){
+	return axis( sortCentre( sort_boxes[a] ),sort_axis )<axis( sortCentre( sort_boxes[b] ),sort_axis );
+}
+
+//returns entry time of line into box grown by pad, if it's entered before max_t
+static bool lineBox( const Line &l,const Box &b,float pad,float max_t,float *t ){
+	if( b.empty() ) return false;
+	float t0=0,t1=max_t;
+	for( int k=0;k<3;++k ){
+		float o=axis( l.o,k ),d=axis( l.d,k );
+		float lo=axis( b.a,k )-pad,hi=axis( b.b,k )+pad;
+		if( fabs( d )<EPSILON ){
+			if( o<lo || o>hi ) return false;
+			continue;
+		}
+		float ta=(lo-o)/d,tb=(hi-o)/d;
+		if( ta>tb ) std::swap( ta,tb );
+		if( ta>t0 ) t0=ta;
+		if( tb<t1 ) t1=tb;
+		if( t0>t1 ) return false;
+	}
+	*t=t0;
+	return true;
+}
+
+ObjectTree::ObjectTree( BoundsFunc bounds ):bounds(bounds){
+}
+
+void ObjectTree::clear(){
+	nodes.clear();
+	objs.clear();
+	boxes.clear();
+	unbounded.clear();
+	slots.clear();
+	leaves.clear();
+	invalid.clear();
+	is_invalid.clear();
+}
+
+void ObjectTree::build( const vector<Object*> &t ){
+	clear();
+
+	vector<Object*> in;
+	for( int k=0;k<t.size();++k ){
+		Box b;
+		if( bounds( t[k],b ) ){
+			in.push_back( t[k] );
+			boxes.push_back( b );
+		}else{
+			unbounded.push_back( t[k] );
+		}
+	}
+	if( !in.size() ) return;
+
+	vector<int> order( in.size() );
+	for( int k=0;k<order.size();++k ) order[k]=k;
+	createNode( order,0,order.size(),-1 );
+
+	//store objects in leaf order
+	vector<Box> in_boxes;
+	in_boxes.swap( boxes );
+	for( int k=0;k<order.size();++k ){
+		objs.push_back( in[order[k]] );
+		boxes.push_back( in_boxes[order[k]] );
+		slots[objs[k]]=k;
+	}
+	leaves.resize( objs.size() );
+	for( int k=0;k<nodes.size();++k ){
+		const Node &n=nodes[k];
+		if( n.right>=0 ) continue;
+		for( int j=n.first;j<n.first+n.count;++j ) leaves[j]=k;
+	}
+	is_invalid.resize( objs.size() );
+}
+
+int ObjectTree::createNode( vector<int> &order,int first,int count,int parent ){
+	int n=nodes.size();
+	nodes.push_back( Node() );
+
+	Box box,centres;
+	for( int k=first;k<first+count;++k ){
+		box.update( boxes[order[k]] );
+		centres.update( sortCentre( boxes[order[k]] ) );
+	}
+	nodes[n].box=box;
+	nodes[n].first=first;
+	nodes[n].count=count;
+	nodes[n].right=-1;
+	nodes[n].parent=parent;
+
+	if( count<=MAX_NODE_OBJS ) return n;
+
+	//split at the median along the longest axis of the centres
+	Vector sz=centres.b-centres.a;
+	sort_axis=sz.x>sz.y ? (sz.x>sz.z ? 0 : 2) : (sz.y>sz.z ? 1 : 2);
+	sort_boxes=&boxes[0];
+	int half=count/2;
+	nth_element( order.begin()+first,order.begin()+first+half,order.begin()+first+count,centreLess );
+
+	createNode( order,first,half,n );
+	int right=createNode( order,first+half,count-half,n );
+	nodes[n].right=right;
+	return n;
+}
+
+void ObjectTree::refitBox( int slot ){
+	if( !bounds( objs[slot],boxes[slot] ) ){
+		//lost its bounds - make sure it can't be missed
+		boxes[slot]=Box( Vector( -INFINITY,-INFINITY,-INFINITY ),Vector( INFINITY,INFINITY,INFINITY ) );
+	}
+}
+
+void ObjectTree::refitNode( Node &n,int k ){
+	n.box.clear();
+	if( n.right<0 ){
+		for( int j=n.first;j<n.first+n.count;++j ) n.box.update( boxes[j] );
+	}else{
+		n.box.update( nodes[k+1].box );
+		n.box.update( nodes[n.right].box );
+	}
+}
+
+void ObjectTree::refit(){
+	for( int k=0;k<objs.size();++k ) refitBox( k );
+	//children always come after their parent
+	for( int k=nodes.size()-1;k>=0;--k ) refitNode( nodes[k],k );
+
+	for( int k=0;k<invalid.size();++k ) is_invalid[invalid[k]]=false;
+	invalid.clear();
+}
+
+void ObjectTree::invalidate( Object *obj ){
+	map<Object*,int>::const_iterator it=slots.find( obj );
+	if( it==slots.end() || is_invalid[it->second] ) return;
+	is_invalid[it->second]=true;
+	invalid.push_back( it->second );
+}
+
+void ObjectTree::refitInvalid(){
+	if( !invalid.size() ) return;
+
+	//parents come before their children, so popping the highest node first refits
+	//all of a node's invalid children before it, and shared paths only once
+	priority_queue<int> todo;
+	for( int k=0;k<invalid.size();++k ){
+		int slot=invalid[k];
+		is_invalid[slot]=false;
+		refitBox( slot );
+		todo.push( leaves[slot] );
+	}
+	invalid.clear();
+
+	int last=-1;
+	while( todo.size() ){
+		int n=todo.top();
+		todo.pop();
+		if( n==last ) continue;
+		last=n;
+		refitNode( nodes[n],n );
+		if( nodes[n].parent>=0 ) todo.push( nodes[n].parent );
+	}
+}
+
+void ObjectTree::trace( const Line &line,float radius,const float *max_time,VisitFunc fn,void *ctx )const{
+	int k;
+	for( k=0;k<unbounded.size();++k ){
+		if( fn( unbounded[k],ctx ) ) return;
+	}
+	if( !nodes.size() ) return;
+
+	float pad=radius+.001f;
+
+	int stack[MAX_DEPTH];
+	float stack_t[MAX_DEPTH];
+	int sp=0;
+
+	float t;
+	if( !lineBox( line,nodes[0].box,pad,*max_time,&t ) ) return;
+	stack[sp]=0;stack_t[sp++]=t;
+
+	while( sp ){
+		--sp;
+		if( stack_t[sp]>*max_time ) continue;
+		const Node &n=nodes[stack[sp]];
+
+		if( n.right<0 ){
+			for( k=n.first;k<n.first+n.count;++k ){
+				if( !lineBox( line,boxes[k],pad,*max_time,&t ) ) continue;
+				if( fn( objs[k],ctx ) ) return;
+			}
+			continue;
+		}
+
+		//push the far child first so the near one is visited first
+		int l=stack[sp]+1,r=n.right;
+		float tl,tr;
+		bool hl=lineBox( line,nodes[l].box,pad,*max_time,&tl );
+		bool hr=lineBox( line,nodes[r].box,pad,*max_time,&tr );
+		if( hl && hr && tr<tl ){
+			std::swap( l,r );
+			std::swap( tl,tr );
+		}
+		if( hr ){ stack[sp]=r;stack_t[sp++]=tr; }
+		if( hl ){ stack[sp]=l;stack_t[sp++]=tl; }
+	}
+}
+
+//-1 if box is outside a plane, 1 if inside all of them, else 0.
+//planes box is wholly inside are cleared from mask so children skip them.
+static int cullBox( const Frustum &f,const Box &b,int *mask ){
+	if( b.empty() ) return -1;
+	float cx=(b.a.x+b.b.x)*.5f,cy=(b.a.y+b.b.y)*.5f,cz=(b.a.z+b.b.z)*.5f;
+	float ex=(b.b.x-b.a.x)*.5f,ey=(b.b.y-b.a.y)*.5f,ez=(b.b.z-b.a.z)*.5f;
+	for( int k=0;k<6;++k ){
+		if( !(*mask&(1<<k)) ) continue;
+		const Plane &p=f.getPlane( k );
+		float d=p.n.x*cx+p.n.y*cy+p.n.z*cz+p.d;
+		float r=fabs( p.n.x )*ex+fabs( p.n.y )*ey+fabs( p.n.z )*ez;
+		if( d+r<0 ) return -1;
+		if( d-r>=0 ) *mask&=~(1<<k);
+	}
+	return *mask ? 0 : 1;
+}
+
+int ObjectTree::cull( const Frustum &f,CullFunc fn,void *ctx )const{
+	int k;
+	for( k=0;k<unbounded.size();++k ){
+		fn( unbounded[k],false,ctx );
+	}
+	if( !nodes.size() ) return 0;
+
+	int stack[MAX_DEPTH],stack_mask[MAX_DEPTH];
+	int sp=0,tested=0;
+
+	stack[sp]=0;stack_mask[sp++]=63;
+
+	while( sp ){
+		--sp;
+		int i=stack[sp],mask=stack_mask[sp];
+		const Node &n=nodes[i];
+
+		++tested;
+		int t=cullBox( f,n.box,&mask );
+		if( t<0 ) continue;
+
+		if( t>0 ){
+			//whole subtree is in view
+			for( k=n.first;k<n.first+n.count;++k ) fn( objs[k],true,ctx );
+			continue;
+		}
+
+		if( n.right<0 ){
+			for( k=n.first;k<n.first+n.count;++k ){
+				int obj_mask=mask;
+				++tested;
+				int r=cullBox( f,boxes[k],&obj_mask );
+				if( r>=0 ) fn( objs[k],r>0,ctx );
+			}
+			continue;
+		}
+
+		stack[sp]=n.right;stack_mask[sp++]=mask;
+		stack[sp]=i+1;stack_mask[sp++]=mask;
+	}
+	return tested;
+}
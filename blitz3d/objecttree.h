@@ -0,0 +1,65 @@
+
+#ifndef OBJECTTREE_H
+#define OBJECTTREE_H
+
+#include "object.h"
+#include "frustum.h"
+
+//Bounding volume tree over the world boxes of a set of objects.
+//
+//build() is only needed when the set changes; refit() recomputes the boxes in
+//place after objects have moved. invalidate() and refitInvalid() do the same for
+//just a few objects, refitting only their paths to the root. Objects whose bounds
+//are unknown aren't put in the tree and are always visited.
+class ObjectTree{
+public:
+	//returns false if obj has no known bounds
+	typedef bool (*BoundsFunc)( Object *obj,Box &box );
+
+	//return true to stop the query
+	typedef bool (*VisitFunc)( Object *obj,void *ctx );
+
+	//inside is true if obj's box is wholly inside the frustum
+	typedef void (*CullFunc)( Object *obj,bool inside,void *ctx );
+
+	ObjectTree( BoundsFunc bounds );
+
+	void clear();
+	void build( const vector<Object*> &objs );
+	void refit();
+
+	//marks obj's box for refitInvalid(), ignored if obj isn't in the tree
+	void invalidate( Object *obj );
+	void refitInvalid();
+
+	//visits objects that a swept sphere along line might hit, nearest first.
+	//nodes entered beyond *max_time are skipped, so fn can shrink it as it finds hits.
+	void trace( const Line &line,float radius,const float *max_time,VisitFunc fn,void *ctx )const;
+
+	//visits objects that may be inside a frustum, returns number of boxes tested
+	int cull( const Frustum &f,CullFunc fn,void *ctx )const;
+
+private:
+	struct Node{
+		Box box;
+		int first,count;	//objects in subtree
+		int right;			//right child, -1 for leaves - left child is next node
+		int parent;
+	};
+
+	BoundsFunc bounds;
+	vector<Node> nodes;
+	vector<Object*> objs,unbounded;
+	vector<Box> boxes;
+
+	map<Object*,int> slots;		//index into objs
+	vector<int> leaves;			//leaf node of each object
+	vector<int> invalid;		//slots to refit
+	vector<bool> is_invalid;
+
+	int createNode( vector<int> &order,int first,int count,int parent );
+	void refitBox( int slot );
+	void refitNode( Node &n,int k );
+};
+
+#endif
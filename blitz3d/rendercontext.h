@@ -4,14 +4,19 @@
 
 #include "frustum.h"
 
+class Camera;
+class Mirror;
+
 class RenderContext{
 public:
-	RenderContext( const Transform &t,const Frustum &f,bool r ):
-	camera_tform( t ),camera_frustum(f),ref(r){
+	RenderContext( const Transform &t,const Frustum &f,const Camera *c,const Mirror *m ):
+	camera_tform( t ),camera_frustum(f),camera(c),mirror(m),ref(m!=0){
 		new( &world_frustum ) Frustum( f,t );
 	}
 
 	bool isReflected()const{ return ref; }
+	const Camera *getCamera()const{ return camera; }
+	const Mirror *getMirror()const{ return mirror; }
 	const Transform &getCameraTform()const{ return camera_tform; }
 	const Frustum &getWorldFrustum()const{ return world_frustum; }
 	const Frustum &getCameraFrustum()const{ return camera_frustum; }
@@ -19,6 +24,8 @@ public:
 private:
 	Transform camera_tform;
 	Frustum world_frustum,camera_frustum;
+	const Camera *camera;
+	const Mirror *mirror;
 	bool ref;
 };
 
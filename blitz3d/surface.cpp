@@ -6,6 +6,8 @@ extern gxGraphics *gx_graphics;
 
 static Surface::Monitor nop_mon;
 
+int Surface::_geom_changes;
+
 Surface::Surface():
 mesh(0),mesh_vs(0),mesh_ts(0),valid_vs(0),valid_ts(0),mon( &nop_mon ){
 }
@@ -30,12 +32,12 @@ void Surface::setName( const string &n ){
 void Surface::clear( bool verts,bool tris ){
 	if( verts ){ vertices.clear();valid_vs=0; }
 	if( tris ){ triangles.clear();valid_ts=0; }
-	++mon->geom_changes;
+	geomChanged();
 }
 
 void Surface::addVertices( const vector<Vertex> &verts ){
 	vertices.insert( vertices.end(),verts.begin(),verts.end() );
-	++mon->geom_changes;
+	geomChanged();
 }
 
 void Surface::setColor( int n,const Vector &v ){
@@ -58,6 +60,7 @@ Vector Surface::getColor( int n )const{
 
 void Surface::addTriangles( const vector<Triangle> &tris ){
 	triangles.insert( triangles.end(),tris.begin(),tris.end() );
+	geomChanged();
 }
 
 void Surface::updateNormals(){
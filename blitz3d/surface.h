@@ -50,17 +50,17 @@ public:
 
 	void addVertex( const Vertex &v ){
 		vertices.push_back(v);
-		++mon->geom_changes;
+		geomChanged();
 	}
 	void setVertex( int n,const Vertex &v ){
 		vertices[n]=v;
 		if( n<valid_vs ) valid_vs=n;
-		++mon->geom_changes;
+		geomChanged();
 	}
 	void setCoords( int n,const Vector &v ){
 		vertices[n].coords=v;
 		if( n<valid_vs ) valid_vs=n;
-		++mon->geom_changes;
+		geomChanged();
 	}
 	void setNormal( int n,const Vector &v ){
 		vertices[n].normal=v;
@@ -77,12 +77,12 @@ public:
 	}
 	void addTriangle( const Triangle &t ){
 		triangles.push_back(t);
-		++mon->geom_changes;
+		geomChanged();
 	}
 	void setTriangle( int n,const Triangle &t ){
 		triangles[n]=t;
 		if( n<valid_ts ) valid_ts=n;
-		++mon->geom_changes;
+		geomChanged();
 	}
 
 	Vector getColor( int index )const;
@@ -95,6 +95,9 @@ public:
 	gxMesh *getMesh();
 	gxMesh *getMesh( const vector<Bone> &bones );
 
+	//bumped whenever any surface's geometry changes
+	static int geomChanges(){ return _geom_changes; }
+
 	string getName()const{ return name; }
 	const Brush &getBrush()const{ return brush; }
 	int numVertices()const{ return vertices.size(); }
@@ -111,6 +114,13 @@ private:
 	int mesh_vs,mesh_ts;
 	int valid_vs,valid_ts;
 	Monitor *mon;
+
+	static int _geom_changes;
+
+	void geomChanged(){
+		++mon->geom_changes;
+		++_geom_changes;
+	}
 };
 
 #endif
\ No newline at end of file
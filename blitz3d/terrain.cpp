@@ -3,8 +3,8 @@
 #include "terrain.h"
 #include "terrainrep.h"
 
-Terrain::Terrain( int size_shift ):
-rep( d_new TerrainRep( size_shift ) ){
+Terrain::Terrain( int size_shift,int format ):
+rep( d_new TerrainRep( size_shift,format ) ){
 }
 
 Terrain::~Terrain(){
@@ -20,13 +20,20 @@ void Terrain::setShading( bool t ){
 }
 
 void Terrain::setHeight( int x,int z,float h,bool realtime ){
-	if( x>=0 && z>=0 && x<=rep->getSize() && z<=rep->getSize() ) rep->setHeight( x,z,h,realtime );
+	if( x<0 || z<0 || x>rep->getSize() || z>rep->getSize() ) return;
+	float lo=rep->getMinHeight(),hi=rep->getMaxHeight();
+	rep->setHeight( x,z,h,realtime );
+	if( rep->getMinHeight()!=lo || rep->getMaxHeight()!=hi ) boundsChanged();
 }
 
 int Terrain::getSize()const{
 	return rep->getSize();
 }
 
+int Terrain::getFormat()const{
+	return rep->getFormat();
+}
+
 float Terrain::getHeight( int x,int z )const{
 	return (x>=0 && z>=0 && x<=rep->getSize() && z<=rep->getSize() ) ? rep->getHeight( x,z ) : 0;
 }
@@ -39,3 +46,8 @@ bool Terrain::render( const RenderContext &rc ){
 bool Terrain::collide( const Line &line,float radius,Collision *curr_coll,const Transform &tf ){
 	return rep->collide( line,radius,curr_coll,tf );
 }
+
+bool Terrain::getCollideBounds( Box &box )const{
+	box=Box( Vector( 0,rep->getMinHeight(),0 ),Vector( getSize(),rep->getMaxHeight(),getSize() ) );
+	return true;
+}
@@ -8,7 +8,12 @@ struct TerrainRep;
 
 class Terrain : public Model{
 public:
-	Terrain( int size_shift );
+	//height storage
+	enum{
+		HEIGHTS_8BIT=1,HEIGHTS_16BIT=2,HEIGHTS_FLOAT=3
+	};
+
+	Terrain( int size_shift,int format=HEIGHTS_8BIT );
 	~Terrain();
 
 	Terrain *getTerrain(){ return this; }
@@ -18,6 +23,7 @@ public:
 	void setShading( bool shading );
 
 	int getSize()const;
+	int getFormat()const;
 	float getHeight( int x,int z )const;
 
 	//model interface
@@ -25,6 +31,7 @@ public:
 
 	//object interface
 	bool collide( const Line &line,float radius,Collision *curr_coll,const Transform &tf );
+	bool getCollideBounds( Box &box )const;
 	
 private:
 	TerrainRep *rep;
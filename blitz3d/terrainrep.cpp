@@ -1,115 +1,175 @@
-
 #include "std.h"
 #include "terrainrep.h"
+#include "terrain.h"
 #include <queue>
 
 extern gxRuntime *gx_runtime;
 extern gxGraphics *gx_graphics;
 extern float stats3d[10];
 
-static Vector eye_vec;
-static Plane eye_plane;
 static const Vector up_normal( 0,1,0 );
-static TerrainRep::Tri *tri_pool;
-static const TerrainRep *curr;
-static Frustum frustum;
-static int out_cnt,proc_cnt,clip_cnt;
 
 static float proj_epsilon=EPSILON;	//.01f;
 
-struct TerrainRep::Cell{
-	unsigned char height;
-};
+//renders a view can go unused before its tessellation is thrown away
+static const int VIEW_EXPIRY=256;
+
+//fraction of the way a new vertex moves to its true height each render
+static const float MORPH_STEP=.25f;
 
+//cells are stored in 16x16 tiles
+static const int TILE_SHIFT=4;
+
+//terrains this big have their error hierarchy built by several threads
+static const int PARALLEL_SHIFT=7;
+static const int PARALLEL_LEVEL=8;
+static const int MAX_THREADS=8;
+
+//errors and bounds are stored as steps of 1/err_scale
 struct TerrainRep::Error{
-	unsigned char error,bound;
+	unsigned short error,bound;
 };
 
 int TerrainRep::getSize()const{
 	return cell_size;
 }
 
+int TerrainRep::getFormat()const{
+	return format;
+}
+
+inline int TerrainRep::cellIndex( int x,int z )const{
+	x&=cell_mask;z&=cell_mask;
+	int tile=( (z>>tile_shift)<<(cell_shift-tile_shift) )|( x>>tile_shift );
+	return ( tile<<(tile_shift*2) )|( (z&tile_mask)<<tile_shift )|( x&tile_mask );
+}
+
 float TerrainRep::getHeight( int x,int z )const{
-	return cells[((z&cell_mask)<<cell_shift)|(x&cell_mask)].height/255.0f;
+	int i=cellIndex( x,z );
+	switch( format ){
+	case Terrain::HEIGHTS_16BIT:
+		return ((unsigned short*)cells)[i]*(1/65535.0f);
+	case Terrain::HEIGHTS_FLOAT:
+		return ((float*)cells)[i];
+	}
+	return ((unsigned char*)cells)[i]*(1/255.0f);
+}
+
+unsigned short TerrainRep::quantize( float h )const{
+	float t=ceil( h*err_scale );
+	return t<=0 ? 0 : ( t>=65535 ? 65535 : t );
+}
+
+float TerrainRep::boundHeight( const Error &e )const{
+	return height_lo+e.bound/err_scale;
 }
 
 struct TerrainRep::Vert{
 	short x,z;
 	Vector v;
-	float src_y;
+	float src_y,morph;
 
 	Vert(){
 	}
-	Vert( int x,int z ):x(x),z(z),v( x,curr->getHeight(x,z),z){
+	Vert( const TerrainRep *rep,int x,int z ):x(x),z(z),v( x,rep->getHeight(x,z),z ),morph(1){
 		src_y=v.y;
 	}
-	Vert( int x,int z,float sy ):x(x),z(z),v( x,curr->getHeight(x,z),z ),src_y(sy){
+	Vert( const TerrainRep *rep,int x,int z,float sy ):x(x),z(z),v( x,rep->getHeight(x,z),z ),src_y(sy),morph(0){
 	}
 };
 
-static int vert_cnt,max_verts;
-static TerrainRep::Vert *verts,*next_vert;
-
+//Bintree triangle. Only leaves are drawn; a split leaf keeps its children until
+//it's merged again, so the tessellation carries over from one render to the next.
+//Neighbour pointers are only kept up to date for leaves.
 struct TerrainRep::Tri{
-	int id;
-	short clip,v0,v1,v2;
+	int id,stamp;
+	int v0,v1,v2,mid;
 	Tri *e0,*e1,*e2;
+	Tri *parent,*left,*right;
 	float proj_err;
+	bool visible;
 
-	Tri(){
-	}
-	Tri( int id,int clip,int v0,int v1,int v2,Tri *e0=0,Tri *e1=0,Tri *e2=0 ):
-	id(id),clip(clip),
-	v0(v0),v1(v1),v2(v2),
-	e0(e0),e1(e1),e2(e2),proj_err(0){
-	}
+	bool isLeaf()const{ return !left; }
+	bool hasLeafChildren()const{ return left && !left->left && !right->left; }
 
-	void *operator new( size_t sz ){
-		static const int GROW=64;
-		if( !tri_pool ){
-			tri_pool=new Tri[GROW];
-			for( int k=0;k<GROW-1;++k ) tri_pool[k].e0=&tri_pool[k+1];
-			tri_pool[GROW-1].e0=0;
-		}
-		Tri *t=tri_pool;
-		tri_pool=t->e0;
-		return t;
-	}
-	void operator delete( void *q ){
-		Tri *t=(Tri*)q;
-		t->e0=tri_pool;
-		tri_pool=t;
-	}
-	void unlink(){
-		if( e0 ){
-			if( e0->e0==this ) e0->e0=0;
-			else if( e0->e1==this ) e0->e1=0;
-			else e0->e2=0;
-		}
-		if( e1 ){
-			if( e1->e0==this ) e1->e0=0;
-			else if( e1->e1==this ) e1->e1=0;
-			else e1->e2=0;
-		}
-		if( e2 ){
-			if( e2->e0==this ) e2->e0=0;
-			else if( e2->e1==this ) e2->e1=0;
-			else e2->e2=0;
-		}
+	//points whichever of t's edges referred to from at to
+	static void relink( Tri *t,Tri *from,Tri *to ){
+		if( !t ) return;
+		if( t->e0==from ) t->e0=to;
+		else if( t->e1==from ) t->e1=to;
+		else if( t->e2==from ) t->e2=to;
 	}
 };
 
-struct TriComp{
-	bool operator()( TerrainRep::Tri *a,TerrainRep::Tri *b )const{ return a->proj_err<b->proj_err; }
+//queue entries go stale when their triangle's stamp moves on
+struct TriEntry{
+	float prio;
+	TerrainRep::Tri *tri;
+	int stamp;
+
+	TriEntry( float p,TerrainRep::Tri *t ):prio(p),tri(t),stamp(t->stamp){}
+	bool valid()const{ return stamp==tri->stamp; }
 };
 
-struct TriQue : public priority_queue<TerrainRep::Tri*,vector<TerrainRep::Tri*>,TriComp>{
-	vector<TerrainRep::Tri*> &getVector(){ return c; }
-	const vector<TerrainRep::Tri*> &getVector()const{ return c; }
+struct SplitComp{
+	bool operator()( const TriEntry &a,const TriEntry &b )const{ return a.prio<b.prio; }
 };
 
-static TriQue tri_que;
-static vector<TerrainRep::Tri*> tris;
+struct MergeComp{
+	bool operator()( const TriEntry &a,const TriEntry &b )const{ return a.prio>b.prio; }
+};
+
+//Tessellation for one camera/mirror.
+//
+//Everything render() touches lives here rather than in statics, so different
+//views of the same terrain don't disturb each other's tessellation and could be
+//built at the same time.
+struct TerrainRep::View{
+	const TerrainRep *rep;
+	int last_used,stamp,leaf_cnt;
+	Frustum frustum;
+	Vector eye;
+
+	Tri *roots[2];
+	vector<Tri*> blocks;
+	Tri *free_tris;
+
+	vector<Vert> verts;
+	vector<int> free_verts;
+
+	typedef priority_queue<TriEntry,vector<TriEntry>,SplitComp> SplitQue;
+	typedef priority_queue<TriEntry,vector<TriEntry>,MergeComp> MergeQue;
+	SplitQue split_que;
+	MergeQue merge_que;
+	vector<Tri*> mergeable,visible;
+
+	gxMesh *mesh;
+	int mesh_verts,mesh_tris;
+
+	View( const TerrainRep *rep );
+	~View();
+
+	Tri *allocTri();
+	void freeTri( Tri *t );
+	int allocVert( int x,int z,float src_y );
+
+	void updatePriority( Tri *t );
+	void queueSplit( Tri *t );
+	void queueMerge( Tri *t );
+	bool canMerge( Tri *t )const;
+
+	void splitTri( Tri *t,int mid );
+	void mergeTri( Tri *t );
+	void split( Tri *t );
+	void merge( Tri *t );
+
+	void update( Tri *t );
+	void collect( Tri *t );
+	int remapVert( int n,vector<int> &remap,vector<Vert> &out );
+	void remapVerts( Tri *t,vector<int> &remap,vector<Vert> &out );
+	void compactVerts();
+	void render( Model *model,const RenderContext &rc,int detail );
+};
 
 static bool clip( const Line &l,const Box &box ){
 	static const Vector normals[]={
@@ -135,42 +195,39 @@ static bool clip( const Line &l,const Box &box ){
 	return true;
 }
 
-TerrainRep::TerrainRep( int n ):
+TerrainRep::TerrainRep( int n,int f ):
 cell_shift(n),cell_size(1<<n),cell_mask((1<<n)-1),
-end_tri_id( (1<<n)*(1<<n)*2 ),
-shading(false),mesh(0),detail(0),morph(true){
-	cells=d_new Cell[cell_size*cell_size];
+end_tri_id( (1<<n)*(1<<n)*2 ),format(f),
+shading(false),detail(0),morph(true),render_cnt(0){
+	tile_shift=n<TILE_SHIFT ? n : TILE_SHIFT;
+	tile_mask=(1<<tile_shift)-1;
+	int sz=format==Terrain::HEIGHTS_16BIT ? 2 : ( format==Terrain::HEIGHTS_FLOAT ? 4 : 1 );
+	cells=d_new unsigned char[cell_size*cell_size*sz];
+	cell_bytes=sz;
 	errors=d_new Error[end_tri_id];
 	setDetail( 2000,false );
 	clear();
 }
 
 TerrainRep::~TerrainRep(){
-	if( mesh ) gx_graphics->freeMesh( mesh );
+	for( map<ViewKey,View*>::iterator it=views.begin();it!=views.end();++it ){
+		delete it->second;
+	}
 	delete[] errors;
-	delete[] cells;
+	delete[] (unsigned char*)cells;
 }
 
 void TerrainRep::clear(){
-	memset( cells,0,cell_size*cell_size*sizeof(Cell) );
+	memset( cells,0,cell_size*cell_size*cell_bytes );
 	memset( errors,0,end_tri_id*sizeof(Error) );
+	height_lo=0;height_hi=1;
+	err_scale=65535;
 	errs_valid=true;
 }
 
 void TerrainRep::setDetail( int n,bool m ){
 	morph=m;
-	if( n==detail ) return;
 	detail=n;
-
-	n+=32;
-	if( n>max_verts ){
-		delete[] verts;
-		max_verts=n;
-		verts=new Vert[max_verts];
-	}
-	if( mesh ) gx_graphics->freeMesh( mesh );
-	mesh_verts=mesh_tris=n;
-	mesh=gx_graphics->createMesh( mesh_verts,mesh_tris,0 );
 }
 
 void TerrainRep::setShading( bool t ){
@@ -178,10 +235,28 @@ void TerrainRep::setShading( bool t ){
 }
 
 void TerrainRep::setHeight( int x,int z,float h,bool realtime ){
-	cells[((z&cell_mask)<<cell_shift)|(x&cell_mask)].height=h*255.0f;
+	int i=cellIndex( x,z );
+	switch( format ){
+	case Terrain::HEIGHTS_16BIT:
+		((unsigned short*)cells)[i]=h<=0 ? 0 : ( h>=1 ? 65535 : h*65535.0f+.5f );
+		break;
+	case Terrain::HEIGHTS_FLOAT:
+		((float*)cells)[i]=h;
+		if( h<height_lo || h>height_hi ){
+			//new range, so all the errors need requantizing
+			if( h<height_lo ) height_lo=h;
+			else height_hi=h;
+			err_scale=65535/(height_hi-height_lo);
+			errs_valid=false;
+			return;
+		}
+		break;
+	default:
+		((unsigned char*)cells)[i]=h*255.0f;
+	}
 	if( !errs_valid ) return;
 	if( realtime ){
-		Vert v0(0,0),v1(cell_size,0),v2(cell_size,cell_size),v3(0,cell_size);
+		Vert v0(this,0,0),v1(this,cell_size,0),v2(this,cell_size,cell_size),v3(this,0,cell_size);
 		calcErr( 2,x,z,v1,v2,v0 );
 		calcErr( 3,x,z,v3,v0,v2 );
 		return;
@@ -203,133 +278,348 @@ Vector TerrainRep::getNormal( int x,int z )const{
 		Plane( vt,v0,v3 ).n ).normalized();
 }
 
-void TerrainRep::insert( Tri *t ){
-	++proc_cnt;
-
-	//quicker clip check for 'thin' triangles...
-	if( t->id>=end_tri_id || !errors[t->id].error ){
-		if( t->clip & 63 ){
-			++clip_cnt;
-			Vector e0( verts[t->v0].v ),e1( verts[t->v1].v ),e2( verts[t->v2].v );
-			for( int n=0;n<6;++n ){
-				if( !( t->clip & (1<<n) ) ) continue;
-				const Plane &p=frustum.getPlane( n );
-				if( p.distance(e0)<0 && p.distance(e1)<0 && p.distance(e2)<0 ){
-					t->unlink();
-					delete t;
-					++out_cnt;
-					return;
-				}
-			}
+TerrainRep::View::View( const TerrainRep *rep ):
+rep(rep),last_used(0),stamp(0),leaf_cnt(2),free_tris(0),
+mesh(0),mesh_verts(0),mesh_tris(0){
+	int sz=rep->cell_size;
+	verts.push_back( Vert( rep,0,0 ) );
+	verts.push_back( Vert( rep,sz,0 ) );
+	verts.push_back( Vert( rep,sz,sz ) );
+	verts.push_back( Vert( rep,0,sz ) );
+
+	Tri *t0=roots[0]=allocTri();
+	Tri *t1=roots[1]=allocTri();
+	t0->id=2;t0->v0=1;t0->v1=2;t0->v2=0;
+	t1->id=3;t1->v0=3;t1->v1=0;t1->v2=2;
+	t0->e2=t1;t1->e2=t0;
+}
+
+TerrainRep::View::~View(){
+	if( mesh ) gx_graphics->freeMesh( mesh );
+	for( int k=0;k<blocks.size();++k ) delete[] blocks[k];
+}
+
+TerrainRep::Tri *TerrainRep::View::allocTri(){
+	static const int GROW=64;
+	if( !free_tris ){
+		Tri *b=d_new Tri[GROW];
+		blocks.push_back( b );
+		for( int k=0;k<GROW;++k ){
+			b[k].stamp=0;
+			b[k].parent=k<GROW-1 ? &b[k+1] : 0;
 		}
-		t->clip|=128;
-		tris.push_back( t );
-		++out_cnt;
-		return;
+		free_tris=b;
 	}
+	Tri *t=free_tris;
+	free_tris=t->parent;
+	t->stamp=++stamp;
+	t->mid=-1;
+	t->e0=t->e1=t->e2=0;
+	t->parent=t->left=t->right=0;
+	t->proj_err=0;
+	t->visible=true;
+	return t;
+}
 
-	//clip?
-	if( t->id<end_tri_id/2 && (t->clip & 63) ){
-		++clip_cnt;
-		Vector e0( verts[t->v0].v ),e1( verts[t->v1].v ),e2( verts[t->v2].v );
-		Vector e3(e0),e4(e1),e5(e2);
-		e0.y=e1.y=e2.y=0;
-		e3.y=e4.y=e5.y=errors[t->id].bound/255.0f;
-		for( int n=0;n<6;++n ){
-			int mask=1<<n;
-			if( !(t->clip & mask) ) continue;
-			const Plane &p=frustum.getPlane( n );
-			int q=
-			(p.distance( e0 )>=0)+(p.distance( e1 )>=0)+(p.distance( e2 )>=0)+
-			(p.distance( e3 )>=0)+(p.distance( e4 )>=0)+(p.distance( e5 )>=0);
-			if( !q ){
-				t->unlink();
-				delete t;
-				++out_cnt;
-				return;
-			}
-			if( q==6 ) t->clip&=~mask;
-		}
+void TerrainRep::View::freeTri( Tri *t ){
+	t->stamp=++stamp;
+	t->left=t->right=0;
+	t->parent=free_tris;
+	free_tris=t;
+}
+
+int TerrainRep::View::allocVert( int x,int z,float src_y ){
+	Vert v( rep,x,z,src_y );
+	if( !rep->morph ){
+		v.src_y=v.v.y;
+		v.morph=1;
+	}
+	if( free_verts.size() ){
+		int n=free_verts.back();
+		free_verts.pop_back();
+		verts[n]=v;
+		return n;
 	}
+	verts.push_back( v );
+	return verts.size()-1;
+}
 
-	if( t->clip & 128 ){
-		t->clip|=128;
-		tris.push_back( t );
+void TerrainRep::View::updatePriority( Tri *t ){
+	const Vert &a=verts[t->v0],&b=verts[t->v1],&c=verts[t->v2];
+
+	//clip the prism under the triangle against the frustum
+	float top;
+	if( t->id<rep->end_tri_id ){
+		top=rep->boundHeight( rep->errors[t->id] );
 	}else{
-		Vector v=Vector( verts[t->v1].v+verts[t->v2].v )/2;
-//		float d=eye_plane.distance( v );
-		float d=eye_vec.distance( v );
+		top=a.v.y;
+		if( b.v.y>top ) top=b.v.y;
+		if( c.v.y>top ) top=c.v.y;
+	}
+	float lo=rep->height_lo;
+	Vector e[6]={
+		Vector( a.v.x,lo,a.v.z ),Vector( b.v.x,lo,b.v.z ),Vector( c.v.x,lo,c.v.z ),
+		Vector( a.v.x,top,a.v.z ),Vector( b.v.x,top,b.v.z ),Vector( c.v.x,top,c.v.z )
+	};
+	t->visible=true;
+	for( int n=0;n<6 && t->visible;++n ){
+		const Plane &p=frustum.getPlane( n );
+		int k;
+		for( k=0;k<6 && p.distance( e[k] )<0;++k ){}
+		if( k==6 ) t->visible=false;
+	}
+
+	t->proj_err=0;
+	if( !t->visible || t->id>=rep->end_tri_id ) return;
+	if( int err=rep->errors[t->id].error ){
+		float d=eye.distance( Vector( b.v+c.v )/2 );
 		if( d<EPSILON ) d=EPSILON;
-		t->proj_err=errors[t->id].error/d;
-		if( t->proj_err>proj_epsilon ){
-			tri_que.push( t );
-		}else{
-			t->clip|=128;
-			tris.push_back( t );
-		}
+		t->proj_err=err/(d*rep->err_scale);
 	}
-	++out_cnt;
 }
 
-void TerrainRep::split( Tri *t ){
+void TerrainRep::View::queueSplit( Tri *t ){
+	if( t->proj_err>proj_epsilon ) split_que.push( TriEntry( t->proj_err,t ) );
+}
+
+bool TerrainRep::View::canMerge( Tri *t )const{
+	if( !t->hasLeafChildren() ) return false;
+	return !t->e2 || t->e2->hasLeafChildren();
+}
+
+void TerrainRep::View::queueMerge( Tri *t ){
+	if( !canMerge( t ) ) return;
+	float p=t->proj_err;
+	if( t->e2 && t->e2->proj_err>p ) p=t->e2->proj_err;
+	merge_que.push( TriEntry( p,t ) );
+}
+
+void TerrainRep::View::splitTri( Tri *t,int mid ){
+	Tri *tl=allocTri(),*tr=allocTri();
+
+	tl->id=t->id*2;tl->v0=mid;tl->v1=t->v2;tl->v2=t->v0;
+	tl->e0=tr;tl->e2=t->e0;tl->parent=t;
+	Tri::relink( tl->e2,t,tl );
+
+	tr->id=t->id*2+1;tr->v0=mid;tr->v1=t->v0;tr->v2=t->v1;
+	tr->e1=tl;tr->e2=t->e1;tr->parent=t;
+	Tri::relink( tr->e2,t,tr );
+
+	t->left=tl;t->right=tr;t->mid=mid;
+	t->stamp=++stamp;
+	++leaf_cnt;
+}
+
+void TerrainRep::View::mergeTri( Tri *t ){
+	Tri *tl=t->left,*tr=t->right;
+
+	t->e0=tl->e2;
+	Tri::relink( t->e0,tl,t );
+	t->e1=tr->e2;
+	Tri::relink( t->e1,tr,t );
+
+	freeTri( tl );
+	freeTri( tr );
+	t->left=t->right=0;t->mid=-1;
+	t->stamp=++stamp;
+	--leaf_cnt;
+}
+
+void TerrainRep::View::split( Tri *t ){
 
 	if( t->e2 && t->e2->e2!=t ) split( t->e2 );
 
-	int tv=vert_cnt++;
-	if( tv>=max_verts ){
-		max_verts+=max_verts/2+32;
-		Vert *t=verts;
-		verts=d_new Vert[max_verts];
-		memcpy( verts,t,sizeof(Vert)*tv );
-		next_vert=verts+tv;
-	}
-	Vert *vert=next_vert++;
-	vert->v.x=vert->x=(verts[t->v1].x+verts[t->v2].x)/2;
-	vert->v.z=vert->z=(verts[t->v1].z+verts[t->v2].z)/2;
-	vert->src_y=(verts[t->v1].v.y+verts[t->v2].v.y)/2;
-	vert->v.y=getHeight( vert->x,vert->z );
-
-	Tri *tl=new Tri( t->id*2,t->clip,tv,t->v2,t->v0,0,0,t->e0 );
-	if( Tri *p=tl->e2 ){
-		if( p->e0==t ) p->e0=tl;
-		else if( p->e1==t ) p->e1=tl;
-		else p->e2=tl;
-	}
-	Tri *tr=new Tri( t->id*2+1,t->clip,tv,t->v0,t->v1,0,tl,t->e1 );
-	tl->e0=tr;
-	if( Tri *p=tr->e2 ){
-		if( p->e0==t ) p->e0=tr;
-		else if( p->e1==t ) p->e1=tr;
-		else p->e2=tr;
-	}
+	const Vert &p=verts[t->v1],&q=verts[t->v2];
+	int mid=allocVert( (p.x+q.x)/2,(p.z+q.z)/2,(p.v.y+q.v.y)/2 );
+
+	splitTri( t,mid );
+	Tri *tl=t->left,*tr=t->right;
 
 	if( Tri *b=t->e2 ){
-		Tri *br=new Tri( b->id*2,b->clip,tv,b->v2,b->v0,0,tr,b->e0 );
-		tr->e0=br;
-		if( Tri *p=br->e2 ){
-			if( p->e0==b ) p->e0=br;
-			else if( p->e1==b ) p->e1=br;
-			else p->e2=br;
+		splitTri( b,mid );
+		Tri *br=b->left,*bl=b->right;
+		tl->e1=bl;bl->e0=tl;
+		tr->e0=br;br->e1=tr;
+		updatePriority( bl );queueSplit( bl );
+		updatePriority( br );queueSplit( br );
+	}
+	updatePriority( tl );queueSplit( tl );
+	updatePriority( tr );queueSplit( tr );
+	queueMerge( t );
+}
+
+void TerrainRep::View::merge( Tri *t ){
+	Tri *b=t->e2;
+
+	free_verts.push_back( t->mid );
+	mergeTri( t );
+	queueSplit( t );
+	if( t->parent ) queueMerge( t->parent );
+
+	if( b ){
+		mergeTri( b );
+		queueSplit( b );
+		if( b->parent ) queueMerge( b->parent );
+	}
+}
+
+void TerrainRep::View::update( Tri *t ){
+	updatePriority( t );
+	if( t->isLeaf() ){
+		queueSplit( t );
+		return;
+	}
+	update( t->left );
+	update( t->right );
+	if( t->hasLeafChildren() ) mergeable.push_back( t );
+}
+
+void TerrainRep::View::collect( Tri *t ){
+	if( !t->isLeaf() ){
+		collect( t->left );
+		collect( t->right );
+	}else if( t->visible ){
+		visible.push_back( t );
+	}
+}
+
+int TerrainRep::View::remapVert( int n,vector<int> &remap,vector<Vert> &out ){
+	if( remap[n]<0 ){
+		remap[n]=out.size();
+		out.push_back( verts[n] );
+	}
+	return remap[n];
+}
+
+void TerrainRep::View::remapVerts( Tri *t,vector<int> &remap,vector<Vert> &out ){
+	t->v0=remapVert( t->v0,remap,out );
+	t->v1=remapVert( t->v1,remap,out );
+	t->v2=remapVert( t->v2,remap,out );
+	if( t->isLeaf() ) return;
+	t->mid=remapVert( t->mid,remap,out );
+	remapVerts( t->left,remap,out );
+	remapVerts( t->right,remap,out );
+}
+
+//renumbers the vertices still in use once most are free, so a spike in
+//tessellation doesn't leave every later frame updating the peak vertex count
+void TerrainRep::View::compactVerts(){
+	if( free_verts.size()<256 || free_verts.size()*2<verts.size() ) return;
+
+	vector<int> remap( verts.size(),-1 );
+	vector<Vert> out;
+	out.reserve( verts.size()-free_verts.size() );
+	remapVerts( roots[0],remap,out );
+	remapVerts( roots[1],remap,out );
+	verts.swap( out );
+	free_verts.clear();
+}
+
+void TerrainRep::View::render( Model *model,const RenderContext &rc,int detail ){
+
+	new( &frustum ) Frustum( rc.getWorldFrustum(),-model->getRenderTform() );
+	eye=frustum.getVertex( Frustum::VERT_EYE );
+
+	//reprioritize last render's tessellation for the new eye position
+	int k;
+	split_que=SplitQue();
+	merge_que=MergeQue();
+	mergeable.clear();
+	update( roots[0] );
+	update( roots[1] );
+	for( k=0;k<mergeable.size();++k ) queueMerge( mergeable[k] );
+
+	//merge the least needed diamonds and split the most needed triangles
+	//until the triangle budget is used up
+	for( int n=detail*4+64;n>0;--n ){
+		while( split_que.size() && !split_que.top().valid() ) split_que.pop();
+		while( merge_que.size() && !( merge_que.top().valid() && canMerge( merge_que.top().tri ) ) ) merge_que.pop();
+
+		if( leaf_cnt>detail ){
+			if( !merge_que.size() ) break;
+			Tri *t=merge_que.top().tri;
+			merge_que.pop();
+			merge( t );
+			continue;
+		}
+		if( !split_que.size() ) break;
+		if( leaf_cnt<detail ){
+			Tri *t=split_que.top().tri;
+			split_que.pop();
+			split( t );
+			continue;
+		}
+		if( !merge_que.size() || merge_que.top().prio>=split_que.top().prio ) break;
+		Tri *t=merge_que.top().tri;
+		merge_que.pop();
+		merge( t );
+	}
+
+	compactVerts();
+
+	visible.clear();
+	collect( roots[0] );
+	collect( roots[1] );
+
+	int vert_cnt=verts.size(),tri_cnt=visible.size();
+	if( !tri_cnt ) return;
+
+	if( vert_cnt>mesh_verts || tri_cnt>mesh_tris ){
+		int vc=vert_cnt+32;if( vc>mesh_verts ) mesh_verts=vc;
+		int tc=tri_cnt+32;if( tc>mesh_tris ) mesh_tris=tc;
+		if( detail+32>mesh_verts ) mesh_verts=detail+32;
+		if( detail+32>mesh_tris ) mesh_tris=detail+32;
+		if( mesh ) gx_graphics->freeMesh( mesh );
+		mesh=gx_graphics->createMesh( mesh_verts,mesh_tris,0 );
+	}
+	if( !mesh ) return;
+
+	//move new vertices towards their true heights
+	for( k=0;k<vert_cnt;++k ){
+		Vert &t=verts[k];
+		float y=rep->getHeight( t.x,t.z );
+		if( t.morph<1 ){
+			t.morph+=MORPH_STEP;
+			if( t.morph>1 ) t.morph=1;
+			y=t.src_y+(y-t.src_y)*t.morph;
+		}
+		t.v.y=y;
+	}
+
+	mesh->lock( true );
+	int tc=0,vc=0;
+	if( !rep->shading ){
+		for( k=0;k<vert_cnt;++k ){
+			const Vector &v=verts[k].v;
+			float tex_coords[2][2]={ {v.x,rep->cell_size-v.z},{v.x,rep->cell_size-v.z} };
+			mesh->setVertex( vc++,&v.x,&up_normal.x,tex_coords );
 		}
-		Tri *bl=new Tri( b->id*2+1,b->clip,tv,b->v0,b->v1,tl,br,b->e1 );
-		tl->e1=br->e0=bl;
-		if( Tri *p=bl->e2 ){
-			if( p->e0==b ) p->e0=bl;
-			else if( p->e1==b ) p->e1=bl;
-			else p->e2=bl;
+	}else{
+		for( k=0;k<vert_cnt;++k ){
+			const Vector &v=verts[k].v;
+			float tex_coords[2][2]={ {v.x,rep->cell_size-v.z},{v.x,rep->cell_size-v.z} };
+			Vector normal=rep->getNormal( v.x,v.z );
+			mesh->setVertex( vc++,&v.x,&normal.x,tex_coords );
 		}
-		b->id=0;
-		--out_cnt;
-		insert( br );
-		insert( bl );
 	}
-	t->id=0;
-	--out_cnt;
-	insert( tl );
-	insert( tr );
+	for( k=0;k<tri_cnt;++k ){
+		Tri *t=visible[k];
+		mesh->setTriangle( tc++,t->v0,t->v2,t->v1 );
+	}
+	mesh->unlock();
+
+	static int mvc,mtc;
+	if( vc>mvc ) mvc=vc;
+	if( tc>mtc ) mtc=tc;
+	stats3d[1]=mvc;
+	stats3d[2]=mtc;
+
+	model->enqueue( mesh,0,vc,0,tc );
 }
 
-TerrainRep::Error TerrainRep::calcErr( int id,const Vert &v0,const Vert &v1,const Vert &v2 )const{
+TerrainRep::Error TerrainRep::calcErr( int id,const Vert &v0,const Vert &v1,const Vert &v2,int done_id )const{
+
+	if( id>=done_id && id<end_tri_id ) return errors[id];
 
 	Error et;
 
@@ -338,16 +628,16 @@ TerrainRep::Error TerrainRep::calcErr( int id,const Vert &v0,const Vert &v1,cons
 	if( v2.v.y>y ) y=v2.v.y;
 
 	et.error = 0;
-	et.bound = y>=1 ? 255 : ceil(y*255.0f);
+	et.bound = quantize( y-height_lo );
 
 	if( id>=end_tri_id ) return et;
 
-	Vert tv( (v1.x+v2.x)/2,(v1.z+v2.z)/2 );
+	Vert tv( this,(v1.x+v2.x)/2,(v1.z+v2.z)/2 );
 	float e=fabs(tv.v.y-(v1.v.y+v2.v.y)/2);
-	et.error= e>=1 ? 255 : ceil( (e-EPSILON)*255.0f );
+	et.error= quantize( e-EPSILON );
 
-	Error el=calcErr( id*2,tv,v2,v0 );
-	Error er=calcErr( id*2+1,tv,v0,v1 );
+	Error el=calcErr( id*2,tv,v2,v0,done_id );
+	Error er=calcErr( id*2+1,tv,v0,v1,done_id );
 
 	if( el.error>et.error ) et.error=el.error;
 	if( er.error>et.error ) et.error=er.error;
@@ -367,7 +657,7 @@ TerrainRep::Error TerrainRep::calcErr( int id,int x,int z,const Vert &v0,const V
 	if( v2.v.y>y ) y=v2.v.y;
 
 	et.error = 0;
-	et.bound = y>=1 ? 255 : ceil(y*255.0f);
+	et.bound = quantize( y-height_lo );
 
 	if( id>=end_tri_id ) return et;
 
@@ -380,9 +670,9 @@ TerrainRep::Error TerrainRep::calcErr( int id,int x,int z,const Vert &v0,const V
 	dx=-(v0.z-v2.z);dz=(v0.x-v2.x);
 	if( (x-v2.x)*dx+(z-v2.z)*dz<0 ) return errors[id];
 
-	Vert tv( (v1.x+v2.x)/2,(v1.z+v2.z)/2 );
+	Vert tv( this,(v1.x+v2.x)/2,(v1.z+v2.z)/2 );
 	float e=fabs(tv.v.y-(v1.v.y+v2.v.y)/2);
-	et.error= e>=1 ? 255 : ceil( (e-EPSILON)*255.0f );
+	et.error= quantize( e-EPSILON );
 
 	Error el=calcErr( id*2,x,z,tv,v2,v0 );
 	Error er=calcErr( id*2+1,x,z,tv,v0,v1 );
@@ -396,118 +686,98 @@ TerrainRep::Error TerrainRep::calcErr( int id,int x,int z,const Vert &v0,const V
 	return errors[id]=et;
 }
 
-void TerrainRep::validateErrs()const{
-	if( errs_valid ) return;
-	Vert v0(0,0),v1(cell_size,0),v2(cell_size,cell_size),v3(0,cell_size);
-	calcErr( 2,v1,v2,v0 );
-	calcErr( 3,v3,v0,v2 );
-	errs_valid=true;
-}
-
-void TerrainRep::render( Model *model,const RenderContext &rc ){
-
-	curr=this;
-	validateErrs();
-
-	new( &frustum ) Frustum( rc.getWorldFrustum(),-model->getRenderTform() );
-	eye_plane=frustum.getPlane( Frustum::PLANE_NEAR );
-	eye_vec=frustum.getVertex( Frustum::VERT_EYE );
-
-	vert_cnt=4;next_vert=verts;
-	out_cnt=proc_cnt=clip_cnt=0;
-	tri_que.getVector().clear();
-	tris.clear();
-
-	new(next_vert++) Vert(0,0);
-	new(next_vert++) Vert(cell_size,0);
-	new(next_vert++) Vert(cell_size,cell_size);
-	new(next_vert++) Vert(0,cell_size);
-
-	Tri *t0=new Tri( 2,0x3f,1,2,0 );
-	Tri *t1=new Tri( 3,0x3f,3,0,2 );
-	t0->e2=t1;t1->e2=t0;
-
-	insert( t0 );
-	insert( t1 );
-
-	while( tri_que.size() && out_cnt<detail ){
-
-		Tri *t=tri_que.top();
-		tri_que.pop();
-		if( t->id ) split( t );
-		delete t;
-	}
-
-	int k;
-	const vector<Tri*> &q_tris=tri_que.getVector();
+//Subtrees of the error hierarchy, shared out between threads.
+//
+//Each subtree only writes its own errors, and as the hierarchy is stored a level
+//at a time the errors of a subtree are in one contiguous run per level.
+struct TerrainRep::ErrTask{
+	struct Job{
+		int id;
+		Vert v0,v1,v2;
+	};
 
-	if( !mesh ) out_cnt=0;
+	const TerrainRep *rep;
+	vector<Job> jobs;
+	volatile LONG next;
 
-	if( !out_cnt ){
-		for( k=0;k<tris.size();++k ) delete tris[k];
-		for( k=0;k<q_tris.size();++k ) delete q_tris[k];
-		return;
+	void collect( int id,const Vert &v0,const Vert &v1,const Vert &v2,int level_id ){
+		if( id>=level_id ){
+			Job job={ id,v0,v1,v2 };
+			jobs.push_back( job );
+			return;
+		}
+		Vert tv( rep,(v1.x+v2.x)/2,(v1.z+v2.z)/2 );
+		collect( id*2,tv,v2,v0,level_id );
+		collect( id*2+1,tv,v0,v1,level_id );
 	}
 
-	int err_cnt=0;
-	for( k=0;k<q_tris.size();++k ){
-		Tri *t=q_tris[k];
-		if( t->id ){ tris.push_back( t );++err_cnt; }
-		else delete t;
+	static DWORD WINAPI run( void *p ){
+		ErrTask *task=(ErrTask*)p;
+		for(;;){
+			int n=InterlockedIncrement( &task->next )-1;
+			if( n>=task->jobs.size() ) return 0;
+			const Job &job=task->jobs[n];
+			task->rep->calcErr( job.id,job.v0,job.v1,job.v2,task->rep->end_tri_id );
+		}
 	}
+};
 
-	if( morph ){
-		if( int morph_cnt=err_cnt/4 ){
-			if( morph_cnt>vert_cnt ) morph_cnt=vert_cnt;
-			float t=0,morph_step=1.0f/morph_cnt;
-			for( int vn=vert_cnt-morph_cnt;vn<vert_cnt;++vn ){
-				verts[vn].v.y+=(verts[vn].src_y-verts[vn].v.y)*t;
-				t+=morph_step;
-			}
+void TerrainRep::validateErrs()const{
+	if( errs_valid ) return;
+	Vert v0(this,0,0),v1(this,cell_size,0),v2(this,cell_size,cell_size),v3(this,0,cell_size);
+
+	//big terrains do the levels below PARALLEL_LEVEL on all cores first
+	int done_id=end_tri_id;
+	if( cell_shift>=PARALLEL_SHIFT ){
+		ErrTask task;
+		task.rep=this;
+		task.next=0;
+		done_id=1<<PARALLEL_LEVEL;
+		task.collect( 2,v1,v2,v0,done_id );
+		task.collect( 3,v3,v0,v2,done_id );
+
+		SYSTEM_INFO si;
+		GetSystemInfo( &si );
+		int n=si.dwNumberOfProcessors;
+		if( n>MAX_THREADS ) n=MAX_THREADS;
+
+		vector<HANDLE> threads;
+		for( int k=1;k<n;++k ){
+			DWORD id;
+			if( HANDLE t=CreateThread( 0,0,ErrTask::run,&task,0,&id ) ) threads.push_back( t );
+		}
+		ErrTask::run( &task );
+		if( threads.size() ){
+			WaitForMultipleObjects( threads.size(),&threads[0],TRUE,INFINITE );
+			for( int k=0;k<threads.size();++k ) CloseHandle( threads[k] );
 		}
 	}
 
-	int tri_cnt=tris.size();
+	calcErr( 2,v1,v2,v0,done_id );
+	calcErr( 3,v3,v0,v2,done_id );
+	errs_valid=true;
+}
 
-	if( vert_cnt>mesh_verts || tri_cnt>mesh_tris ){
-		int vc=vert_cnt+32;if( vc>mesh_verts ) mesh_verts=vc;
-		int tc=tri_cnt+32;if( tc>mesh_tris ) mesh_tris=tc;
-		if( mesh ) gx_graphics->freeMesh( mesh );
-		mesh=gx_graphics->createMesh( mesh_verts,mesh_tris,0 );
-	}
+void TerrainRep::render( Model *model,const RenderContext &rc ){
 
-	mesh->lock( true );
-	int tc=0,vc=0;
-	if( !shading ){
-		for( k=0;k<vert_cnt;++k ){
-			const Vert &t=verts[k];
-			const Vector &v=t.v;
-			float tex_coords[2][2]={ {v.x,cell_size-v.z},{v.x,cell_size-v.z} };
-			mesh->setVertex( vc++,&v.x,&up_normal.x,tex_coords );
-		}
-	}else{
-		for( k=0;k<vert_cnt;++k ){
-			const Vert &t=verts[k];
-			const Vector &v=t.v;
-			float tex_coords[2][2]={ {v.x,cell_size-v.z},{v.x,cell_size-v.z} };
-			Vector normal=getNormal( v.x,v.z );
-			mesh->setVertex( vc++,&v.x,&normal.x,tex_coords );
+	validateErrs();
+
+	//forget views that have stopped rendering this terrain
+	++render_cnt;
+	map<ViewKey,View*>::iterator it=views.begin();
+	while( it!=views.end() ){
+		if( render_cnt-it->second->last_used>VIEW_EXPIRY ){
+			delete it->second;
+			views.erase( it++ );
+		}else{
+			++it;
 		}
 	}
-	for( k=0;k<tri_cnt;++k ){
-		Tri *t=tris[k];
-		if( t->id ) mesh->setTriangle( tc++,t->v0,t->v2,t->v1 );
-		delete t;
-	}
-	mesh->unlock();
 
-	static int mvc,mtc;
-	if( vc>mvc ) mvc=vc;
-	if( tc>mtc ) mtc=tc;
-	stats3d[1]=mvc;
-	stats3d[2]=mtc;
-
-	model->enqueue( mesh,0,vc,0,tc );
+	View *&v=views[ ViewKey( rc.getCamera(),rc.getMirror() ) ];
+	if( !v ) v=d_new View( this );
+	v->last_used=render_cnt;
+	v->render( model,rc,detail );
 }
 
 bool TerrainRep::collide( const Line &line,Collision *curr_coll,const Transform &tform,int id,const Vert &v0,const Vert &v1,const Vert &v2,const Line &l )const{
@@ -521,11 +791,11 @@ bool TerrainRep::collide( const Line &line,Collision *curr_coll,const Transform
 		: false;
 	}
 
-	b.a.y=0;
-	b.b.y=errors[id].bound/255.0f;
+	b.a.y=height_lo;
+	b.b.y=boundHeight( errors[id] );
 	if( !::clip( l,b ) ) return false;
 
-	Vert tv( (v1.x+v2.x)/2,(v1.z+v2.z)/2 );
+	Vert tv( this,(v1.x+v2.x)/2,(v1.z+v2.z)/2 );
 
 	return
 	collide( line,curr_coll,tform,id*2,tv,v2,v0,l )|
@@ -546,11 +816,11 @@ bool TerrainRep::collide( const Line &line,float radius,Collision *curr_coll,con
 		: false;
 	}
 
-	b.a.y=0;
-	b.b.y=errors[id].bound/255.0f;
+	b.a.y=height_lo;
+	b.b.y=boundHeight( errors[id] );
 	if( !b.overlaps( box ) ) return false;
 
-	Vert tv( (v1.x+v2.x)/2,(v1.z+v2.z)/2 );
+	Vert tv( this,(v1.x+v2.x)/2,(v1.z+v2.z)/2 );
 	return
 	collide( line,radius,curr_coll,tform,id*2,tv,v2,v0,box )|
 	collide( line,radius,curr_coll,tform,id*2+1,tv,v0,v1,box );
@@ -558,10 +828,9 @@ bool TerrainRep::collide( const Line &line,float radius,Collision *curr_coll,con
 
 bool TerrainRep::collide( const Line &line,float radius,Collision *curr_coll,const Transform &tform )const{
 
-	curr=this;
 	validateErrs();
 
-	Vert v0(0,0),v1(cell_size,0),v2(cell_size,cell_size),v3(0,cell_size);
+	Vert v0(this,0,0),v1(this,cell_size,0),v2(this,cell_size,cell_size),v3(this,0,cell_size);
 
 	if( !radius ){
 		Line l=-tform * line;
@@ -8,7 +8,7 @@
 
 struct TerrainRep{
 public:
-	TerrainRep( int cell_shift );
+	TerrainRep( int cell_shift,int format );
 	~TerrainRep();
 	
 	void clear();
@@ -19,34 +19,46 @@ public:
 	void render( Model *model,const RenderContext &rc );
 
 	int getSize()const;
+	int getFormat()const;
 	float getHeight( int x,int z )const;
+	float getMinHeight()const{ return height_lo; }
+	float getMaxHeight()const{ return height_hi; }
 	bool collide( const Line &line,float radius,Collision *curr_coll,const Transform &tform )const;
 
 	struct Tri;
 	struct Vert;
+	struct View;
 
 private:
-	struct Cell;
 	struct Error;
+	struct ErrTask;
 
 	friend struct Tri;
 	friend struct Vert;
+	friend struct View;
+	friend struct ErrTask;
 
-	Cell *cells;
+	//tessellations are kept per camera/mirror pair
+	typedef pair<const void*,const void*> ViewKey;
+
+	void *cells;
 	Error *errors;
-	gxMesh *mesh;
+	map<ViewKey,View*> views;
 
-	int cell_size,cell_shift,cell_mask;
-	int end_tri_id,detail,mesh_verts,mesh_tris;
+	int cell_size,cell_shift,cell_mask,cell_bytes;
+	int tile_shift,tile_mask;
+	int end_tri_id,detail,render_cnt,format;
+	float height_lo,height_hi,err_scale;
 	bool morph,shading;
 	mutable bool errs_valid;
 
-	void insert( Tri *t );
-	void split( Tri *t );
+	int cellIndex( int x,int z )const;
+	unsigned short quantize( float h )const;
+	float boundHeight( const Error &e )const;
 
 	void validateErrs()const;
 	Vector getNormal( int x,int z )const;
-	Error calcErr( int id,const Vert &v0,const Vert &v1,const Vert &v2 )const;
+	Error calcErr( int id,const Vert &v0,const Vert &v1,const Vert &v2,int done_id )const;
 	Error calcErr( int id,int x,int z,const Vert &v0,const Vert &v1,const Vert &v2 )const;
 	bool collide( const Line &line,Collision *curr_coll,const Transform &tform,int id,const Vert &v0,const Vert &v1,const Vert &v2,const Line &l )const;
 	bool collide( const Line &line,float radius,Collision *curr_coll,const Transform &tform,int id,const Vert &v0,const Vert &v1,const Vert &v2,const Box &box )const;
@@ -184,6 +184,14 @@ int Texture::getFlags()const{
 	return rep ? rep->tex_flags : 0;
 }
 
+bool Texture::getCoords( float pos[2],float scl[2],float *rot )const{
+	if( !rep || !rep->mat_used ) return false;
+	pos[0]=rep->tx;pos[1]=rep->ty;
+	scl[0]=rep->sx;scl[1]=rep->sy;
+	*rot=rep->rot;
+	return true;
+}
+
 DWORD Texture::getBumpEnvMat(int x, int y)const {
 	return rep ? rep->bumpEnvMat[x][y] : 0;
 }
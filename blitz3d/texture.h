@@ -33,6 +33,7 @@ public:
 	const gxScene::Matrix *getMatrix()const;
 	int getBlend()const;
 	int getFlags()const;
+	bool getCoords( float pos[2],float scl[2],float *rot )const;
 	DWORD getBumpEnvMat(int x, int y)const;
 	DWORD getBumpEnvScale()const;
 	DWORD getBumpEnvOffset()const;
@@ -2,24 +2,110 @@
 #include "std.h"
 #include <queue>
 #include "world.h"
+#include "objecttree.h"
+#include "surface.h"
 
 //0=tris compared for collision
 //1=max proj err of terrain
+//3=render boxes frustum tested
+//4=models passing frustum test
+//5=update time in ms
+//6=render setup time in ms - enumerating, tweening, sorting and refitting
+//7=camera render time in ms - culling, queues and drawing
 float stats3d[10];
 
+static double milliSecs(){
+	static double scale;
+	if( !scale ){
+		LARGE_INTEGER f;
+		QueryPerformanceFrequency( &f );
+		scale=1000.0/f.QuadPart;
+	}
+	LARGE_INTEGER t;
+	QueryPerformanceCounter( &t );
+	return t.QuadPart*scale;
+}
+
 extern gxScene *gx_scene;
 extern gxRuntime *gx_runtime;
 
-static vector<Object*> _enabled,_visible;
+//only rebuilt when an entity is created, destroyed, reparented, shown/hidden, enabled/disabled or has its pick mode changed
+static vector<Object*> _enabled,_visible,_pickable;
+static int enabled_changes=-1,visible_changes=-1;
 
 static void enumEnabled(){
+	if( enabled_changes==Entity::enabledChanges() ) return;
+	enabled_changes=Entity::enabledChanges();
+
 	_enabled.clear();
 	for( Entity *e=Entity::orphans();e;e=e->successor() ){
 		e->enumEnabled( _enabled );
 	}
+	_pickable.clear();
+	for( int k=0;k<_enabled.size();++k ){
+		if( _enabled[k]->getPickGeometry() ) _pickable.push_back( _enabled[k] );
+	}
+}
+
+//world bounds of an object's pick geometry
+static bool pickBounds( Object *obj,Box &box ){
+	const Transform &tf=obj->getWorldTform();
+	switch( obj->getPickGeometry() ){
+	case World::COLLISION_METHOD_SPHERE:
+		box=Box( tf.v );
+		box.expand( obj->getCollisionRadii().x );
+		return true;
+	case World::COLLISION_METHOD_BOX:{
+		Transform t=tf;
+		t.m.i.normalize();t.m.j.normalize();t.m.k.normalize();
+		box=t * obj->getCollisionBox();
+		return true;
+		}
+	case World::COLLISION_METHOD_CAPSULE:
+		box=Box( tf * obj->getCapsulePointA() );
+		box.update( tf * obj->getCapsulePointB() );
+		box.expand( obj->getCapsuleRadius() );
+		return true;
+	case World::COLLISION_METHOD_POLYGON:{
+		Box b;
+		if( !obj->getCollideBounds( b ) ) return false;
+		box=b.empty() ? b : tf * b;
+		return true;
+		}
+	}
+	return false;
+}
+
+static ObjectTree pick_tree( pickBounds );
+static int pick_enabled=-1,pick_geom=-1;
+static vector<Entity*> pick_moved;
+
+static void invalidatePicks( Entity *e ){
+	if( Object *o=e->getObject() ) pick_tree.invalidate( o );
+	for( Entity *c=e->children();c;c=c->successor() ) invalidatePicks( c );
+}
+
+//rebuilds the pick tree if the pickable set changed, else refits whatever moved.
+//mesh geometry changes aren't tracked per mesh, so they refit everything.
+static void updatePickTree(){
+	enumEnabled();
+	Entity::takeMoved( pick_moved );
+	if( pick_enabled!=enabled_changes ){
+		pick_tree.build( _pickable );
+	}else if( pick_geom!=Surface::geomChanges() ){
+		pick_tree.refit();
+	}else{
+		for( int k=0;k<pick_moved.size();++k ) invalidatePicks( pick_moved[k] );
+		pick_tree.refitInvalid();
+	}
+	pick_enabled=enabled_changes;
+	pick_geom=Surface::geomChanges();
 }
 
 static void enumVisible(){
+	if( visible_changes==Entity::visibleChanges() ) return;
+	visible_changes=Entity::visibleChanges();
+
 	_visible.clear();
 	for( Entity *e=Entity::orphans();e;e=e->successor() ){
 		e->enumVisible( _visible );
@@ -108,49 +194,67 @@ bool World::hitTest( const Line &line,float radius,Object *obj,const Transform &
 	return false;
 }
 
-bool World::checkLOS( Object *src,Object *dest ){
+struct PickQuery{
+	World *world;
+	const Line *line;
+	float radius;
+	Object *src,*dest;
+	Collision coll;
+	Object *hit;
+};
 
-	enumEnabled();
+static bool visitLOS( Object *obj,void *ctx ){
+	PickQuery *q=(PickQuery*)ctx;
+	if( obj==q->src || obj==q->dest || !obj->getObscurer() ) return false;
+	if( !q->world->hitTest( *q->line,0,obj,obj->getWorldTform(),obj->getPickGeometry(),&q->coll ) ) return false;
+	q->hit=obj;
+	return true;
+}
 
-	Object *coll_obj=0;
-	Collision curr_coll;
+static bool visitPick( Object *obj,void *ctx ){
+	PickQuery *q=(PickQuery*)ctx;
+	if( q->world->hitTest( *q->line,q->radius,obj,obj->getWorldTform(),obj->getPickGeometry(),&q->coll ) ){
+		q->hit=obj;
+	}
+	return false;
+}
 
-	Line line( src->getWorldPosition(),dest->getWorldPosition()-src->getWorldPosition() );
+bool World::checkLOS( Object *src,Object *dest ){
 
-	vector<Object*>::const_iterator it;
+	updatePickTree();
 
-	for( it=_enabled.begin();it!=_enabled.end();++it ){
-		Object *obj=*it;
+	Line line( src->getWorldPosition(),dest->getWorldPosition()-src->getWorldPosition() );
 
-		if( obj==src || obj==dest || !obj->getPickGeometry() || !obj->getObscurer() ) continue;
+	PickQuery q;
+	q.world=this;q.line=&line;q.radius=0;q.src=src;q.dest=dest;q.hit=0;
+	pick_tree.trace( line,0,&q.coll.time,visitLOS,&q );
 
-		if( hitTest( line,0,obj,obj->getWorldTform(),obj->getPickGeometry(),&curr_coll ) ){
-			return false;
-		}
-	}
-	return true;
+	return !q.hit;
 }
 
 Object *World::traceRay( const Line &line,float radius,ObjCollision *curr_coll ){
 
-	enumEnabled();
-
-	Object *coll_obj=0;
-
-	vector<Object*>::const_iterator it;
-	for( it=_enabled.begin();it!=_enabled.end();++it ){
-		Object *obj=*it;
+	updatePickTree();
 
-		if( !obj->getPickGeometry() ) continue;
+	PickQuery q;
+	q.world=this;q.line=&line;q.radius=radius;q.src=q.dest=0;q.hit=0;
+	q.coll=curr_coll->collision;
+	pick_tree.trace( line,radius,&q.coll.time,visitPick,&q );
 
-		if( hitTest( line,radius,obj,obj->getWorldTform(),obj->getPickGeometry(),&curr_coll->collision ) ){
-			coll_obj=obj;
-		}
+	if( curr_coll->with=q.hit ){
+		curr_coll->collision=q.coll;
+		curr_coll->coords=line*q.coll.time-q.coll.normal*radius;
 	}
-	if( curr_coll->with=coll_obj ){
-		curr_coll->coords=line*curr_coll->collision.time-curr_coll->collision.normal*radius;
+	return q.hit;
+}
+
+int World::traceRays( const Line *lines,int n,float radius,ObjCollision *colls ){
+	int hits=0;
+	for( int k=0;k<n;++k ){
+		colls[k].collision=Collision();
+		if( traceRay( lines[k],radius,&colls[k] ) ) ++hits;
 	}
-	return coll_obj;
+	return hits;
 }
 
 //
@@ -477,6 +581,7 @@ void World::collide( Object *src ){
 
 void World::update(float elapsed) {
 	stats3d[0] = 0;
+	double start = milliSecs();
 
 	for (size_t i = 0; i < used_colls.size(); ++i) {
 		if (used_colls[i]) {
@@ -486,6 +591,7 @@ void World::update(float elapsed) {
 	used_colls.clear();
 
 	enumEnabled();
+	Entity::updateWorldTforms();
 
 	for (int k = 0; k < 1000; ++k) {
 		_objsByType[k].clear();
@@ -522,6 +628,7 @@ void World::update(float elapsed) {
 			}
 		}
 	}
+	stats3d[5] = milliSecs() - start;
 }
 
 /****************************** Render *********************************/
@@ -538,11 +645,10 @@ struct OrderComp{
 	}
 };
 
+//furthest first
 struct TransComp{
-	bool operator()( Model *a,Model *b )const{
-		return 
-		cam_tform.v.distance( a->getRenderTform().v )<
-		cam_tform.v.distance( b->getRenderTform().v );
+	bool operator()( const pair<float,Model*> &a,const pair<float,Model*> &b )const{
+		return a.first>b.first;
 	}
 };
 
@@ -552,11 +658,48 @@ static priority_queue<Model*,vector<Model*>,OrderComp> ord_que;
 
 static priority_queue<Camera*,vector<Camera*>,OrderComp> cam_que;
 
-static priority_queue<Model*,vector<Model*>,TransComp> transparents;
+//sorted by squared distance from camera when flushed
+static vector<pair<float,Model*> > transparents;
+
+//unordered models with opaque queues, rendered together sorted by state
+static vector<Model*> opaque_mods;
+
+//world render box of a model
+static bool renderBounds( Object *obj,Box &box ){
+	Model *mod=obj->getModel();
+	Box b;
+	if( !mod || !mod->getRenderBounds( b ) ) return false;
+	box=b.empty() ? b : mod->getRenderTform() * b;
+	return true;
+}
+
+//unordered models, culled a subtree at a time
+static ObjectTree render_tree( renderBounds );
+static vector<Object*> render_objs,next_render_objs;
+static vector<Model*> in_view;
+
+static void updateRenderTree(){
+	next_render_objs.clear();
+	for( int k=0;k<unord_mods.size();++k ) next_render_objs.push_back( unord_mods[k] );
+	if( next_render_objs!=render_objs ){
+		render_objs.swap( next_render_objs );
+		render_tree.build( render_objs );
+	}else{
+		//render tforms are tweened every frame
+		render_tree.refit();
+	}
+}
+
+static void cullModel( Object *obj,bool inside,void *ctx ){
+	Model *mod=obj->getModel();
+	mod->setInView( inside );
+	in_view.push_back( mod );
+}
 
 void World::capture(){
 
 	enumVisible();
+	Entity::updateWorldTforms();
 
 	vector<Object*>::const_iterator it;
 	for( it=_visible.begin();it!=_visible.end();++it ){
@@ -566,20 +709,22 @@ void World::capture(){
 
 void World::render( float tween ){
 
+	double start=milliSecs();
+
 	//set render tweens, and build ordered and unordered model lists...
 	ord_mods.clear();
 	unord_mods.clear();
 
-	_visible.clear();
 	_lights.clear();
 	_mirrors.clear();
 	_listeners.clear();
 
 	while (!ord_que.empty()) ord_que.pop();
 	while (!cam_que.empty()) cam_que.pop();
-	while (!transparents.empty()) transparents.pop();
+	transparents.clear();
 
 	enumVisible();
+	Entity::updateWorldTforms();
 
 	for (auto it = _visible.begin(); it != _visible.end(); ++it) {
 		Object* o = *it;
@@ -621,6 +766,13 @@ void World::render( float tween ){
 		ord_que.pop();
 	}
 
+	updateRenderTree();
+	stats3d[3]=stats3d[4]=0;
+
+	double draw=milliSecs();
+	stats3d[6]=draw-start;
+	stats3d[7]=0;
+
 	if (!gx_scene || !gx_scene->begin(_lights)) {
 		gx_runtime->debugLog("Failed to begin render session");
 		return;
@@ -643,6 +795,7 @@ void World::render( float tween ){
 		}
 
 		gx_scene->end();
+		stats3d[7]=milliSecs()-draw;
 
 		for (auto lis_it = _listeners.begin(); lis_it != _listeners.end(); ++lis_it) {
 			if (*lis_it) (*lis_it)->renderListener();
@@ -674,7 +827,7 @@ void World::render( Camera *cam,Mirror *mirror ){
 	gx_scene->setViewMatrix( (gxScene::Matrix*)&(-cam_tform) );
 
 	//initialize render context
-	RenderContext rc( cam_tform,cam->getFrustum(),mirror!=0 );
+	RenderContext rc( cam_tform,cam->getFrustum(),cam,mirror );
 
 	//draw everything in order
 	int ord=0;
@@ -687,11 +840,16 @@ void World::render( Camera *cam,Mirror *mirror ){
 	}
 
 	gx_scene->setZMode( gxScene::ZMODE_NORMAL );
-	for( int k=0;k<unord_mods.size();++k ){
-		Model *mod=unord_mods[k];
-		if( !mod->doAutoFade( cam_tform.v ) ) continue;
-		render( mod,rc );
-	}
+	in_view.clear();
+	stats3d[3]+=render_tree.cull( rc.getWorldFrustum(),cullModel,0 );
+	stats3d[4]+=in_view.size();
+	for( int k=0;k<in_view.size();++k ){
+		Model *mod=in_view[k];
+		if( mod->doAutoFade( cam_tform.v ) ) render( mod,rc,true );
+		mod->setInView( false );
+	}
+	Model::renderQueues( opaque_mods,Model::QUEUE_OPAQUE );
+	opaque_mods.clear();
 	gx_scene->setZMode( gxScene::ZMODE_CMPONLY );
 	flushTransparent();
 
@@ -705,12 +863,19 @@ void World::render( Camera *cam,Mirror *mirror ){
 }
 
 void World::render(Model* mod, const RenderContext& rc) {
+	render(mod, rc, false);
+}
+
+void World::render(Model* mod, const RenderContext& rc, bool batch) {
 	if (!mod) return;
 
 	try {
 		bool trans = mod->render(rc);
 
-		if (mod->queueSize(Model::QUEUE_OPAQUE)) {
+		if (batch && mod->batchable() && mod->queueSize(Model::QUEUE_OPAQUE)) {
+			opaque_mods.push_back(mod);
+		}
+		else if (mod->queueSize(Model::QUEUE_OPAQUE)) {
 			if (mod->getRenderSpace() == Model::RENDER_SPACE_LOCAL) {
 				gx_scene->setWorldMatrix((gxScene::Matrix*)&mod->getRenderTform());
 			}
@@ -721,7 +886,8 @@ void World::render(Model* mod, const RenderContext& rc) {
 		}
 
 		if (trans || mod->queueSize(Model::QUEUE_TRANSPARENT)) {
-			transparents.push(mod);
+			const Vector d = mod->getRenderTform().v - cam_tform.v;
+			transparents.push_back(make_pair(d.dot(d), mod));
 		}
 	}
 	catch (...) {
@@ -733,9 +899,10 @@ void World::flushTransparent() {
 	bool local = true;
 
 	try {
-		while (!transparents.empty()) {
-			Model* mod = transparents.top();
-			transparents.pop();
+		sort(transparents.begin(), transparents.end(), TransComp());
+
+		for (size_t k = 0; k < transparents.size(); ++k) {
+			Model* mod = transparents[k].second;
 
 			if (!mod) continue;
 
@@ -754,4 +921,5 @@ void World::flushTransparent() {
 	catch (...) {
 		gx_runtime->debugLog("Warning: Failed to flush transparent objects");
 	}
+	transparents.clear();
 }
\ No newline at end of file
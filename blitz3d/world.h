@@ -38,6 +38,8 @@ public:
 	bool checkLOS( Object *src,Object *dest );
 	bool hitTest( const Line &line,float radius,Object *obj,const Transform &tf,int method,Collision *curr_coll  );
 	Object *traceRay( const Line &line,float radius,ObjCollision *curr_coll );
+	//returns number of rays that hit something
+	int traceRays( const Line *lines,int n,float radius,ObjCollision *colls );
 
 private:
 	struct CollInfo{
@@ -50,6 +52,7 @@ private:
 	void collide( Object *src );
 	void render( Camera *c,Mirror *m );
 	void render( Model *m,const RenderContext &rc );
+	void render( Model *m,const RenderContext &rc,bool batch );
 	void flushTransparent();
 
 };
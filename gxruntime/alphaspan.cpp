@@ -0,0 +1,98 @@
+
+#include "std.h"
+#include "alphaspan.h"
+
+#include <emmintrin.h>
+
+static bool sse2=IsProcessorFeaturePresent( PF_XMMI64_INSTRUCTIONS_AVAILABLE ) ? true : false;
+
+int alphaSpanFormat( int depth,unsigned amask,unsigned rmask,unsigned gmask,unsigned bmask ){
+	switch( depth ){
+	case 32:
+		if( rmask!=0xff0000 || gmask!=0xff00 || bmask!=0xff ) break;
+		if( amask==0xff000000 ) return SPAN_ARGB32;
+		if( !amask ) return SPAN_XRGB32;
+		break;
+	case 16:
+		if( amask ) break;
+		if( rmask==0xf800 && gmask==0x07e0 && bmask==0x001f ) return SPAN_RGB565;
+		if( rmask==0x7c00 && gmask==0x03e0 && bmask==0x001f ) return SPAN_RGB555;
+		break;
+	}
+	return SPAN_NONE;
+}
+
+//exact x/255 for x<=255*255
+static inline unsigned div255( unsigned x ){
+	return (x+1+(x>>8))>>8;
+}
+
+static inline __m128i div255( __m128i x ){
+	return _mm_srli_epi16( _mm_add_epi16( _mm_add_epi16( x,_mm_srli_epi16( x,8 ) ),_mm_set1_epi16( 1 ) ),8 );
+}
+
+//source channels are premultiplied once per span, source alpha counts as 255
+static void span32( unsigned *p,int n,unsigned argb,int alpha,unsigned keep ){
+	int inv=255-alpha;
+	unsigned sa=255*alpha,sr=((argb>>16)&255)*alpha,sg=((argb>>8)&255)*alpha,sb=(argb&255)*alpha;
+
+	int k=0;
+	if( sse2 ){
+		__m128i src=_mm_set_epi16( (short)sa,(short)sr,(short)sg,(short)sb,(short)sa,(short)sr,(short)sg,(short)sb );
+		__m128i vinv=_mm_set1_epi16( inv ),vkeep=_mm_set1_epi32( keep ),zero=_mm_setzero_si128();
+		for( ;k+4<=n;k+=4 ){
+			__m128i d=_mm_loadu_si128( (__m128i*)(p+k) );
+			__m128i lo=div255( _mm_add_epi16( src,_mm_mullo_epi16( _mm_unpacklo_epi8( d,zero ),vinv ) ) );
+			__m128i hi=div255( _mm_add_epi16( src,_mm_mullo_epi16( _mm_unpackhi_epi8( d,zero ),vinv ) ) );
+			_mm_storeu_si128( (__m128i*)(p+k),_mm_and_si128( _mm_packus_epi16( lo,hi ),vkeep ) );
+		}
+	}
+	for( ;k<n;++k ){
+		unsigned d=p[k];
+		p[k]=(
+			div255( sa+(d>>24)*inv )<<24 |
+			div255( sr+((d>>16)&255)*inv )<<16 |
+			div255( sg+((d>>8)&255)*inv )<<8 |
+			div255( sb+(d&255)*inv ) ) & keep;
+	}
+}
+
+//channels are expanded to the top of a byte, as PixelFormat::toARGB does
+template<int RSH,int GSH,int GMASK>
+static void span16( unsigned short *p,int n,unsigned argb,int alpha ){
+	int inv=255-alpha;
+	unsigned sr=((argb>>16)&255)*alpha,sg=((argb>>8)&255)*alpha,sb=(argb&255)*alpha;
+
+	int k=0;
+	if( sse2 ){
+		__m128i vr=_mm_set1_epi16( (short)sr ),vg=_mm_set1_epi16( (short)sg ),vb=_mm_set1_epi16( (short)sb );
+		__m128i vinv=_mm_set1_epi16( inv ),m8=_mm_set1_epi16( 0xf8 ),gm=_mm_set1_epi16( GMASK );
+		for( ;k+8<=n;k+=8 ){
+			__m128i d=_mm_loadu_si128( (__m128i*)(p+k) );
+			__m128i r=div255( _mm_add_epi16( vr,_mm_mullo_epi16( _mm_and_si128( _mm_srli_epi16( d,RSH ),m8 ),vinv ) ) );
+			__m128i g=div255( _mm_add_epi16( vg,_mm_mullo_epi16( _mm_and_si128( _mm_srli_epi16( d,GSH ),gm ),vinv ) ) );
+			__m128i b=div255( _mm_add_epi16( vb,_mm_mullo_epi16( _mm_and_si128( _mm_slli_epi16( d,3 ),m8 ),vinv ) ) );
+			r=_mm_slli_epi16( _mm_and_si128( r,m8 ),RSH );
+			g=_mm_slli_epi16( _mm_and_si128( g,gm ),GSH );
+			b=_mm_srli_epi16( b,3 );
+			_mm_storeu_si128( (__m128i*)(p+k),_mm_or_si128( _mm_or_si128( r,g ),b ) );
+		}
+	}
+	for( ;k<n;++k ){
+		unsigned d=p[k];
+		unsigned r=div255( sr+((d>>RSH)&0xf8)*inv );
+		unsigned g=div255( sg+((d>>GSH)&GMASK)*inv );
+		unsigned b=div255( sb+((d<<3)&0xf8)*inv );
+		p[k]=((r&0xf8)<<RSH)|((g&GMASK)<<GSH)|(b>>3);
+	}
+}
+
+void alphaSpan( int format,void *p,int n,unsigned argb,int alpha ){
+	if( n<=0 || alpha<=0 ) return;
+	switch( format ){
+	case SPAN_ARGB32:span32( (unsigned*)p,n,argb,alpha,0xffffffff );break;
+	case SPAN_XRGB32:span32( (unsigned*)p,n,argb,alpha,0x00ffffff );break;
+	case SPAN_RGB565:span16<8,3,0xfc>( (unsigned short*)p,n,argb,alpha );break;
+	case SPAN_RGB555:span16<7,2,0xf8>( (unsigned short*)p,n,argb,alpha );break;
+	}
+}
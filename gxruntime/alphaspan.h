@@ -0,0 +1,23 @@
+
+#ifndef ALPHASPAN_H
+#define ALPHASPAN_H
+
+//Alpha blended horizontal spans over locked surface memory.
+//
+//Each colour channel becomes (src*alpha+dest*(255-alpha))/255 and dest alpha
+//becomes alpha+dest_alpha*(255-alpha)/255, the same as a pixel at a time
+//through PixelFormat but without the decode/encode calls.
+enum{
+	SPAN_NONE,		//no fast path for this format
+	SPAN_ARGB32,	//8 bits per channel
+	SPAN_XRGB32,	//8 bits per channel, unused top byte kept 0
+	SPAN_RGB565,
+	SPAN_RGB555		//unused top bit kept 0
+};
+
+int alphaSpanFormat( int depth,unsigned amask,unsigned rmask,unsigned gmask,unsigned bmask );
+
+//blends n pixels from p onwards with the rgb part of argb
+void alphaSpan( int format,void *p,int n,unsigned argb,int alpha );
+
+#endif
@@ -0,0 +1,86 @@
+
+#include "std.h"
+#include "bitmask.h"
+
+#include <emmintrin.h>
+
+static bool sse2=IsProcessorFeaturePresent( PF_XMMI64_INSTRUCTIONS_AVAILABLE ) ? true : false;
+
+//bit reversed bytes, movemask puts the leftmost pixel in the bottom bit
+static unsigned char rev8[256];
+
+static bool initRev8(){
+	for( int k=0;k<256;++k ){
+		int r=0;
+		for( int b=0;b<8;++b ) if( k & (1<<b) ) r|=0x80>>b;
+		rev8[k]=r;
+	}
+	return true;
+}
+
+static bool rev8_init=initRev8();
+
+//16 pixels to 16 bits, leftmost in the top bit
+static inline unsigned reverse16( unsigned bits ){
+	return (rev8[bits&255]<<8)|rev8[bits>>8];
+}
+
+static void maskWords32( const unsigned *src,int words,unsigned rgbmask,unsigned key,unsigned *dest ){
+	int k=0;
+	if( sse2 ){
+		__m128i vmask=_mm_set1_epi32( rgbmask ),vkey=_mm_set1_epi32( key );
+		for( ;k<words;++k ){
+			unsigned word=0;
+			for( int h=0;h<2;++h ){
+				const __m128i *p=(const __m128i*)src;
+				__m128i e0=_mm_cmpeq_epi32( _mm_and_si128( _mm_loadu_si128( p ),vmask ),vkey );
+				__m128i e1=_mm_cmpeq_epi32( _mm_and_si128( _mm_loadu_si128( p+1 ),vmask ),vkey );
+				__m128i e2=_mm_cmpeq_epi32( _mm_and_si128( _mm_loadu_si128( p+2 ),vmask ),vkey );
+				__m128i e3=_mm_cmpeq_epi32( _mm_and_si128( _mm_loadu_si128( p+3 ),vmask ),vkey );
+				__m128i eq=_mm_packs_epi16( _mm_packs_epi32( e0,e1 ),_mm_packs_epi32( e2,e3 ) );
+				word=(word<<16)|reverse16( ~_mm_movemask_epi8( eq ) & 0xffff );
+				src+=16;
+			}
+			*dest++=word;
+		}
+		return;
+	}
+	for( ;k<words;++k ){
+		unsigned word=0;
+		for( int x=0;x<32;++x ) word=(word<<1)|((*src++ & rgbmask)!=key);
+		*dest++=word;
+	}
+}
+
+static void maskWords16( const unsigned short *src,int words,unsigned rgbmask,unsigned key,unsigned *dest ){
+	int k=0;
+	if( sse2 ){
+		__m128i vmask=_mm_set1_epi16( (short)rgbmask ),vkey=_mm_set1_epi16( (short)key );
+		for( ;k<words;++k ){
+			unsigned word=0;
+			for( int h=0;h<2;++h ){
+				const __m128i *p=(const __m128i*)src;
+				__m128i e0=_mm_cmpeq_epi16( _mm_and_si128( _mm_loadu_si128( p ),vmask ),vkey );
+				__m128i e1=_mm_cmpeq_epi16( _mm_and_si128( _mm_loadu_si128( p+1 ),vmask ),vkey );
+				word=(word<<16)|reverse16( ~_mm_movemask_epi8( _mm_packs_epi16( e0,e1 ) ) & 0xffff );
+				src+=16;
+			}
+			*dest++=word;
+		}
+		return;
+	}
+	for( ;k<words;++k ){
+		unsigned word=0;
+		for( int x=0;x<32;++x ) word=(word<<1)|((*src++ & rgbmask)!=key);
+		*dest++=word;
+	}
+}
+
+bool bitMaskWords( int depth,const void *src,int words,unsigned rgbmask,unsigned key,unsigned *dest ){
+	key&=rgbmask;
+	switch( depth ){
+	case 32:maskWords32( (const unsigned*)src,words,rgbmask,key,dest );return true;
+	case 16:maskWords16( (const unsigned short*)src,words,rgbmask,key,dest );return true;
+	}
+	return false;
+}
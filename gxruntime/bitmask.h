@@ -0,0 +1,12 @@
+
+#ifndef BITMASK_H
+#define BITMASK_H
+
+//Collision mask words from surface memory.
+//
+//Each word covers 32 pixels, leftmost pixel in the top bit. A bit is set where
+//(pixel & rgbmask)!=key. Only 16 and 32 bit pixels are handled - returns false
+//for other depths, leaving dest untouched.
+bool bitMaskWords( int depth,const void *src,int words,unsigned rgbmask,unsigned key,unsigned *dest );
+
+#endif
@@ -8,6 +8,7 @@
 extern gxRuntime *gx_runtime;
 
 #include "..\freeimage\freeimage.h"
+#include "..\freeimage\LibPNG\png.h"
 
 static AsmCoder asm_coder;
 
@@ -59,7 +60,7 @@ void PixelFormat::setFormat( const DDPIXELFORMAT &pf ){
 
 static void adjustTexSize( int *width,int *height,IDirect3DDevice7 *dir3dDev ){
     D3DDEVICEDESC7 ddDesc={0};
-	if( dir3dDev->GetCaps( &ddDesc )<0 ){
+	if( dir3dDev && dir3dDev->GetCaps( &ddDesc )<0 ){
 		*width=*height=256;
 		return;
 	}
@@ -289,7 +290,9 @@ ddSurf *ddUtil::createSurface( int w,int h,int flags,gxGraphics *gfx ){
 	if( flags & gxCanvas::CANVAS_TEXTURE ){
 		desc.ddsCaps.dwCaps|=DDSCAPS_TEXTURE;
 		if( !(flags & gxCanvas::CANVAS_TEX_VIDMEM) ){
-			desc.ddsCaps.dwCaps2|=DDSCAPS2_TEXTUREMANAGE;
+			//headless graphics have no device to manage textures
+			if( gfx->headless ) desc.ddsCaps.dwCaps|=DDSCAPS_SYSTEMMEMORY;
+			else desc.ddsCaps.dwCaps2|=DDSCAPS2_TEXTUREMANAGE;
 			if( flags & gxCanvas::CANVAS_TEX_MIPMAP ){
 				desc.ddsCaps.dwCaps|=DDSCAPS_MIPMAP|DDSCAPS_COMPLEX;
 			}
@@ -329,32 +332,27 @@ ddSurf *ddUtil::createSurface( int w,int h,int flags,gxGraphics *gfx ){
 
 //Tom Speed's DXTC loader
 //
-IDirectDrawSurface7 *loadDXTC(const char* filename,gxGraphics *gfx)
+//reads from a copy of the file in memory, so the file itself can be read on
+//another thread
+IDirectDrawSurface7 *loadDXTC(const char *data,int size,gxGraphics *gfx)
 {
 	HRESULT hr;
 	DDSURFACEDESC2 ddsd;
 	DDSURFACEDESC2 fileddsd;
-	char magicID[4];
-	FILE *fp;
-
-	/* try to open the file */
-	fp = fopen(filename, "rb");
-	if(!fp) return NULL;
+	const char *end=data+size;
 
 	/* valid DDS? */
-	fread(magicID, 1, 4, fp);
-	if (strncmp(magicID, "DDS ", 4) != 0)
+	if (size < 4+(int)sizeof(DDSURFACEDESC2) || strncmp(data, "DDS ", 4) != 0)
 	{
-		fclose(fp);
 		return NULL;
 	}
 
 	/* get the DXTC file surface description */
-	fread(&fileddsd, sizeof(DDSURFACEDESC2), 1, fp);
+	memcpy(&fileddsd, data+4, sizeof(DDSURFACEDESC2));
+	data+=4+sizeof(DDSURFACEDESC2);
 
 	if (fileddsd.dwSize != sizeof(DDSURFACEDESC2))
 	{
-		fclose(fp);
 		return NULL;
 	}
 
@@ -379,12 +377,12 @@ IDirectDrawSurface7 *loadDXTC(const char* filename,gxGraphics *gfx)
 	/* if it isn't a format we support, exit */
 	if (blockSize == 0)
 	{
-		fclose(fp);
 		return NULL;
 	}
 
 	/* add texture manage flag */
-	ddsd.ddsCaps.dwCaps2|=DDSCAPS2_TEXTUREMANAGE;
+	if( gfx->headless ) ddsd.ddsCaps.dwCaps|=DDSCAPS_SYSTEMMEMORY;
+	else ddsd.ddsCaps.dwCaps2|=DDSCAPS2_TEXTUREMANAGE;
 
 	/* Create the new DXTC surface using the DDSURFACEDESC2
 	we read in from the file */
@@ -392,7 +390,6 @@ IDirectDrawSurface7 *loadDXTC(const char* filename,gxGraphics *gfx)
 	hr = gfx->dirDraw->CreateSurface(&ddsd, &newSurf, NULL);
 	if(FAILED(hr))
 	{
-		fclose(fp);
 		return NULL;
 	}
 
@@ -415,25 +412,24 @@ IDirectDrawSurface7 *loadDXTC(const char* filename,gxGraphics *gfx)
 		hr = topDDS->Lock(NULL,&ddsd,DDLOCK_WAIT,NULL);
 		if(FAILED(hr))
 		{
-			fclose(fp);
 			topDDS->Release();
 			newSurf->Release();
-			nextDDS->Release();
 			return NULL;
 		}
 
 		/* how big the raw data is for this surface */
 		chunkSize = ((ddsd.dwWidth+3)/4) * ((ddsd.dwHeight+3)/4) * blockSize;
 
-		/* read in the raw DXTC surface data */
-		if(!fread(ddsd.lpSurface, chunkSize, 1, fp))
+		/* copy in the raw DXTC surface data */
+		if(chunkSize > end-data)
 		{
-			fclose(fp);
+			topDDS->Unlock(NULL);
 			topDDS->Release();
 			newSurf->Release();
-			nextDDS->Release();
 			return NULL;
 		}
+		memcpy(ddsd.lpSurface, data, chunkSize);
+		data+=chunkSize;
 		topDDS->Unlock(NULL);
 
 
@@ -441,7 +437,6 @@ IDirectDrawSurface7 *loadDXTC(const char* filename,gxGraphics *gfx)
 		hr = topDDS->GetAttachedSurface(&mipmapddsd,&nextDDS);
 		if(FAILED(hr))
 		{
-			fclose(fp);
 			topDDS->Release();
 			break;
 		}
@@ -454,16 +449,50 @@ IDirectDrawSurface7 *loadDXTC(const char* filename,gxGraphics *gfx)
 	return newSurf;
 }
 
-ddSurf *ddUtil::loadSurface( const std::string &f,int flags,gxGraphics *gfx ){
+//dds files are kept as the raw file and only turned into a surface by loadSurface
+struct ddUtil::Image{
+	FIBITMAP *dib;
+	bool trans;
+	vector<char> dds;
+};
 
+static bool isDDS( const string &f ){
 	int i=f.find( ".dds" );
-	if( i!=string::npos && i+4==f.size() ){
-		//dds file!
-		ddSurf *surf=loadDXTC( f.c_str(),gfx );
-		return surf;
-	}
+	return i!=string::npos && i+4==f.size();
+}
 
+void ddUtil::initImages(){
+	static bool init;
+	if( init ) return;
 	FreeImage_Initialise();
+	init=true;
+}
+
+static ddUtil::Image *readDDS( const string &f ){
+	FILE *fp=fopen( f.c_str(),"rb" );
+	if( !fp ) return 0;
+	fseek( fp,0,SEEK_END );
+	int sz=ftell( fp );
+	fseek( fp,0,SEEK_SET );
+
+	ddUtil::Image *img=0;
+	if( sz>4 ){
+		img=d_new ddUtil::Image;
+		img->dib=0;
+		img->trans=false;
+		img->dds.resize( sz );
+		if( fread( &img->dds[0],sz,1,fp )!=1 ){
+			delete img;
+			img=0;
+		}
+	}
+	fclose( fp );
+	return img;
+}
+
+ddUtil::Image *ddUtil::decodeImage( const std::string &f ){
+	if( isDDS( f ) ) return readDDS( f );
+
 	FREE_IMAGE_FORMAT fmt=FreeImage_GetFileType( f.c_str(),f.size() );
 	if( fmt==FIF_UNKNOWN ){
 		int n=f.find( "." );if( n==string::npos ) return 0;
@@ -480,16 +509,206 @@ ddSurf *ddUtil::loadSurface( const std::string &f,int flags,gxGraphics *gfx ){
 	if( dib ) FreeImage_Unload( t_dib );
 	else dib=t_dib;
 
+	Image *img=d_new Image;
+	img->dib=dib;
+	img->trans=trans;
+	return img;
+}
+
+void ddUtil::freeImage( Image *img ){
+	if( !img ) return;
+	if( img->dib ) FreeImage_Unload( img->dib );
+	delete img;
+}
+
+static bool isExt( const string &f,const char *ext ){
+	int n=strlen( ext );
+	return f.size()>n && !_stricmp( f.c_str()+f.size()-n,ext );
+}
+
+//FreeImage only gives us 8 bits per channel, so pngs go straight to libpng
+static float *decodePNGHeights( const string &f,int *width,int *height,int *bits ){
+	FILE *fp=fopen( f.c_str(),"rb" );
+	if( !fp ) return 0;
+
+	unsigned char sig[8];
+	png_structp png=0;
+	png_infop info=0;
+	if( fread( sig,1,8,fp )==8 && !png_sig_cmp( sig,0,8 ) ){
+		if( png=png_create_read_struct( PNG_LIBPNG_VER_STRING,0,0,0 ) ){
+			if( !(info=png_create_info_struct( png )) ) png_destroy_read_struct( &png,0,0 );
+		}
+	}
+	if( !info ){
+		fclose( fp );
+		return 0;
+	}
+
+	unsigned char *volatile data=0;
+	png_bytep *volatile rows=0;
+	if( setjmp( png->jmpbuf ) ){
+		png_destroy_read_struct( &png,&info,0 );
+		delete[] data;
+		delete[] rows;
+		fclose( fp );
+		return 0;
+	}
+
+	png_init_io( png,fp );
+	png_set_sig_bytes( png,8 );
+	png_read_info( png,info );
+
+	png_uint_32 w,h;
+	int depth,type;
+	png_get_IHDR( png,info,&w,&h,&depth,&type,0,0,0 );
+	if( type==PNG_COLOR_TYPE_PALETTE ) png_set_palette_to_rgb( png );
+	else if( depth<8 ) png_set_gray_1_2_4_to_8( png );
+	if( type & PNG_COLOR_MASK_ALPHA ) png_set_strip_alpha( png );
+	if( depth==16 ) png_set_swap( png );
+	png_read_update_info( png,info );
+
+	//tRNS chunks are expanded to alpha, so skip that if it's there
+	int chans=png_get_channels( png,info ),colors=chans>=3 ? 3 : 1;
+	int pitch=png_get_rowbytes( png,info );
+	data=d_new unsigned char[pitch*h];
+	rows=d_new png_bytep[h];
+	for( int y=0;y<h;++y ) rows[y]=data+pitch*y;
+	png_read_image( png,rows );
+	png_read_end( png,0 );
+	png_destroy_read_struct( &png,&info,0 );
+	fclose( fp );
+
+	float *heights=d_new float[w*h];
+	for( int y=0;y<h;++y ){
+		float *out=heights+(h-1-y)*w;
+		if( depth==16 ){
+			unsigned short *p=(unsigned short*)rows[y];
+			for( int x=0;x<w;++x ){
+				unsigned short t=p[0];
+				for( int k=1;k<colors;++k ) if( p[k]>t ) t=p[k];
+				out[x]=t/65535.0f;
+				p+=chans;
+			}
+		}else{
+			unsigned char *p=rows[y];
+			for( int x=0;x<w;++x ){
+				unsigned char t=p[0];
+				for( int k=1;k<colors;++k ) if( p[k]>t ) t=p[k];
+				out[x]=t/255.0f;
+				p+=chans;
+			}
+		}
+	}
+	delete[] data;
+	delete[] rows;
+
+	*width=w;*height=h;*bits=depth==16 ? 16 : 8;
+	return heights;
+}
+
+static float *decodeRawHeights( const string &f,int *width,int *height,int *bits ){
+	FILE *fp=fopen( f.c_str(),"rb" );
+	if( !fp ) return 0;
+	fseek( fp,0,SEEK_END );
+	int sz=ftell( fp );
+	fseek( fp,0,SEEK_SET );
+
+	int n=sqrt( sz/2.0 )+.5,depth=16;
+	if( n*n*2!=sz ){
+		n=sqrt( (double)sz )+.5;depth=8;
+		if( n*n!=sz ) n=0;
+	}
+	if( !n ){
+		fclose( fp );
+		return 0;
+	}
+
+	unsigned char *data=d_new unsigned char[sz];
+	bool ok=fread( data,sz,1,fp )==1;
+	fclose( fp );
+	if( !ok ){
+		delete[] data;
+		return 0;
+	}
+
+	float *heights=d_new float[n*n];
+	for( int y=0;y<n;++y ){
+		float *out=heights+(n-1-y)*n;
+		if( depth==16 ){
+			unsigned char *p=data+y*n*2;
+			for( int x=0;x<n;++x ) out[x]=(p[x*2]|(p[x*2+1]<<8))/65535.0f;
+		}else{
+			unsigned char *p=data+y*n;
+			for( int x=0;x<n;++x ) out[x]=p[x]/255.0f;
+		}
+	}
+	delete[] data;
+
+	*width=*height=n;*bits=depth;
+	return heights;
+}
+
+float *ddUtil::decodeHeights( const std::string &f,int *width,int *height,int *bits ){
+	if( isExt( f,".raw" ) || isExt( f,".r16" ) ) return decodeRawHeights( f,width,height,bits );
+	if( isExt( f,".png" ) ) return decodePNGHeights( f,width,height,bits );
+
+	initImages();
+	Image *img=decodeImage( f );
+	if( !img ) return 0;
+	//dds files and images FreeImage couldn't convert to 32 bits
+	if( !img->dib || FreeImage_GetBPP( img->dib )!=32 ){
+		freeImage( img );
+		return 0;
+	}
+
+	FIBITMAP *dib=img->dib;
+	int w=FreeImage_GetWidth( dib ),h=FreeImage_GetHeight( dib );
+	float *heights=d_new float[w*h];
+	for( int y=0;y<h;++y ){
+		//scanline 0 is the bottom row
+		unsigned char *p=FreeImage_GetScanLine( dib,y );
+		float *out=heights+y*w;
+		for( int x=0;x<w;++x ){
+			int r=p[2],g=p[1],b=p[0];
+			out[x]=(r>g?(r>b?r:b):(g>b?g:b))/255.0f;
+			p+=4;
+		}
+	}
+	freeImage( img );
+
+	*width=w;*height=h;*bits=8;
+	return heights;
+}
+
+ddSurf *ddUtil::loadSurface( const std::string &f,int flags,gxGraphics *gfx ){
+
+	initImages();
+	Image *img=decodeImage( f );
+	if( !img ) return 0;
+
+	ddSurf *surf=loadSurface( img,flags,gfx );
+	freeImage( img );
+	return surf;
+}
+
+//note: this modifies the image's pixels, so an image can only be loaded once
+ddSurf *ddUtil::loadSurface( Image *img,int flags,gxGraphics *gfx ){
+
+	if( !img->dib ){
+		//dds file!
+		return loadDXTC( &img->dds[0],img->dds.size(),gfx );
+	}
+
+	FIBITMAP *dib=img->dib;
+	bool trans=img->trans;
+
 	int width=FreeImage_GetWidth(dib);
 	int height=FreeImage_GetHeight(dib);
 	int pitch=FreeImage_GetPitch(dib);
 	void *bits=FreeImage_GetBits(dib);
 
 	ddSurf *src=::createSurface( width,height,pitch,bits,gfx->dirDraw );
-	if( !src ){
-		FreeImage_Unload( dib );
-		return 0;
-	}
+	if( !src ) return 0;
 
 	if( flags & gxCanvas::CANVAS_TEX_ALPHA ){
 		if( flags & gxCanvas::CANVAS_TEX_MASK ){
@@ -511,7 +730,6 @@ ddSurf *ddUtil::loadSurface( const std::string &f,int flags,gxGraphics *gfx ){
 	ddSurf *dest=createSurface( width,height,flags,gfx );
 	if( !dest ){
 		src->Release();
-		FreeImage_Unload( dib );
 		return 0;
 	}
 
@@ -520,6 +738,5 @@ ddSurf *ddUtil::loadSurface( const std::string &f,int flags,gxGraphics *gfx ){
 	copy( dest,0,0,t_w,t_h,src,0,height-1,width,-height );
 
 	src->Release();
-	FreeImage_Unload( dib );
 	return dest;
 }
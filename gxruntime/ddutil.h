@@ -9,10 +9,26 @@ typedef IDirectDrawSurface7 ddSurf;
 
 struct ddUtil{
 
+	//an image decoded into memory but not yet turned into a surface
+	struct Image;
+
 	static void buildMipMaps( ddSurf *surf );
 	static void copy( ddSurf *dest,int dx,int dy,int dw,int dh,ddSurf *src,int sx,int sy,int sw,int sh );
 	static ddSurf *loadSurface( const std::string &f,int flags,gxGraphics *gfx );
+	static ddSurf *loadSurface( Image *img,int flags,gxGraphics *gfx );
 	static ddSurf *createSurface( int width,int height,int flags,gxGraphics *gfx );
+
+	//decodeImage doesn't touch DirectDraw, so it may be called from any thread once initImages has been called.
+	//.dds files are only read into memory, and become compressed surfaces in loadSurface.
+	static void initImages();
+	static Image *decodeImage( const std::string &f );
+	static void freeImage( Image *img );
+
+	//Decodes a heightmap into heights from 0 to 1, bottom row first. bits is set to the precision
+	//of the source - 8 or 16. 16 bit greyscale/RGB pngs keep their full precision, and .raw/.r16
+	//files are read as headerless square 8 or 16 bit (little endian) heightmaps, top row first.
+	//Returns 0 for formats it can't read directly, such as .dds, which need loading as a canvas.
+	static float *decodeHeights( const std::string &f,int *width,int *height,int *bits );
 };
 
 class PixelFormat{
@@ -147,7 +147,7 @@ private:
 	FMUSIC_MODULE *module;
 };
 
-static set<gxSound*> sound_set;
+static ptrset<gxSound> sound_set;
 static vector<gxChannel*> channels;
 static map<string,StaticChannel*> songs;
 static CDChannel *cdChannel;
@@ -236,6 +236,18 @@ gxSound *gxAudio::loadSound( const string &f,bool use3d ){
 	return sound;
 }
 
+gxSound *gxAudio::loadSound( const void *data,int size,bool use3d ){
+
+	int flags=FSOUND_NORMAL | FSOUND_LOADMEMORY | (use3d ? FSOUND_FORCEMONO : FSOUND_2D);
+
+	FSOUND_SAMPLE *sample=FSOUND_Sample_Load( FSOUND_FREE,(const char*)data,flags,0,size );
+	if( !sample ) return 0;
+
+	gxSound *sound=d_new gxSound( this,sample );
+	sound_set.insert( sound );
+	return sound;
+}
+
 gxSound *gxAudio::verifySound( gxSound *s ){
 	return sound_set.count( s )  ? s : 0;
 }
@@ -31,6 +31,7 @@ public:
 	};
 
 	gxSound *loadSound( const std::string &filename,bool use_3d );
+	gxSound *loadSound( const void *data,int size,bool use_3d );
 	gxSound *verifySound( gxSound *sound );
 	void freeSound( gxSound *sound );
 
@@ -4,6 +4,8 @@
 #include "gxgraphics.h"
 #include "gxruntime.h"
 #include "asmcoder.h"
+#include "alphaspan.h"
+#include "bitmask.h"
 #include "gxutf8.h"
 
 #define DEBUG_BITMASK
@@ -39,6 +41,15 @@ static void calcShifts( unsigned mask,unsigned char *shr,unsigned char *shl ){
 	}else *shr=*shl=0;
 }
 
+//largest n with n*n<=v
+static int isqrt( int v ){
+	if( v<=0 ) return 0;
+	int n=(int)sqrt( (double)v );
+	while( n*n>v ) --n;
+	while( (n+1)*(n+1)<=v ) ++n;
+	return n;
+}
+
 struct Rect : public RECT{
 	Rect(){
 	}
@@ -139,11 +150,17 @@ t_surf(0),cm_mask(0),locked_cnt(0),mod_cnt(0),remip_cnt(0){
 	DDSURFACEDESC2 desc={sizeof(desc)};
 	surf->GetSurfaceDesc( &desc );
 	format.setFormat( desc.ddpfPixelFormat );
+	span_format=SPAN_NONE;
+	if( desc.ddpfPixelFormat.dwFlags & DDPF_RGB ){
+		const DDPIXELFORMAT &pf=desc.ddpfPixelFormat;
+		span_format=alphaSpanFormat( pf.dwRGBBitCount,pf.dwRGBAlphaBitMask,pf.dwRBitMask,pf.dwGBitMask,pf.dwBBitMask );
+	}
 
 	clip_rect.left=clip_rect.top=0;
 	clip_rect.right=desc.dwWidth;
 	clip_rect.bottom=desc.dwHeight;
 	cm_pitch=(clip_rect.right+31)/32+1;
+	cm_dirty.left=cm_dirty.right=cm_dirty.top=cm_dirty.bottom=0;
 	setMask( 0 );
 	setColor( ~0 );
 	setClsColor( 0 );
@@ -210,47 +227,75 @@ bool gxCanvas::clip( RECT *d,RECT *s )const{
 	return ::clip( viewport,d,s );
 }
 
-void gxCanvas::updateBitMask( const RECT &r )const{
+//32 pixels the slow way, n<32 only for the part word at the right edge
+static unsigned maskWord( const PixelFormat &format,unsigned char *src,int n,unsigned mask_argb ){
+	unsigned mask=0;
+	for( int x=0;x<n;++x ){
+		unsigned pix=format.getPixel(src) & 0xffffff;
+		mask=(mask<<1)|(pix!=mask_argb);
+		src+=format.getPitch();
+	}
+	return n<32 ? mask<<(32-n) : mask;
+}
 
-	int w=r.right-r.left;if( w<=0 ) return;
-	int h=r.bottom-r.top;if( h<=0 ) return;
+void gxCanvas::updateBitMask( const RECT &r )const{
 
-	lock();
 	RECT t=r;
-	t.left&=~31;
-	t.right=(t.right+31)&~31;
-	w=(t.right-t.left)/32;
-	unsigned char *src_row=locked_surf+t.top*locked_pitch+t.left*format.getPitch();
-	unsigned *dest_row=cm_mask+t.top*cm_pitch+t.left/32;
+	if( !::clip( clip_rect,&t ) ) return;
+
+	//whole mask words, never reading past the right edge of the image
+	int first=t.left/32,last=(t.right+31)/32,full=clip_rect.right/32;
+	int n=(last<full ? last : full)-first,part=clip_rect.right-full*32;
+
+	if( !lock() ) return;
+	int pitch=format.getPitch();
+	unsigned char *src_row=locked_surf+t.top*locked_pitch+first*32*pitch;
+	unsigned *dest_row=cm_mask+t.top*cm_pitch+first;
 	unsigned mask_argb=format.toARGB( mask_surf ) & 0xffffff;
+	unsigned rgbmask=format.fromARGB( 0xffffff );
 
 #ifdef DEBUG_BITMASK
-	unsigned *cm_mask_end=cm_mask+cm_pitch*clip_rect.bottom;
+	if( dest_row<cm_mask || dest_row+(t.bottom-t.top-1)*cm_pitch+last-first>cm_mask+cm_pitch*clip_rect.bottom ){
+		gx_runtime->debugError( "gxCanvas::updateBitMask dest out of range" );
+	}
 #endif
 
-	while( h-- ){
-		unsigned *dest=dest_row;
-		unsigned char *src=src_row;
-		for( int c=0;c<w;++c ){
-			unsigned mask=0;
-			for( int x=0;x<32;++x ){
-				unsigned pix=format.getPixel(src) & 0xffffff;
-				mask=(mask<<1)|(pix!=mask_argb);
-				src+=format.getPitch();
-			}
-#ifdef DEBUG_BITMASK
-			if( dest<cm_mask || dest>=cm_mask_end ){
-				gx_runtime->debugError( "gxCanvas::updateBitMask dest out of range" );
-			}
-#endif
-			*dest++=mask;
+	for( int y=t.top;y<t.bottom;++y ){
+		if( n>0 && !bitMaskWords( format.getDepth(),src_row,n,rgbmask,mask_surf,dest_row ) ){
+			for( int c=0;c<n;++c ) dest_row[c]=maskWord( format,src_row+c*32*pitch,32,mask_argb );
 		}
+		if( last>full ) dest_row[full-first]=maskWord( format,src_row+(full-first)*32*pitch,part,mask_argb );
 		dest_row+=cm_pitch;
 		src_row+=locked_pitch;
 	}
 	unlock();
 }
 
+//brings the mask up to date with everything damaged since it was last used
+void gxCanvas::validateBitMask()const{
+	if( !cm_mask ){
+		cm_mask=d_new unsigned[cm_pitch*clip_rect.bottom];
+		memset( cm_mask,0,cm_pitch*clip_rect.bottom*4 );
+		cm_dirty=clip_rect;
+	}
+	if( cm_dirty.left<cm_dirty.right && cm_dirty.top<cm_dirty.bottom ){
+		updateBitMask( cm_dirty );
+		cm_dirty.left=cm_dirty.right=cm_dirty.top=cm_dirty.bottom=0;
+	}
+}
+
+void gxCanvas::damageBitMask( const RECT &r )const{
+	if( r.left>=r.right || r.top>=r.bottom ) return;
+	if( cm_dirty.left>=cm_dirty.right || cm_dirty.top>=cm_dirty.bottom ){
+		cm_dirty=r;
+		return;
+	}
+	if( r.left<cm_dirty.left ) cm_dirty.left=r.left;
+	if( r.top<cm_dirty.top ) cm_dirty.top=r.top;
+	if( r.right>cm_dirty.right ) cm_dirty.right=r.right;
+	if( r.bottom>cm_dirty.bottom ) cm_dirty.bottom=r.bottom;
+}
+
 void gxCanvas::setModify( int n ){
 	mod_cnt=n;
 }
@@ -280,7 +325,7 @@ void gxCanvas::releaseZBuffer(){
 }
 
 void gxCanvas::damage( const RECT &r )const{
-	++mod_cnt;if( cm_mask ) updateBitMask( r );
+	++mod_cnt;if( cm_mask ) damageBitMask( r );
 }
 
 void gxCanvas::setFont( gxFont *f ){
@@ -289,6 +334,7 @@ void gxCanvas::setFont( gxFont *f ){
 
 void gxCanvas::setMask( unsigned argb ){
 	mask_surf=format.fromARGB( argb );
+	if( cm_mask ) cm_dirty=clip_rect;
 }
 
 void gxCanvas::setColor(unsigned argb) {
@@ -490,45 +536,11 @@ void gxCanvas::rectAlpha(int x, int y, int w, int h, bool solid) {
 
 		if (solid) {
 			for (int py = dest.top; py < dest.bottom; ++py) {
-				for (int px = dest.left; px < dest.right; ++px) {
-					setPixelAlpha(px, py, color_argb);
-				}
+				blendSpan(dest.left, dest.right, py, color_argb);
 			}
 		}
 		else {
-			if (dest.top >= viewport.top && dest.top < viewport.bottom) {
-				for (int px = dest.left; px < dest.right; ++px) {
-					if (px >= viewport.left && px < viewport.right) {
-						setPixelAlpha(px, dest.top, color_argb);
-					}
-				}
-			}
-
-			int bottom_y = y + h - 1;
-			if (bottom_y >= viewport.top && bottom_y < viewport.bottom && bottom_y >= dest.top) {
-				for (int px = dest.left; px < dest.right; ++px) {
-					if (px >= viewport.left && px < viewport.right) {
-						setPixelAlpha(px, bottom_y, color_argb);
-					}
-				}
-			}
-
-			for (int py = dest.top; py < dest.bottom; ++py) {
-				if (py >= viewport.top && py < viewport.bottom) {
-					if (dest.left >= viewport.left && dest.left < viewport.right) {
-						setPixelAlpha(dest.left, py, color_argb);
-					}
-				}
-			}
-
-			int right_x = x + w - 1;
-			if (right_x >= viewport.left && right_x < viewport.right && right_x >= dest.left) {
-				for (int py = dest.top; py < dest.bottom; ++py) {
-					if (py >= viewport.top && py < viewport.bottom) {
-						setPixelAlpha(right_x, py, color_argb);
-					}
-				}
-			}
+			blendFrame(x, y, w, h, color_argb);
 		}
 
 		unlock();
@@ -545,100 +557,23 @@ void gxCanvas::rectGlow(int x, int y, int w, int h, int thickness) {
 
 	if (color_a == 0) return;
 
-	unsigned original_argb = color_argb;
-	int original_a = color_a;
-
 	lock();
 
 	for (int t = 0; t < thickness; ++t) {
 		float distance_factor = 1.0f - ((float)t / (float)thickness);
-		int current_a = (int)(original_a * distance_factor * distance_factor);
+		int current_a = (int)(color_a * distance_factor * distance_factor);
 
 		if (current_a == 0) continue;
 
 		unsigned current_argb = (current_a << 24) | (color_r << 16) | (color_g << 8) | color_b;
 
-		int glow_x = x - t;
-		int glow_y = y - t;
-		int glow_w = w + 2 * t;
-		int glow_h = h + 2 * t;
-
-		for (int px = glow_x; px < glow_x + glow_w; ++px) {
-			if (px >= viewport.left && px < viewport.right &&
-				glow_y >= viewport.top && glow_y < viewport.bottom) {
-				setPixelAlpha(px, glow_y, current_argb);
-			}
-		}
-
-		int glow_bottom_y = glow_y + glow_h - 1;
-		if (glow_bottom_y >= viewport.top && glow_bottom_y < viewport.bottom) {
-			for (int px = glow_x; px < glow_x + glow_w; ++px) {
-				if (px >= viewport.left && px < viewport.right) {
-					setPixelAlpha(px, glow_bottom_y, current_argb);
-				}
-			}
-		}
-
-		for (int py = glow_y; py < glow_y + glow_h; ++py) {
-			if (py >= viewport.top && py < viewport.bottom &&
-				glow_x >= viewport.left && glow_x < viewport.right) {
-				setPixelAlpha(glow_x, py, current_argb);
-			}
-		}
-
-		int glow_right_x = glow_x + glow_w - 1;
-		if (glow_right_x >= viewport.left && glow_right_x < viewport.right) {
-			for (int py = glow_y; py < glow_y + glow_h; ++py) {
-				if (py >= viewport.top && py < viewport.bottom) {
-					setPixelAlpha(glow_right_x, py, current_argb);
-				}
-			}
-		}
+		blendFrame(x - t, y - t, w + 2 * t, h + 2 * t, current_argb);
 	}
 
-	unsigned main_argb = original_argb;
-
-	// top
-	for (int px = x; px < x + w; ++px) {
-		if (px >= viewport.left && px < viewport.right &&
-			y >= viewport.top && y < viewport.bottom) {
-			setPixelAlpha(px, y, main_argb);
-		}
-	}
-
-	// bottom
-	int bottom_y = y + h - 1;
-	if (bottom_y >= viewport.top && bottom_y < viewport.bottom) {
-		for (int px = x; px < x + w; ++px) {
-			if (px >= viewport.left && px < viewport.right) {
-				setPixelAlpha(px, bottom_y, main_argb);
-			}
-		}
-	}
-
-	// left
-	for (int py = y; py < y + h; ++py) {
-		if (py >= viewport.top && py < viewport.bottom &&
-			x >= viewport.left && x < viewport.right) {
-			setPixelAlpha(x, py, main_argb);
-		}
-	}
-
-	// right
-	int right_x = x + w - 1;
-	if (right_x >= viewport.left && right_x < viewport.right) {
-		for (int py = y; py < y + h; ++py) {
-			if (py >= viewport.top && py < viewport.bottom) {
-				setPixelAlpha(right_x, py, main_argb);
-			}
-		}
-	}
+	blendFrame(x, y, w, h, color_argb);
 
 	unlock();
 
-	color_argb = original_argb;
-	color_a = original_a;
-
 	damage(glow_dest);
 }
 // don't do drugs kids
@@ -719,12 +654,7 @@ void gxCanvas::roundedRect(int x, int y, int w, int h, int radius, bool solid) {
 				int x_start = tl_cx - dx;
 				int x_end = tl_cx;
 
-				for (int px = x_start; px <= x_end; ++px) {
-					if (px >= viewport.left && px < viewport.right &&
-						py >= viewport.top && py < viewport.bottom) {
-						setPixelFast(px, py, color_argb);
-					}
-				}
+				blendSpan(x_start, x_end + 1, py, color_argb);
 			}
 
 			// top-right
@@ -736,12 +666,7 @@ void gxCanvas::roundedRect(int x, int y, int w, int h, int radius, bool solid) {
 				int x_start = tr_cx;
 				int x_end = tr_cx + dx;
 
-				for (int px = x_start; px <= x_end; ++px) {
-					if (px >= viewport.left && px < viewport.right &&
-						py >= viewport.top && py < viewport.bottom) {
-						setPixelFast(px, py, color_argb);
-					}
-				}
+				blendSpan(x_start, x_end + 1, py, color_argb);
 			}
 
 			// bottom-left
@@ -753,12 +678,7 @@ void gxCanvas::roundedRect(int x, int y, int w, int h, int radius, bool solid) {
 				int x_start = bl_cx - dx;
 				int x_end = bl_cx;
 
-				for (int px = x_start; px <= x_end; ++px) {
-					if (px >= viewport.left && px < viewport.right &&
-						py >= viewport.top && py < viewport.bottom) {
-						setPixelFast(px, py, color_argb);
-					}
-				}
+				blendSpan(x_start, x_end + 1, py, color_argb);
 			}
 
 			// bottom-right
@@ -770,12 +690,7 @@ void gxCanvas::roundedRect(int x, int y, int w, int h, int radius, bool solid) {
 				int x_start = br_cx;
 				int x_end = br_cx + dx;
 
-				for (int px = x_start; px <= x_end; ++px) {
-					if (px >= viewport.left && px < viewport.right &&
-						py >= viewport.top && py < viewport.bottom) {
-						setPixelFast(px, py, color_argb);
-					}
-				}
+				blendSpan(x_start, x_end + 1, py, color_argb);
 			}
 
 			unlock();
@@ -844,80 +759,29 @@ void gxCanvas::roundedRect(int x, int y, int w, int h, int radius, bool solid) {
 
 		if (solid) {
 			for (int py = dest.top; py < dest.bottom; ++py) {
-				for (int px = dest.left; px < dest.right; ++px) {
-					bool inside = true;
-
-					if (px >= x && px < x + w && py >= y && py < y + h) {
-						if (px < x + radius && py < y + radius) {
-							// top-left
-							int dx = px - tl_cx;
-							int dy = py - tl_cy;
-							if (dx * dx + dy * dy > radius_sq) {
-								inside = false;
-							}
-						}
-						else if (px >= x + w - radius && py < y + radius) {
-							// top-right
-							int dx = px - tr_cx;
-							int dy = py - tr_cy;
-							if (dx * dx + dy * dy > radius_sq) {
-								inside = false;
-							}
-						}
-						else if (px < x + radius && py >= y + h - radius) {
-							// bottom-left
-							int dx = px - bl_cx;
-							int dy = py - bl_cy;
-							if (dx * dx + dy * dy > radius_sq) {
-								inside = false;
-							}
-						}
-						else if (px >= x + w - radius && py >= y + h - radius) {
-							// bottom-right
-							int dx = px - br_cx;
-							int dy = py - br_cy;
-							if (dx * dx + dy * dy > radius_sq) {
-								inside = false;
-							}
-						}
-					}
-					else {
-						inside = false;
-					}
-
-					if (inside) {
-						setPixelAlpha(px, py, color_argb);
-					}
+				// corner rows are inset to the arc
+				int inset = 0;
+				if (py < y + radius) {
+					int dy = py - tl_cy;
+					inset = radius - isqrt(radius_sq - dy * dy);
 				}
+				else if (py >= y + h - radius) {
+					int dy = py - bl_cy;
+					inset = radius - isqrt(radius_sq - dy * dy);
+				}
+				blendSpan(x + inset, x + w - inset, py, color_argb);
 			}
 		}
 		else {
-			for (int px = x + radius; px < x + w - radius; ++px) {
-				if (px >= viewport.left && px < viewport.right &&
-					y >= viewport.top && y < viewport.bottom) {
-					setPixelAlpha(px, y, color_argb);
-				}
-			}
-
-			for (int px = x + radius; px < x + w - radius; ++px) {
-				if (px >= viewport.left && px < viewport.right &&
-					y + h - 1 >= viewport.top && y + h - 1 < viewport.bottom) {
-					setPixelAlpha(px, y + h - 1, color_argb);
-				}
-			}
-
-			for (int py = y + radius; py < y + h - radius; ++py) {
-				if (x >= viewport.left && x < viewport.right &&
-					py >= viewport.top && py < viewport.bottom) {
-					setPixelAlpha(x, py, color_argb);
-				}
-			}
-
-			for (int py = y + radius; py < y + h - radius; ++py) {
-				if (x + w - 1 >= viewport.left && x + w - 1 < viewport.right &&
-					py >= viewport.top && py < viewport.bottom) {
-					setPixelAlpha(x + w - 1, py, color_argb);
-				}
+			blendSpan(x + radius, x + w - radius, y, color_argb);
+			blendSpan(x + radius, x + w - radius, y + h - 1, color_argb);
+
+			int y0 = y + radius, y1 = y + h - radius;
+			if (y0 < viewport.top) y0 = viewport.top;
+			if (y1 > viewport.bottom) y1 = viewport.bottom;
+			for (int py = y0; py < y1; ++py) {
+				blendSpan(x, x + 1, py, color_argb);
+				blendSpan(x + w - 1, x + w, py, color_argb);
 			}
 
 			int f = 1 - radius;
@@ -928,44 +792,20 @@ void gxCanvas::roundedRect(int x, int y, int w, int h, int radius, bool solid) {
 
 			while (xc <= yc) {
 				// top-left
-				if (tl_cx - xc >= viewport.left && tl_cx - xc < viewport.right &&
-					tl_cy - yc >= viewport.top && tl_cy - yc < viewport.bottom) {
-					setPixelAlpha(tl_cx - xc, tl_cy - yc, color_argb);
-				}
-				if (tl_cx - yc >= viewport.left && tl_cx - yc < viewport.right &&
-					tl_cy - xc >= viewport.top && tl_cy - xc < viewport.bottom) {
-					setPixelAlpha(tl_cx - yc, tl_cy - xc, color_argb);
-				}
+				blendSpan(tl_cx - xc, tl_cx - xc + 1, tl_cy - yc, color_argb);
+				blendSpan(tl_cx - yc, tl_cx - yc + 1, tl_cy - xc, color_argb);
 
 				// top-right
-				if (tr_cx + xc >= viewport.left && tr_cx + xc < viewport.right &&
-					tr_cy - yc >= viewport.top && tr_cy - yc < viewport.bottom) {
-					setPixelAlpha(tr_cx + xc, tr_cy - yc, color_argb);
-				}
-				if (tr_cx + yc >= viewport.left && tr_cx + yc < viewport.right &&
-					tr_cy - xc >= viewport.top && tr_cy - xc < viewport.bottom) {
-					setPixelAlpha(tr_cx + yc, tr_cy - xc, color_argb);
-				}
+				blendSpan(tr_cx + xc, tr_cx + xc + 1, tr_cy - yc, color_argb);
+				blendSpan(tr_cx + yc, tr_cx + yc + 1, tr_cy - xc, color_argb);
 
 				// bottom-left
-				if (bl_cx - xc >= viewport.left && bl_cx - xc < viewport.right &&
-					bl_cy + yc >= viewport.top && bl_cy + yc < viewport.bottom) {
-					setPixelAlpha(bl_cx - xc, bl_cy + yc, color_argb);
-				}
-				if (bl_cx - yc >= viewport.left && bl_cx - yc < viewport.right &&
-					bl_cy + xc >= viewport.top && bl_cy + xc < viewport.bottom) {
-					setPixelAlpha(bl_cx - yc, bl_cy + xc, color_argb);
-				}
+				blendSpan(bl_cx - xc, bl_cx - xc + 1, bl_cy + yc, color_argb);
+				blendSpan(bl_cx - yc, bl_cx - yc + 1, bl_cy + xc, color_argb);
 
 				// botttom-right
-				if (br_cx + xc >= viewport.left && br_cx + xc < viewport.right &&
-					br_cy + yc >= viewport.top && br_cy + yc < viewport.bottom) {
-					setPixelAlpha(br_cx + xc, br_cy + yc, color_argb);
-				}
-				if (br_cx + yc >= viewport.left && br_cx + yc < viewport.right &&
-					br_cy + xc >= viewport.top && br_cy + xc < viewport.bottom) {
-					setPixelAlpha(br_cx + yc, br_cy + xc, color_argb);
-				}
+				blendSpan(br_cx + xc, br_cx + xc + 1, br_cy + yc, color_argb);
+				blendSpan(br_cx + yc, br_cx + yc + 1, br_cy + xc, color_argb);
 
 				if (f >= 0) {
 					yc--;
@@ -1048,18 +888,14 @@ void gxCanvas::oval(int x1, int y1, int w, int h, bool solid) {
 			int xb = floor(cx + x);
 
 			if (solid) {
-				for (int px = xa; px <= xb; ++px) {
-					if (px >= dest.left && px < dest.right) {
-						setPixelAlpha(px, py, color_argb);
-					}
-				}
+				blendSpan(xa > dest.left ? xa : dest.left, xb < dest.right ? xb + 1 : dest.right, py, color_argb);
 			}
 			else {
 				if (xa >= dest.left && xa < dest.right) {
-					setPixelAlpha(xa, py, color_argb);
+					blendSpan(xa, xa + 1, py, color_argb);
 				}
 				if (xb >= dest.left && xb < dest.right && xb != xa) {
-					setPixelAlpha(xb, py, color_argb);
+					blendSpan(xb, xb + 1, py, color_argb);
 				}
 			}
 		}
@@ -1171,14 +1007,8 @@ bool gxCanvas::collide( int x1,int y1,const gxCanvas *i2,int x2,int y2,bool soli
 
 	if( solid ) return true;
 
-	if( !cm_mask ){
-		cm_mask=d_new unsigned[cm_pitch*clip_rect.bottom];
-		updateBitMask( clip_rect );
-	}
-	if( !i2->cm_mask ){
-		i2->cm_mask=d_new unsigned[i2->cm_pitch*i2->clip_rect.bottom];
-		i2->updateBitMask( i2->clip_rect );
-	}
+	validateBitMask();
+	i2->validateBitMask();
 
 	const gxCanvas *i1=this;
 
@@ -1259,10 +1089,7 @@ bool gxCanvas::rect_collide( int x1,int y1,int x2,int y2,int w2,int h2,bool soli
 	ir.top=r1.top>r2.top ? r1.top : r2.top;
 	ir.bottom=r1.bottom<r2.bottom ? r1.bottom : r2.bottom;
 
-	if( !cm_mask ){
-		cm_mask=d_new unsigned[cm_pitch*clip_rect.bottom];
-		updateBitMask( clip_rect );
-	}
+	validateBitMask();
 
 	unsigned *s1=cm_mask+(ir.top-r1.top)*cm_pitch;
 
@@ -1303,7 +1130,7 @@ bool gxCanvas::lock()const{
 
 void gxCanvas::unlock()const{
 	if( locked_cnt==1 ){
-		if( lock_mod_cnt!=mod_cnt && cm_mask ) updateBitMask( clip_rect );
+		if( lock_mod_cnt!=mod_cnt && cm_mask ) cm_dirty=clip_rect;
 		surf->Unlock( 0 );
 	}
 	--locked_cnt;
@@ -1330,6 +1157,46 @@ void gxCanvas::setPixelAlpha(int x, int y, unsigned argb) {
 	format.setPixel(locked_surf + y * locked_pitch + x * format.getPitch(), blended);
 }
 
+void gxCanvas::blendSpan( int x0,int x1,int y,unsigned argb ){
+	if( y<viewport.top || y>=viewport.bottom ) return;
+	if( x0<viewport.left ) x0=viewport.left;
+	if( x1>viewport.right ) x1=viewport.right;
+	if( x0>=x1 ) return;
+
+	int pitch=format.getPitch();
+	unsigned char *p=locked_surf+y*locked_pitch+x0*pitch;
+
+	//same results as setPixelAlpha
+	if( color_a==255 ){
+		for( ;x0<x1;++x0,p+=pitch ) format.setPixel( p,argb );
+		return;
+	}
+	int alpha=(argb>>24)*color_a/255;
+	if( !alpha ) return;
+	if( span_format!=SPAN_NONE ){
+		alphaSpan( span_format,p,x1-x0,argb,alpha );
+		return;
+	}
+	for( ;x0<x1;++x0,p+=pitch ){
+		format.setPixel( p,blendColors( format.getPixel( p ),argb,color_a ) );
+	}
+}
+
+//outline, each pixel blended once
+void gxCanvas::blendFrame( int x,int y,int w,int h,unsigned argb ){
+	if( w<=0 || h<=0 ) return;
+	blendSpan( x,x+w,y,argb );
+	if( h>1 ) blendSpan( x,x+w,y+h-1,argb );
+
+	int y0=y+1,y1=y+h-1;
+	if( y0<viewport.top ) y0=viewport.top;
+	if( y1>viewport.bottom ) y1=viewport.bottom;
+	for( ;y0<y1;++y0 ){
+		blendSpan( x,x+1,y0,argb );
+		if( w>1 ) blendSpan( x+w-1,x+w,y0,argb );
+	}
+}
+
 unsigned gxCanvas::getPixel( int x,int y )const{
 	x+=origin_x;if( x<viewport.left || x>=viewport.right ) return format.toARGB( mask_surf );
 	y+=origin_y;if( y<viewport.top || y>=viewport.bottom ) return format.toARGB( mask_surf );
@@ -47,10 +47,12 @@ private:
 
 	mutable int cm_pitch;
 	mutable unsigned *cm_mask;
+	mutable RECT cm_dirty;		//part of cm_mask needing updateBitMask before use
 
 	RECT clip_rect;
 
 	PixelFormat format;
+	int span_format;
 
 	gxFont *font;
 	RECT viewport;
@@ -61,6 +63,12 @@ private:
 	int color_r, color_g, color_b, color_a;
 
 	void updateBitMask( const RECT &r )const;
+	void validateBitMask()const;
+	void damageBitMask( const RECT &r )const;
+
+	//alpha blended drawing of the current color, clipped to the viewport - canvas must be locked
+	void blendSpan( int x0,int x1,int y,unsigned argb );
+	void blendFrame( int x,int y,int w,int h,unsigned argb );
 
 	/***** GX INTERFACE *****/
 public:
@@ -2,7 +2,7 @@
 #include "std.h"
 #include "gxfilesystem.h"
 
-static set<gxDir*> dir_set;
+static ptrset<gxDir> dir_set;
 
 gxFileSystem::gxFileSystem(){
 	dir_set.clear();
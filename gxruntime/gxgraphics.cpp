@@ -5,8 +5,8 @@
 
 extern gxRuntime *gx_runtime;
 
-gxGraphics::gxGraphics( gxRuntime *rt,IDirectDraw7 *dd,IDirectDrawSurface7 *fs,IDirectDrawSurface7 *bs,bool d3d ):
-runtime(rt),dirDraw(dd),dir3d(0),dir3dDev(0),def_font(0),gfx_lost(false),dummy_mesh(0){
+gxGraphics::gxGraphics( gxRuntime *rt,IDirectDraw7 *dd,IDirectDrawSurface7 *fs,IDirectDrawSurface7 *bs,bool d3d,bool hl ):
+runtime(rt),dirDraw(dd),dir3d(0),dir3dDev(0),headless(hl),def_font(0),gfx_lost(false),dummy_mesh(0){
 
 	dirDraw->QueryInterface( IID_IDirectDraw,(void**)&ds_dirDraw );
 
@@ -55,6 +55,7 @@ gxGraphics::~gxGraphics(){
 	while( movie_set.size() ) closeMovie( *movie_set.begin() );
 	while( font_set.size() ) freeFont( *font_set.begin() );
 	while( canvas_set.size() ) freeCanvas( *canvas_set.begin() );
+	flushPreloads();
 
 	set<string>::iterator it;
 	for( it=font_res.begin();it!=font_res.end();++it ) RemoveFontResource( (*it).c_str() );
@@ -170,14 +171,14 @@ bool gxGraphics::restore(){
 	dirDraw->RestoreAllSurfaces();
 
 	//restore all canvases
-	set<gxCanvas*>::iterator it;
+	ptrset<gxCanvas>::iterator it;
 	for( it=canvas_set.begin();it!=canvas_set.end();++it ){
 		(*it)->restore();
 	}
 
 #ifdef PRO
 	//restore all meshes (b3d surfaces)
-	set<gxMesh*>::iterator mesh_it;
+	ptrset<gxMesh>::iterator mesh_it;
 	for( mesh_it=mesh_set.begin();mesh_it!=mesh_set.end();++mesh_it ){
 		(*mesh_it)->restore();
 	}
@@ -280,13 +281,34 @@ gxCanvas *gxGraphics::createCanvas( int w,int h,int flags ){
 }
 
 gxCanvas *gxGraphics::loadCanvas( const string &f,int flags ){
-	ddSurf *s=ddUtil::loadSurface( f,flags,this );
+	ddSurf *s;
+	map<string,ddUtil::Image*>::iterator it=preloads.find( f );
+	if( it!=preloads.end() ){
+		ddUtil::Image *img=it->second;
+		preloads.erase( it );
+		s=ddUtil::loadSurface( img,flags,this );
+		ddUtil::freeImage( img );
+	}else{
+		s=ddUtil::loadSurface( f,flags,this );
+	}
 	if( !s ) return 0;
 	gxCanvas *c=d_new gxCanvas( this,s,flags );
 	canvas_set.insert( c );
 	return c;
 }
 
+void gxGraphics::preloadCanvas( const string &f,ddUtil::Image *img ){
+	ddUtil::Image *&t=preloads[f];
+	if( t ) ddUtil::freeImage( t );
+	t=img;
+}
+
+void gxGraphics::flushPreloads(){
+	map<string,ddUtil::Image*>::iterator it;
+	for( it=preloads.begin();it!=preloads.end();++it ) ddUtil::freeImage( it->second );
+	preloads.clear();
+}
+
 gxCanvas *gxGraphics::verifyCanvas( gxCanvas *c ){
 	return canvas_set.count( c ) || c==front_canvas || c==back_canvas ? c : 0;
 }
@@ -319,7 +341,7 @@ gxFont *gxGraphics::loadFont(const string &f,int height) {
 	}
 
 	gxFont* newFont = new gxFont(ftLibrary, this, f, height);
-	font_set.emplace(newFont);
+	font_set.insert(newFont);
 	return newFont;
 }
 
@@ -486,6 +508,26 @@ static void pickTexFmts( gxGraphics *g,int hi ){
 gxScene *gxGraphics::createScene( int flags ){
 	if( scene_set.size() ) return 0;
 
+	if( headless ){
+		//null scene - textures are plain system memory surfaces
+		memset( &zbuffFmt,0,sizeof(zbuffFmt) );
+		DDPIXELFORMAT argb={sizeof(argb)};
+		argb.dwFlags=DDPF_RGB|DDPF_ALPHAPIXELS;
+		argb.dwRGBBitCount=32;
+		argb.dwRBitMask=0xff0000;
+		argb.dwGBitMask=0x00ff00;
+		argb.dwBBitMask=0x0000ff;
+		argb.dwRGBAlphaBitMask=0xff000000;
+		for( int hi=0;hi<2;++hi ){
+			texRGBFmt[hi]=primFmt;
+			texAlphaFmt[hi]=texRGBAlphaFmt[hi]=texRGBMaskFmt[hi]=argb;
+		}
+		gxScene *scene=d_new gxScene( this,back_canvas );
+		scene_set.insert( scene );
+		dummy_mesh=createMesh( 8,12,0 );
+		return scene;
+	}
+
 	//get d3d
 	if( dirDraw->QueryInterface( IID_IDirect3D7,(void**)&dir3d )>=0 ){
 		//enum devices
@@ -567,8 +609,8 @@ gxMesh *gxGraphics::createMesh( int max_verts,int max_tris,int flags ){
 
 	D3DVERTEXBUFFERDESC desc={ sizeof(desc),vbflags,VTXFMT,max_verts };
 
-	IDirect3DVertexBuffer7 *buff;
-	if( dir3d->CreateVertexBuffer( &desc,&buff,0 )<0 ) return 0;
+	IDirect3DVertexBuffer7 *buff=0;
+	if( !headless && dir3d->CreateVertexBuffer( &desc,&buff,0 )<0 ) return 0;
 	WORD *indices=d_new WORD[max_tris*3];
 	gxMesh *mesh=d_new gxMesh( this,buff,indices,max_verts,max_tris );
 	mesh_set.insert( mesh );
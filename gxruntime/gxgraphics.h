@@ -6,6 +6,7 @@
 #include FT_FREETYPE_H
 
 #include <set>
+#include <map>
 #include <string>
 #include <d3d.h>
 
@@ -33,7 +34,10 @@ public:
 
 	FT_Library ftLibrary;
 
-	gxGraphics( gxRuntime *runtime,IDirectDraw7 *dirDraw,IDirectDrawSurface7 *front,IDirectDrawSurface7 *back,bool d3d );
+	//headless graphics have no 3d device - scenes and meshes are null and only count what they're given
+	bool headless;
+
+	gxGraphics( gxRuntime *runtime,IDirectDraw7 *dirDraw,IDirectDrawSurface7 *front,IDirectDrawSurface7 *back,bool d3d,bool headless );
 	~gxGraphics();
 
 	void backup();
@@ -52,12 +56,13 @@ private:
 	ddSurf *createSurface( int width,int height,int flags );
 	ddSurf *loadSurface( const std::string &f,int flags );
 
-	std::set<gxFont*> font_set;
-	std::set<gxCanvas*> canvas_set;
-	std::set<gxMesh*> mesh_set;
-	std::set<gxScene*> scene_set;
-	std::set<gxMovie*> movie_set;
+	ptrset<gxFont> font_set;
+	ptrset<gxCanvas> canvas_set;
+	ptrset<gxMesh> mesh_set;
+	ptrset<gxScene> scene_set;
+	ptrset<gxMovie> movie_set;
 	std::set<std::string> font_res;
+	std::map<std::string,ddUtil::Image*> preloads;
 
 	DDGAMMARAMP _gammaRamp;
 	IDirectDrawGammaControl *_gamma;
@@ -72,7 +77,8 @@ public:
 		GRAPHICS_SCALED = 2,		//scaled window
 		GRAPHICS_3D = 4,			//3d mode! Hurrah!
 		GRAPHICS_AUTOSUSPEND = 8,	//suspend graphics when app suspended
-		GRAPHICS_BORDERLESS = 16
+		GRAPHICS_BORDERLESS = 16,
+		GRAPHICS_HEADLESS = 32		//no window or 3d hardware, for benchmarking
 	};
 
 	//MANIPULATORS
@@ -111,6 +117,11 @@ public:
 	gxCanvas *verifyCanvas( gxCanvas *canvas );
 	void freeCanvas( gxCanvas *canvas );
 
+	//takes ownership of an image decoded ahead of time - the next loadCanvas of file uses it instead of reading file
+	void preloadCanvas( const std::string &file,ddUtil::Image *img );
+	//frees preloaded images nothing asked for
+	void flushPreloads();
+
 	gxMovie *openMovie( const std::string &file,int flags );
 	gxMovie *verifyMovie( gxMovie *movie );
 	void closeMovie( gxMovie *movie );
@@ -8,20 +8,27 @@
 extern gxRuntime *gx_runtime;
 
 gxMesh::gxMesh( gxGraphics *g,IDirect3DVertexBuffer7 *vs,WORD *is,int max_vs,int max_ts ):
-graphics(g),locked_verts(0),vertex_buff(vs),tri_indices(is),max_verts(max_vs),max_tris(max_ts),mesh_dirty(false){
+graphics(g),locked_verts(0),vertex_buff(vs),tri_indices(is),sys_verts(0),max_verts(max_vs),max_tris(max_ts),mesh_dirty(false){
+	if( !vertex_buff ) sys_verts=d_new dxVertex[max_verts];
 }
 
 gxMesh::~gxMesh(){
 	unlock();
 
-	vertex_buff->Release();
+	if( vertex_buff ) vertex_buff->Release();
 
+	delete[] sys_verts;
 	delete[] tri_indices;
 }
 
 bool gxMesh::lock( bool all ){
 	if( locked_verts ) return true;
 
+	if( sys_verts ){
+		locked_verts=sys_verts;
+		return true;
+	}
+
 	//V1.104
 	//int flags=all ? DDLOCK_DISCARDCONTENTS : 0;
 
@@ -52,7 +59,7 @@ bool gxMesh::lock( bool all ){
 
 void gxMesh::unlock(){
 	if( locked_verts ){
-		vertex_buff->Unlock();
+		if( vertex_buff ) vertex_buff->Unlock();
 		locked_verts=0;
 	}
 }
@@ -100,6 +107,7 @@ void gxMesh::restore(){
 
 void gxMesh::render( int first_vert,int vert_cnt,int first_tri,int tri_cnt ){
 	unlock();
+	if( !vertex_buff ) return;
 	graphics->dir3dDev->DrawIndexedPrimitiveVB(
 		D3DPT_TRIANGLELIST,
 		vertex_buff,first_vert,vert_cnt,
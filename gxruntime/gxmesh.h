@@ -33,6 +33,7 @@ private:
 	gxGraphics *graphics;
 	IDirect3DVertexBuffer7 *vertex_buff;
 	WORD *tri_indices;
+	dxVertex *sys_verts;	//used instead of vertex_buff by headless graphics
 
 	int max_verts,max_tris;
 	bool mesh_dirty;
@@ -44,6 +44,7 @@ static LRESULT CALLBACK windowProc( HWND hwnd,UINT msg,WPARAM wparam,LPARAM lpar
 //1=SCALED WINDOW
 //2=FIXED SIZE WINDOW
 //3=EXCLUSIVE
+//4=HEADLESS
 //
 static int gfx_mode;
 static int border_mode;
@@ -57,7 +58,7 @@ static IDirectDrawClipper *clipper;
 static IDirectDrawSurface7 *primSurf;
 static Debugger *debugger;
 
-static set<gxTimer*> timers;
+static ptrset<gxTimer> timers;
 
 enum{
 	WM_STOP=WM_APP+1,WM_RUN,WM_END
@@ -853,7 +854,7 @@ gxGraphics *gxRuntime::openWindowedGraphics( int w,int h,int d,bool d3d ){
 								primSurf=ps;
 								mod_cnt=0;
 								fs->AddRef();
-								return d_new gxGraphics( this,dd,fs,fs,d3d );
+								return d_new gxGraphics( this,dd,fs,fs,d3d,false );
 							}
 							fs->Release();
 						}
@@ -892,7 +893,7 @@ gxGraphics *gxRuntime::openExclusiveGraphics( int w,int h,int d,bool d3d ){
 				DDSCAPS2 caps={sizeof caps};
 				caps.dwCaps=DDSCAPS_BACKBUFFER;
 				if( ps->GetAttachedSurface( &caps,&bs )>=0 ){
-					return d_new gxGraphics( this,dd,ps,bs,d3d );
+					return d_new gxGraphics( this,dd,ps,bs,d3d,false );
 				}
 				ps->Release();
 			}
@@ -903,6 +904,29 @@ gxGraphics *gxRuntime::openExclusiveGraphics( int w,int h,int d,bool d3d ){
 	return 0;
 }
 
+gxGraphics *gxRuntime::openHeadlessGraphics( int w,int h,int d,bool d3d ){
+
+	//software only, never shown - nothing here needs a display adapter
+	IDirectDraw7 *dd;
+	if( DirectDrawCreateEx( (GUID*)DDCREATE_EMULATIONONLY,(void**)&dd,IID_IDirectDraw7,0 )<0 ) return 0;
+
+	if( dd->SetCooperativeLevel( hwnd,DDSCL_NORMAL )>=0 ){
+		//create front buffer
+		IDirectDrawSurface7 *fs;
+		DDSURFACEDESC2 desc={sizeof(desc)};
+		desc.dwFlags=DDSD_WIDTH|DDSD_HEIGHT|DDSD_CAPS;
+		desc.dwWidth=w;desc.dwHeight=h;
+		desc.ddsCaps.dwCaps=DDSCAPS_OFFSCREENPLAIN|DDSCAPS_SYSTEMMEMORY;
+
+		if( dd->CreateSurface( &desc,&fs,0 )>=0 ){
+			fs->AddRef();
+			return d_new gxGraphics( this,dd,fs,fs,d3d,true );
+		}
+	}
+	dd->Release();
+	return 0;
+}
+
 gxGraphics *gxRuntime::openGraphics( int w,int h,int d,int driver,int flags ){
 	if( graphics ) return 0;
 
@@ -915,7 +939,12 @@ gxGraphics *gxRuntime::openGraphics( int w,int h,int d,int driver,int flags ){
 
 	curr_driver=drivers[driver];
 
-	if( windowed ){
+	if( flags & gxGraphics::GRAPHICS_HEADLESS ){
+		if( graphics=openHeadlessGraphics( w,h,d,d3d ) ){
+			gfx_mode=4;
+			auto_suspend=false;
+		}
+	}else if( windowed ){
 		if( graphics=openWindowedGraphics( w,h,d,d3d ) ){
 			gfx_mode=(flags & gxGraphics::GRAPHICS_SCALED) ? 1 : 2;
 			auto_suspend=(flags & gxGraphics::GRAPHICS_AUTOSUSPEND) ? true : false;
@@ -56,6 +56,7 @@ private:
 	bool setDisplayMode( int w,int h,int d,bool d3d,IDirectDraw7 *dd );
 	gxGraphics *openWindowedGraphics( int w,int h,int d,bool d3d );
 	gxGraphics *openExclusiveGraphics( int w,int h,int d,bool d3d );
+	gxGraphics *openHeadlessGraphics( int w,int h,int d,bool d3d );
 
 	bool enum_all;
 	std::vector<GfxDriver*> drivers;
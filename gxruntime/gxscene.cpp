@@ -13,19 +13,21 @@ static D3DMATRIX sphere_mat,nullmatrix;
 
 void gxScene::setRS( int n,int t ){
 	if( d3d_rs[n]==t ) return;
-	dir3dDev->SetRenderState( (D3DRENDERSTATETYPE)n,t );
+	if( dir3dDev ) dir3dDev->SetRenderState( (D3DRENDERSTATETYPE)n,t );
 	d3d_rs[n]=t;
+	++state_changes;
 }
 
 void gxScene::setTSS( int n,int s,int t ){
 	if( d3d_tss[n][s]==t ) return;
-	dir3dDev->SetTextureStageState( n,(D3DTEXTURESTAGESTATETYPE)s,t );
+	if( dir3dDev ) dir3dDev->SetTextureStageState( n,(D3DTEXTURESTAGESTATETYPE)s,t );
 	d3d_tss[n][s]=t;
+	++state_changes;
 }
 
 gxScene::gxScene( gxGraphics *g,gxCanvas *t ):
 graphics(g),target(t),dir3dDev( g->dir3dDev ),
-n_texs(0),tris_drawn(0){
+n_texs(0),tris_drawn(0),verts_drawn(0),state_changes(0),draw_calls(0){
 
 	memset( d3d_rs,0x55,sizeof(d3d_rs) );
 	memset( d3d_tss,0x55,sizeof(d3d_tss) );
@@ -53,7 +55,13 @@ n_texs(0),tris_drawn(0){
 	can_wb=false;
 	hw_tex_stages=1;
 	D3DDEVICEDESC7 devDesc={0};
-	if( dir3dDev->GetCaps( &devDesc )>=0 ){
+	if( !dir3dDev ){
+		//null device - no limits
+		hw_tex_stages=MAX_TEXTURES;
+		devDesc.dpcTriCaps.dwTextureCaps=D3DPTEXTURECAPS_CUBEMAP;
+		setRS( D3DRENDERSTATE_FOGTABLEMODE,D3DFOG_NONE );
+		setRS( D3DRENDERSTATE_FOGVERTEXMODE,D3DFOG_LINEAR );
+	}else if( dir3dDev->GetCaps( &devDesc )>=0 ){
 		DWORD caps=devDesc.dpcTriCaps.dwRasterCaps;
 		//texture stages
 		hw_tex_stages=devDesc.wMaxSimultaneousTextures;
@@ -88,8 +96,10 @@ n_texs(0),tris_drawn(0){
 	setHWMultiTex( true );
 
 	//ATI lighting hack
-	dir3dDev->LightEnable( 0,true );
-	dir3dDev->LightEnable( 0,false );
+	if( dir3dDev ){
+		dir3dDev->LightEnable( 0,true );
+		dir3dDev->LightEnable( 0,false );
+	}
 
 	//globals
 	sphere_mat._11=.5f;sphere_mat._22=-.5f;sphere_mat._33=.5f;
@@ -117,7 +127,7 @@ n_texs(0),tris_drawn(0){
 	ortho_proj=true;frustum_nr=frustum_fr=frustum_w=frustum_h=0;setPerspProj( 1,1000,1,1 );
 	memset(&viewport,0,sizeof(viewport));viewport.dvMaxZ=1;setViewport( 0,0,target->getWidth(),target->getHeight() );
 	viewmatrix=nullmatrix;setViewMatrix( 0 );
-	worldmatrix=nullmatrix;setWorldMatrix( 0 );
+	memset(&worldmatrix,0,sizeof(worldmatrix));setWorldMatrix( 0 );
 
 	//set default renderstate
 	blend=fx=~0;shininess=1;
@@ -137,7 +147,8 @@ void gxScene::setTexState( int n,const TexState &state,bool tex_blend ){
 	int tc_index=state.flags & TEX_COORDS2 ? 1 : 0;
 
 	//set canvas
-	dir3dDev->SetTexture( n,state.canvas->getTexSurface() );
+	if( dir3dDev ) dir3dDev->SetTexture( n,state.canvas->getTexSurface() );
+	++state_changes;
 
 	//set addressing modes
 	setTSS( n,D3DTSS_ADDRESSU,(flags & gxCanvas::CANVAS_TEX_CLAMPU) ? D3DTADDRESS_CLAMP : D3DTADDRESS_WRAP );
@@ -183,7 +194,7 @@ void gxScene::setTexState( int n,const TexState &state,bool tex_blend ){
 	case gxCanvas::CANVAS_TEX_SPHERE:
 		setTSS( n,D3DTSS_TEXCOORDINDEX,D3DTSS_TCI_CAMERASPACENORMAL );//|tc_index );
 		setTSS( n,D3DTSS_TEXTURETRANSFORMFLAGS,D3DTTFF_COUNT2 );
-		dir3dDev->SetTransform( (D3DTRANSFORMSTATETYPE)(D3DTRANSFORMSTATE_TEXTURE0+n),&sphere_mat );
+		if( dir3dDev ) dir3dDev->SetTransform( (D3DTRANSFORMSTATETYPE)(D3DTRANSFORMSTATE_TEXTURE0+n),&sphere_mat );
 		break;
 	case gxCanvas::CANVAS_TEX_CUBE:
 		switch( state.canvas->cubeMode() & 3 ){
@@ -201,14 +212,14 @@ void gxScene::setTexState( int n,const TexState &state,bool tex_blend ){
 			setTSS( n,D3DTSS_TEXTURETRANSFORMFLAGS,D3DTTFF_DISABLE );
 		}else{
 			setTSS( n,D3DTSS_TEXTURETRANSFORMFLAGS,D3DTTFF_COUNT3 );//COUNT4|D3DTTFF_PROJECTED );
-			dir3dDev->SetTransform( (D3DTRANSFORMSTATETYPE)(D3DTRANSFORMSTATE_TEXTURE0+n),&inv_viewmatrix );
+			if( dir3dDev ) dir3dDev->SetTransform( (D3DTRANSFORMSTATETYPE)(D3DTRANSFORMSTATE_TEXTURE0+n),&inv_viewmatrix );
 		}
 		break;
 	default:
 		setTSS( n,D3DTSS_TEXCOORDINDEX,D3DTSS_TCI_PASSTHRU|tc_index );
 		if( state.mat_valid){
 			setTSS( n,D3DTSS_TEXTURETRANSFORMFLAGS,D3DTTFF_COUNT2 );
-			dir3dDev->SetTransform( (D3DTRANSFORMSTATETYPE)(D3DTRANSFORMSTATE_TEXTURE0+n),(D3DMATRIX*)&state.matrix );
+			if( dir3dDev ) dir3dDev->SetTransform( (D3DTRANSFORMSTATETYPE)(D3DTRANSFORMSTATE_TEXTURE0+n),(D3DMATRIX*)&state.matrix );
 		}else{
 			setTSS( n,D3DTSS_TEXTURETRANSFORMFLAGS,D3DTTFF_DISABLE );
 		}
@@ -272,6 +283,7 @@ void gxScene::setZMode(){
 }
 
 void gxScene::setLights(){
+	if( !dir3dDev ) return;
 	if( fx & FX_FULLBRIGHT ){
 		//no lights on
 		for( int n=0;n<_curLights.size();++n ) dir3dDev->LightEnable( n,false );
@@ -331,7 +343,7 @@ void gxScene::setHWMultiTex( bool e ){
 	for( int n=0;n<8;++n ){
 		setTSS( n,D3DTSS_COLOROP,D3DTOP_DISABLE );
 		setTSS( n,D3DTSS_ALPHAOP,D3DTOP_DISABLE );
-		dir3dDev->SetTexture( n,0 );
+		if( dir3dDev ) dir3dDev->SetTexture( n,0 );
 	}
 	for( int k=0;k<MAX_TEXTURES;++k ){
 		memset( &texstate[k],0,sizeof(texstate[k]) );
@@ -378,7 +390,7 @@ void gxScene::setAmbient2( const float rgb[] ){
 void gxScene::setViewport( int x,int y,int w,int h ){
 	if( x==viewport.dwX && y==viewport.dwY && w==viewport.dwWidth && h==viewport.dwHeight ) return;
 	viewport.dwX=x;viewport.dwY=y;viewport.dwWidth=w;viewport.dwHeight=h;
-	dir3dDev->SetViewport( &viewport );
+	if( dir3dDev ) dir3dDev->SetViewport( &viewport );
 }
 
 void gxScene::setOrthoProj( float nr,float fr,float w,float h ){
@@ -393,7 +405,7 @@ void gxScene::setOrthoProj( float nr,float fr,float w,float h ){
 	projmatrix._34=0;
 	projmatrix._43=-Q*nr;
 	projmatrix._44=1;
-	dir3dDev->SetTransform( D3DTRANSFORMSTATE_PROJECTION,&projmatrix );
+	if( dir3dDev ) dir3dDev->SetTransform( D3DTRANSFORMSTATE_PROJECTION,&projmatrix );
 }
 
 void gxScene::setPerspProj( float nr,float fr,float w,float h ){
@@ -408,7 +420,7 @@ void gxScene::setPerspProj( float nr,float fr,float w,float h ){
 	projmatrix._34=1;
 	projmatrix._43=-Q*nr;
 	projmatrix._44=0;
-	dir3dDev->SetTransform( D3DTRANSFORMSTATE_PROJECTION,&projmatrix );
+	if( dir3dDev ) dir3dDev->SetTransform( D3DTRANSFORMSTATE_PROJECTION,&projmatrix );
 }
 
 void gxScene::setFogColor( const float rgb[3] ){
@@ -454,17 +466,21 @@ void gxScene::setViewMatrix( const Matrix *m ){
 		viewmatrix=inv_viewmatrix=nullmatrix;
 	}
 
-	dir3dDev->SetTransform( D3DTRANSFORMSTATE_VIEW,&viewmatrix );
+	if( dir3dDev ) dir3dDev->SetTransform( D3DTRANSFORMSTATE_VIEW,&viewmatrix );
 }
 
 void gxScene::setWorldMatrix( const Matrix *m ){
+	D3DMATRIX t=nullmatrix;
 	if( m ){
-		memcpy( &worldmatrix._11,m->elements[0],12 );
-		memcpy( &worldmatrix._21,m->elements[1],12 );
-		memcpy( &worldmatrix._31,m->elements[2],12 );
-		memcpy( &worldmatrix._41,m->elements[3],12 );
-	}else worldmatrix=nullmatrix;
-	dir3dDev->SetTransform( D3DTRANSFORMSTATE_WORLD,&worldmatrix );
+		memcpy( &t._11,m->elements[0],12 );
+		memcpy( &t._21,m->elements[1],12 );
+		memcpy( &t._31,m->elements[2],12 );
+		memcpy( &t._41,m->elements[3],12 );
+	}
+	if( !memcmp( &t,&worldmatrix,sizeof(t) ) ) return;
+	worldmatrix=t;
+	if( dir3dDev ) dir3dDev->SetTransform( D3DTRANSFORMSTATE_WORLD,&worldmatrix );
+	++state_changes;
 }
 
 void gxScene::setRenderState( const RenderState &rs ){
@@ -551,7 +567,8 @@ void gxScene::setRenderState( const RenderState &rs ){
 		}
 	}
 	if( setmat ){
-		dir3dDev->SetMaterial( &material );
+		if( dir3dDev ) dir3dDev->SetMaterial( &material );
+		++state_changes;
 	}
 
 	n_texs=0;
@@ -591,13 +608,13 @@ void gxScene::setRenderState( const RenderState &rs ){
 		hw->canvas=0;
 		setTSS( n_texs,D3DTSS_COLOROP,D3DTOP_DISABLE );
 		setTSS( n_texs,D3DTSS_ALPHAOP,D3DTOP_DISABLE );
-		dir3dDev->SetTexture( n_texs,0 );
+		if( dir3dDev ) dir3dDev->SetTexture( n_texs,0 );
 	}
 }
 
 bool gxScene::begin( const vector<gxLight*> &lights ){
 
-	if( dir3dDev->BeginScene()!=D3D_OK ) return false;
+	if( dir3dDev && dir3dDev->BeginScene()!=D3D_OK ) return false;
 
 	//clear textures!
 	int n;
@@ -605,7 +622,7 @@ bool gxScene::begin( const vector<gxLight*> &lights ){
 		texstate[n].canvas=0;
 		setTSS( n,D3DTSS_COLOROP,D3DTOP_DISABLE );
 		setTSS( n,D3DTSS_ALPHAOP,D3DTOP_DISABLE );
-		dir3dDev->SetTexture( n,0 );
+		if( dir3dDev ) dir3dDev->SetTexture( n,0 );
 		setTSS(n, D3DTSS_MIPMAPLODBIAS, textureLodBias);
 	}
 
@@ -614,9 +631,9 @@ bool gxScene::begin( const vector<gxLight*> &lights ){
 	for( n=0;n<8;++n ){
 		if( n<lights.size() ){
 			_curLights.push_back( lights[n] );
-			dir3dDev->SetLight( n,&_curLights[n]->d3d_light );
+			if( dir3dDev ) dir3dDev->SetLight( n,&_curLights[n]->d3d_light );
 		}else{
-			dir3dDev->LightEnable( n,false );
+			if( dir3dDev ) dir3dDev->LightEnable( n,false );
 		}
 	}
 	setLights();
@@ -630,13 +647,15 @@ void gxScene::clear( const float rgb[3],float alpha,float z,bool clear_argb,bool
 	if( !clear_argb && !clear_z ) return;
 	int flags=(clear_argb ? D3DCLEAR_TARGET : 0) | (clear_z ? D3DCLEAR_ZBUFFER : 0);
 	unsigned argb=(int(alpha*255.0f)<<24)|(int(rgb[0]*255.0f)<<16)|(int(rgb[1]*255.0f)<<8)|int(rgb[2]*255.0f);
-	dir3dDev->Clear( 0,0,flags,argb,z,0 );
+	if( dir3dDev ) dir3dDev->Clear( 0,0,flags,argb,z,0 );
 }
 
 void gxScene::render( gxMesh *m,int first_vert,int vert_cnt,int first_tri,int tri_cnt ){
 
 	m->render( first_vert,vert_cnt,first_tri,tri_cnt );
 	tris_drawn+=tri_cnt;
+	verts_drawn+=vert_cnt;
+	++draw_calls;
 	if( n_texs<=tex_stages ) return;
 
 	setTSS( 0,D3DTSS_COLOROP,D3DTOP_SELECTARG1 );
@@ -668,6 +687,8 @@ void gxScene::render( gxMesh *m,int first_vert,int vert_cnt,int first_tri,int tr
 		setTexState( 0,state,false );
 		m->render( first_vert,vert_cnt,first_tri,tri_cnt );
 		tris_drawn+=tri_cnt;
+		verts_drawn+=vert_cnt;
+		++draw_calls;
 	}
 
 	setRS( D3DRENDERSTATE_ALPHABLENDENABLE,false );
@@ -677,7 +698,7 @@ void gxScene::render( gxMesh *m,int first_vert,int vert_cnt,int first_tri,int tr
 }
 
 void gxScene::end(){
-	dir3dDev->EndScene();
+	if( dir3dDev ) dir3dDev->EndScene();
 	RECT r={ viewport.dwX,viewport.dwY,viewport.dwX+viewport.dwWidth,viewport.dwY+viewport.dwHeight };
 	target->damage( r );
 }
@@ -695,3 +716,15 @@ void gxScene::freeLight( gxLight *l ){
 int gxScene::getTrianglesDrawn()const{
 	return tris_drawn;
 }
+
+int gxScene::getVerticesDrawn()const{
+	return verts_drawn;
+}
+
+int gxScene::getStateChanges()const{
+	return state_changes;
+}
+
+int gxScene::getDrawCalls()const{
+	return draw_calls;
+}
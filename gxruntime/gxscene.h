@@ -118,6 +118,9 @@ public:
 
 	//info
 	int getTrianglesDrawn()const;
+	int getVerticesDrawn()const;
+	int getStateChanges()const;
+	int getDrawCalls()const;
 
 	DWORD textureLodBias;
 	int textureAnisotropic;
@@ -146,7 +149,7 @@ private:
 		bool mat_valid;
 	};
 	TexState texstate[MAX_TEXTURES];
-	int n_texs,tris_drawn;
+	int n_texs,tris_drawn,verts_drawn,state_changes,draw_calls;
 
 	std::set<gxLight*> _allLights;
 	std::vector<gxLight*> _curLights;
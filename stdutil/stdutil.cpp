@@ -362,3 +362,78 @@ qstreambuf::int_type qstreambuf::overflow( qstreambuf::int_type c ){
 	*pptr()=traits_type::to_char_type( c );
 	pbump( 1 );return traits_type::not_eof( c );
 }
+
+mmapfile::mmapfile():file(INVALID_HANDLE_VALUE),mapping(0),_data(0),_size(0){
+}
+
+mmapfile::~mmapfile(){
+	close();
+}
+
+bool mmapfile::open( const string &f,bool copy ){
+	close();
+	file=CreateFile( f.c_str(),GENERIC_READ,FILE_SHARE_READ,0,OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,0 );
+	if( file==INVALID_HANDLE_VALUE ) return false;
+	DWORD hi=0,lo=GetFileSize( file,&hi );
+	if( hi || lo>0x7fffffff ){ close();return false; }
+	_size=lo;
+	if( !_size ){
+		//can't map empty files, but they're still valid
+		static const char empty=0;
+		_data=&empty;
+		return true;
+	}
+	mapping=CreateFileMapping( file,0,copy ? PAGE_WRITECOPY : PAGE_READONLY,0,0,0 );
+	if( !mapping ){ close();return false; }
+	_data=(const char*)MapViewOfFile( mapping,copy ? FILE_MAP_COPY : FILE_MAP_READ,0,0,0 );
+	if( !_data ){ close();return false; }
+	return true;
+}
+
+void mmapfile::close(){
+	if( _data && mapping ) UnmapViewOfFile( _data );
+	if( mapping ) CloseHandle( mapping );
+	if( file!=INVALID_HANDLE_VALUE ) CloseHandle( file );
+	file=INVALID_HANDLE_VALUE;
+	mapping=0;
+	_data=0;
+	_size=0;
+}
+
+struct ParallelFor{
+	int n;
+	volatile LONG next;
+	void (*fn)( int,void* );
+	void *ctx;
+};
+
+static DWORD WINAPI parallelForProc( void *p ){
+	ParallelFor *t=(ParallelFor*)p;
+	for(;;){
+		int i=InterlockedIncrement( &t->next )-1;
+		if( i>=t->n ) return 0;
+		t->fn( i,t->ctx );
+	}
+}
+
+void parallelfor( int n,void (*fn)( int,void* ),void *ctx ){
+	ParallelFor t;
+	t.n=n;t.next=0;t.fn=fn;t.ctx=ctx;
+
+	SYSTEM_INFO si;
+	GetSystemInfo( &si );
+	int cnt=si.dwNumberOfProcessors;
+	if( cnt>n ) cnt=n;
+	if( cnt>8 ) cnt=8;
+
+	//calling thread does its share too
+	HANDLE threads[8];
+	int n_threads=0;
+	for( int k=1;k<cnt;++k ){
+		DWORD id;
+		if( HANDLE h=CreateThread( 0,0,parallelForProc,&t,0,&id ) ) threads[n_threads++]=h;
+	}
+	parallelForProc( &t );
+	if( n_threads ) WaitForMultipleObjects( n_threads,threads,TRUE,INFINITE );
+	for( int k=0;k<n_threads;++k ) CloseHandle( threads[k] );
+}
@@ -9,6 +9,7 @@
 #include <string>
 #include <iostream>
 #include <memory>
+#include <string.h>
 
 #ifdef MEMDEBUG
 
@@ -42,6 +43,9 @@ std::string fullfilename( const std::string &t );
 std::string filenamepath( const std::string &t );
 std::string filenamefile( const std::string &t );
 
+//calls fn( i,ctx ) for every i in [0,n) on a few threads, returns when they're all done
+void parallelfor( int n,void (*fn)( int i,void *ctx ),void *ctx );
+
 /*
 //lazy version of auto_ptr
 template<class T>
@@ -73,6 +77,135 @@ private:
 	int_type overflow( int_type c );
 };
 
+//Read-only memory mapped file - a copy view can be written to, changing the
+//memory but not the file
+class mmapfile{
+public:
+	mmapfile();
+	~mmapfile();
+	bool open( const std::string &f,bool copy=false );
+	void close();
+	const char *data()const{ return _data; }
+	int size()const{ return _size; }
+private:
+	void *file,*mapping;
+	const char *_data;
+	int _size;
+	mmapfile( const mmapfile & );
+	mmapfile &operator=( const mmapfile & );
+};
+
+//Set of pointers in an open addressed hash table.
+//
+//For checking handles passed in from Blitz code: count() is a hash and a short
+//probe rather than a tree walk. Iteration order is arbitrary, and inserting
+//or erasing invalidates iterators. Null can't be stored.
+//
+//The table only shrinks on clear(). Shrinking as entries are erased would
+//crowd whatever survives a free-*begin()-until-empty loop, which all sits at
+//the top of the table, into a few long probe runs.
+template<class T>
+class ptrset{
+public:
+	class const_iterator{
+	public:
+		const_iterator():p(0),e(0){}
+		const_iterator( T **p,T **e ):p(p),e(e){ skip(); }
+		T *operator*()const{ return *p; }
+		const_iterator &operator++(){ ++p;skip();return *this; }
+		bool operator==( const const_iterator &t )const{ return p==t.p; }
+		bool operator!=( const const_iterator &t )const{ return p!=t.p; }
+	private:
+		T **p,**e;
+		void skip(){ while( p!=e && !*p ) ++p; }
+	};
+	typedef const_iterator iterator;
+
+	ptrset():slots(0),mask(0),bits(0),cnt(0),first(0){
+		alloc( 4 );
+	}
+	~ptrset(){
+		delete[] slots;
+	}
+	int size()const{
+		return cnt;
+	}
+	const_iterator begin()const{
+		//so freeing *begin() until empty doesn't rescan the emptied slots
+		while( first<=mask && !slots[first] ) ++first;
+		return const_iterator( slots+first,slots+mask+1 );
+	}
+	const_iterator end()const{
+		return const_iterator( slots+mask+1,slots+mask+1 );
+	}
+	int count( T *p )const{
+		if( !p ) return 0;
+		for( int i=home( p );slots[i];i=(i+1)&mask ){
+			if( slots[i]==p ) return 1;
+		}
+		return 0;
+	}
+	bool insert( T *p ){
+		if( !p || count( p ) ) return false;
+		if( (cnt+1)*4>(mask+1)*3 ) rehash( bits+1 );
+		put( p );
+		++cnt;
+		return true;
+	}
+	int erase( T *p ){
+		if( !p ) return 0;
+		int i=home( p );
+		while( slots[i]!=p ){
+			if( !slots[i] ) return 0;
+			i=(i+1)&mask;
+		}
+		//shift back later entries of the probe run into the hole
+		slots[i]=0;
+		for( int j=(i+1)&mask;slots[j];j=(j+1)&mask ){
+			int k=home( slots[j] );
+			if( i<=j ? (k>i && k<=j) : (k>i || k<=j) ) continue;
+			slots[i]=slots[j];
+			slots[j]=0;
+			i=j;
+		}
+		--cnt;
+		return 1;
+	}
+	void clear(){
+		delete[] slots;
+		alloc( 4 );
+	}
+private:
+	T **slots;
+	int mask,bits,cnt;
+	mutable int first;		//no entries below this slot
+
+	int home( T *p )const{
+		return (unsigned)((size_t)p>>3)*2654435761u>>(32-bits);
+	}
+	void alloc( int b ){
+		bits=b;mask=(1<<b)-1;cnt=0;first=mask+1;
+		slots=d_new T*[mask+1];
+		memset( slots,0,(mask+1)*sizeof(T*) );
+	}
+	void put( T *p ){
+		int i=home( p );
+		while( slots[i] ) i=(i+1)&mask;
+		slots[i]=p;
+		if( i<first ) first=i;
+	}
+	void rehash( int b ){
+		T **old=slots;
+		int n=mask+1,c=cnt;
+		alloc( b );
+		for( int k=0;k<n;++k ) if( old[k] ) put( old[k] );
+		cnt=c;
+		delete[] old;
+	}
+	ptrset( const ptrset & );
+	ptrset &operator=( const ptrset & );
+};
+
 template<class T>
 class pool{
 	T *free;